@@ -4,8 +4,44 @@
 #include <cctype>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <algorithm> // For std::all_of
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <deque>
+#include <queue>
+#include <random>
+#include <climits>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#else
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#elif !defined(_WIN32)
+#include <malloc.h>
+#endif
+#if defined(__linux__) && defined(__x86_64__)
+#include <sys/mman.h>
+#endif
 
 using namespace std;
 struct ASTNode;                         // Forward declaration of ASTNode
@@ -41,7 +77,9 @@ enum TokenType
     T_INPUT,
     T_DEF,
     T_COMMA,
-    T_CALL
+    T_CALL,
+    T_LBRACKET,
+    T_RBRACKET
 };
 
 struct Token
@@ -71,6 +109,9 @@ struct TAC
     std::string arg1;
     std::string arg2;
     vector<string> extras;
+    // profile of an `if` or `call`: its counter id, times executed and times the jump was taken, -1 when unknown
+    int profileId = -1;
+    long long hits = -1, taken = -1;
 
     TAC(std::string res, std::string operation = "", std::string a1 = "", std::string a2 = "", vector<string> extras = {})
         : result(res), op(operation), arg1(a1), arg2(a2), extras(extras) {}
@@ -79,7 +120,7 @@ struct TAC
     {
         if (result == "if")
         {
-            cout << result + " " + op + " " + arg1 + " " + arg2 << endl;
+            cout << result + " " + arg1 + " " + op + " " + arg2 + " goto " + extras[0] << endl;
         }
         else if (result == "print")
         {
@@ -102,6 +143,10 @@ struct TAC
             cout << result + " " + arg1 << endl;
         }
         else if (result == "call")
+        {
+            cout << (op.empty() ? "" : op + " = ") + result + " " + arg1 << endl; // op receives the returned value
+        }
+        else if (result == "ret")
         {
             cout << result + " " + arg1 << endl;
         }
@@ -113,6 +158,38 @@ struct TAC
         {
             cout << result << endl;
         }
+        else if (result == "count")
+        {
+            cout << result + " " + arg1 << endl;
+        }
+        else if (op == "array")
+        {
+            cout << "array " << result << "[" << arg1 << "]" << endl;
+        }
+        else if (op == "[]")
+        {
+            cout << result << " = " << arg1 << "[" << arg2 << "]" << endl;
+        }
+        else if (op == "[]=")
+        {
+            cout << result << "[" << arg1 << "] = " << arg2 << endl;
+        }
+        else if (op == "vload")
+        {
+            cout << result << " = vload " << arg1 << "[" << arg2 << "]" << endl;
+        }
+        else if (op == "vstore")
+        {
+            cout << "vstore " << result << "[" << arg1 << "] = " << arg2 << endl;
+        }
+        else if (op == "vsplat" || op == "vsum")
+        {
+            cout << result << " = " << op << " " << arg1 << endl;
+        }
+        else if (op == "vend")
+        {
+            cout << op << endl;
+        }
         else if (arg2.empty())
         {
             std::cout << result << " = " << " " << arg1 << "\n";
@@ -166,6 +243,15 @@ public:
         return -1;
     }
 
+    // element count of an int array, 0 for scalars and unknown names
+    int arraySize(const string variableName, const string scope = "main")
+    {
+        auto it = table.find(variableName + scope);
+        if (it == table.end() || it->second.scope != scope || it->second.dataType != "array")
+            return 0;
+        return stoi(it->second.value);
+    }
+
     // void displaySymbols() const
     // {
     //     cout << "\nSymbol Table:\n";
@@ -176,1945 +262,8947 @@ public:
     //     }
     // }
 };
-struct RegisterInfo
-{
-    bool isFree;
-    string variable; // the variable whose value is inside the register
-    RegisterInfo(string var = "", bool isFree = true)
-        : variable(var), isFree(isFree) {}
-};
-struct DataSegment
-{
-    string var;
-    string type;
-    string val;
-    string scope;
-    DataSegment(string var, string type, string val, string scope = "main") : var(var), type(type), val(val), scope(scope) {}
-};
 
-class Assembly
+// Buffered output straight to a file descriptor. Text is copied into one
+// reusable buffer that is written out whenever it fills up, so the memory
+// used for output stays the same however much is emitted. A chunk too big
+// for the buffer goes out together with the pending text in one writev.
+class FdWriter
 {
 public:
-        string getAssembly()
+    // an empty path writes to stdout
+    FdWriter(const string &path, size_t capacity = 1 << 16) : buffer(new char[capacity]), capacity(capacity)
     {
-        string assembly = "Include Irvine32.inc\n.stack 4086\n.data\n.code\nmain proc\n";
-        // generate main data segment
-        for (auto s : getDataSegmentForScope("main"))
-        {
-            assembly += s;
-        }
-        // generate main assembly
-        for (auto s : mainAssembly)
+        if (path.empty())
         {
-            assembly += s;
+            cout.flush(); // keep anything already printed in front
+            return;
         }
-        assembly += "invoke ExitProcess,0\nmain endp\n";
-        // generate functions
-        for (auto s : functions)
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (fd < 0)
         {
-            assembly += s;
+            cout << "Error: cannot write " << path << endl;
+            exit(1);
         }
-        assembly += "end main\n";
-        return assembly;
+        owned = true;
     }
-
-    Assembly(SymbolTable &symbolTable) : symbolTable(symbolTable)
+    ~FdWriter()
     {
-        regMap["eax"];
-        regMap["ebx"];
-        regMap["ecx"];
-        regMap["edx"];
-
-        funcRegMap["eax"];
-        funcRegMap["ebx"];
-        funcRegMap["ecx"];
-        funcRegMap["edx"];
-
-        insMap["+"] = "Add";
-        insMap["-"] = "Sub";
-        insMap["*"] = "Imul";
-        insMap["/"] = "IDiv";
-        insMap[">"] = "Cmp";
-        insMap["<"] = "Cmp";
-        insMap["=="] = "Cmp";
-        insMap[">="] = "Cmp";
-        insMap["<="] = "Cmp";
-        insMap[">i"] = "JNC";
-        insMap["<i"] = "JC";
-        insMap["<=i"] = "JLE";
-        insMap[">=i"] = "JGE";
-        insMap["==i"] = "JZ";
-        insMap["goto"] = "JMP";
+        flush();
+#ifdef _WIN32
+        if (owned)
+            _close(fd);
+#else
+        if (owned)
+            close(fd);
+#endif
     }
-    // string getDataSegment(string scope = "main")
-    // {
-    //     string dataSegment = ".data\n";
-    //     dataSegment += "newLine db 0Ah, 0\n";
-    //     for (auto ds : dataSegmentVariables)
-    //     {
-    //         if (ds.scope == scope)
-    //         {
-    //             string var = ds.var + " " + ds.type + " " + ds.val;
-    //             dataSegment += var + "\n";
-    //         }
-    //     }
-    //     return dataSegment;
-    // }
-    vector<string> getDataSegmentForScope(string scope)
+
+    void write(const char *data, size_t size)
     {
-        vector<string> dataSegment;
-        for (auto ds : dataSegmentVariables)
+        if (used + size > capacity)
         {
-            if (ds.scope == scope)
+            if (size >= capacity)
             {
-                string var = string("LOCAL ") + ds.var + ":" + ds.type + "\n";
-                dataSegment.push_back(var);
+                writeAll(data, size);
+                return;
             }
+            flush();
         }
-        return dataSegment;
+        memcpy(buffer.get() + used, data, size);
+        used += size;
+    }
+    void write(const string &text) { write(text.data(), text.size()); }
+    void put(char c)
+    {
+        if (used == capacity)
+            flush();
+        buffer[used++] = c;
     }
+    void flush() { writeAll(nullptr, 0); }
 
-    void generateMainAssembly(TAC tac)
+private:
+    unique_ptr<char[]> buffer;
+    size_t capacity;
+    size_t used = 0;
+    int fd = 1;
+    bool owned = false;
+
+    // the buffered text followed by data, retrying short and interrupted writes
+    void writeAll(const char *data, size_t size)
     {
-        if (tac.result == "if")
+        const char *parts[2] = {buffer.get(), data};
+        size_t sizes[2] = {used, size};
+        int first = 0;
+        while (first < 2)
         {
-            if (tac.op == ">")
-            {
-                mainAssembly.push_back(insMap[">i"] + " " + tac.arg2 + "\n"); // arg2 is label
-            }
-            else if (tac.op == "<")
-            {
-                mainAssembly.push_back(insMap["<i"] + " " + tac.arg2 + "\n"); // arg2 is label
-            }
-            else if (tac.op == "==")
+            if (sizes[first] == 0)
             {
-                mainAssembly.push_back(insMap["==i"] + " " + tac.arg2 + "\n"); // arg2 is label
+                first++;
+                continue;
             }
-            else if (tac.op == "<=")
+#ifdef _WIN32
+            long n = _write(fd, parts[first], (unsigned)sizes[first]);
+#else
+            iovec iov[2];
+            for (int k = first; k < 2; k++)
+                iov[k - first] = iovec{(void *)parts[k], sizes[k]};
+            ssize_t n = writev(fd, iov, 2 - first);
+#endif
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
             {
-                mainAssembly.push_back(insMap["<=i"] + " " + tac.arg2 + "\n"); // arg2 is label
+                cerr << "Error: cannot write output" << endl;
+                exit(1);
             }
-            else if (tac.op == ">=")
+            for (size_t left = n; left > 0;)
             {
-                mainAssembly.push_back(insMap[">=i"] + " " + tac.arg2 + "\n"); // arg2 is label
+                size_t step = min(left, sizes[first]);
+                parts[first] += step;
+                sizes[first] -= step;
+                left -= step;
+                if (sizes[first] == 0)
+                    first++;
             }
         }
-        else if (tac.result == "goto")
+        used = 0;
+    }
+};
+
+// Heap use seen through the replaced global operator new and delete below,
+// counted once -fmem-report turns it on; until then they only test a flag.
+// Live bytes use the allocator's block sizes, so a block freed here that was
+// allocated before counting started is subtracted too.
+struct AllocationTracker
+{
+    static bool enabled;
+    static atomic<long long> allocations, bytes, live, peak;
+
+    static void allocated(void *block, size_t size)
+    {
+        allocations.fetch_add(1, memory_order_relaxed);
+        bytes.fetch_add(size, memory_order_relaxed);
+        long long now = live.fetch_add(blockSize(block), memory_order_relaxed) + blockSize(block);
+        long long high = peak.load(memory_order_relaxed);
+        while (now > high && !peak.compare_exchange_weak(high, now, memory_order_relaxed))
         {
-            mainAssembly.push_back(insMap["goto"] + " " + tac.arg1 + "\n"); // arg1 is label
         }
-        else if (tac.result == "label")
+    }
+    static void freed(void *block) { live.fetch_sub(blockSize(block), memory_order_relaxed); }
+
+    // starts a new high-water mark at the current live size and returns the old one
+    static long long resetPeak() { return peak.exchange(live.load(memory_order_relaxed), memory_order_relaxed); }
+    static void restorePeak(long long saved)
+    {
+        long long high = peak.load(memory_order_relaxed);
+        while (saved > high && !peak.compare_exchange_weak(high, saved, memory_order_relaxed))
         {
-            mainAssembly.push_back(tac.arg1 + "\n"); // arg1 is label
         }
-        else if (tac.result == "print")
-        {
-            // string retVal = "push eax\npush edx \n";
-            // retVal += string("Mov EAX,") + " [" + tac.op + "]" + "\n";
-            // retVal += "mov edx, offset newLine \n";
-            // retVal += "Call writeDec \n";
-            // retVal += "call WriteString \n";
-            // retVal += "pop edx\npop eax \n";
+    }
 
-            string retVal = "push eax\n";
-            retVal += string("Mov EAX,") + " [" + tac.op + "]" + "\n";
-            retVal += "Call writeDec \n";
-            retVal += "call CRLF \n";
-            retVal += "pop eax \n";
+    // the process's resident set high-water mark in KB, 0 where it is not available
+    static long peakRss()
+    {
+#ifdef _WIN32
+        return 0;
+#else
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024; // bytes there
+#else
+        return usage.ru_maxrss;
+#endif
+#endif
+    }
 
-            mainAssembly.push_back(retVal);
-        }
+private:
+    static size_t blockSize(void *block)
+    {
+#if defined(_WIN32)
+        return _msize(block);
+#elif defined(__APPLE__)
+        return malloc_size(block);
+#else
+        return malloc_usable_size(block);
+#endif
+    }
+};
+
+bool AllocationTracker::enabled = false;
+atomic<long long> AllocationTracker::allocations{0}, AllocationTracker::bytes{0}, AllocationTracker::live{0},
+    AllocationTracker::peak{0};
+
+void *operator new(size_t size)
+{
+    void *block = malloc(size ? size : 1);
+    if (!block)
+        throw bad_alloc();
+    if (AllocationTracker::enabled)
+        AllocationTracker::allocated(block, size);
+    return block;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const nothrow_t &) noexcept
+{
+    void *block = malloc(size ? size : 1);
+    if (block && AllocationTracker::enabled)
+        AllocationTracker::allocated(block, size);
+    return block;
+}
+void *operator new[](size_t size, const nothrow_t &tag) noexcept { return operator new(size, tag); }
+void operator delete(void *block) noexcept
+{
+    if (block && AllocationTracker::enabled)
+        AllocationTracker::freed(block);
+    free(block);
+}
+void operator delete[](void *block) noexcept { operator delete(block); }
+void operator delete(void *block, size_t) noexcept { operator delete(block); }
+void operator delete[](void *block, size_t) noexcept { operator delete(block); }
+void operator delete(void *block, const nothrow_t &) noexcept { operator delete(block); }
+void operator delete[](void *block, const nothrow_t &) noexcept { operator delete(block); }
+
+// Wall-clock spans of the compiler's phases for -ftime-report and --trace.
+// Spans come from PhaseTimer and may be added from the codegen threads.
+// Nothing is recorded, and the clock is never read, unless tracing was started.
+class PhaseTrace
+{
+public:
+    struct Span
+    {
+        const char *name;
+        string detail;             // the function a per-function span covers, else empty
+        long long start, duration; // microseconds since tracing started
+        int thread;
+        // with -fmem-report: what the span allocated, the most live heap bytes
+        // while it ran and the process's peak RSS in KB when it ended
+        long long allocations = 0, bytes = 0, peakLive = 0;
+        long peakRss = 0;
+    };
+
+    static bool enabled;
+    bool report = false;       // print the per-phase summary to cerr at exit
+    bool memoryReport = false; // count allocations and print them per phase at exit
+    string tracePath;          // Chrome trace-event JSON goes here at exit, if set
+
+    static PhaseTrace &get()
+    {
+        static PhaseTrace trace;
+        return trace;
+    }
+
+    // starts the clock; the report and the trace are written when the process exits
+    void start()
+    {
+        origin = chrono::steady_clock::now();
+        enabled = true;
+        AllocationTracker::enabled = memoryReport;
+        atexit(finish);
+    }
+
+    long long now() const
+    {
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - origin).count();
+    }
 
-        else if (tac.result == "input")
+    void add(Span span)
+    {
+        lock_guard<mutex> lock(spansLock);
+        spans.push_back(move(span));
+    }
+
+    // small ids for threads in the order they first record a span
+    static int threadId()
+    {
+        static atomic<int> next{0};
+        thread_local int id = next++;
+        return id;
+    }
+
+    // one line per phase in the order the phases started, spans of the same name summed
+    void printReport(ostream &out, long long total) const
+    {
+        vector<const char *> order;
+        unordered_map<string, pair<int, long long>> phases; // calls, microseconds
+        for (const auto &span : spans)
         {
-            string retVal = "push eax\n";
-            retVal += "Call ReadInt \n";
-            retVal += string("Mov ") + "[" + tac.op + "]" + ", " + "EAX" + "\n";
-            retVal += "pop eax \n";
-            mainAssembly.push_back(retVal);
+            auto &phase = phases[span.name];
+            if (phase.first++ == 0)
+                order.push_back(span.name);
+            phase.second += span.duration;
         }
-        else if (tac.result == "call")
+        stable_sort(order.begin(), order.end(), [&](const char *a, const char *b)
+                    { return firstStart(a) < firstStart(b); });
+        char line[128];
+        snprintf(line, sizeof line, "time report: %.3f ms total\n", total / 1000.0);
+        out << line;
+        snprintf(line, sizeof line, "  %-18s %8s %12s %7s\n", "phase", "calls", "ms", "%");
+        out << line;
+        for (const char *name : order)
         {
-            string retVal = "PUSHAD\n";
-
-            int numberOfParams = stoi(tac.arg2);
-            if (numberOfParams > 0)
-            {
-                vector<string> parms = tac.extras;
-                for (int i = 0; i < parms.size(); i++)
-                {
-                    try
-                    {
-                        int num = stoi(parms[i]);
-                        retVal += "PUSH " + to_string(num) + "\n";
-                    }
-                    catch (const std::exception &e)
-                    {
-                        string var = parms[i];
-                        retVal += "PUSH [" + var + "]\n";
-                    }
-                }
-            }
-            retVal += "CALL " + tac.arg1 + "\n";
-            retVal += "ADD ESP, " + to_string(numberOfParams * 4) + "\n";
-            retVal += "POPAD\n";
-
-            mainAssembly.push_back(retVal);
+            const auto &phase = phases[name];
+            snprintf(line, sizeof line, "  %-18s %8d %12.3f %6.1f%%\n", name, phase.first, phase.second / 1000.0,
+                     total > 0 ? 100.0 * phase.second / total : 0.0);
+            out << line;
         }
-        else if (tac.arg2.empty())
+    }
+
+    // the same phases by heap use; spans on the codegen threads overlap, so their
+    // figures include whatever the other threads allocated meanwhile
+    void printMemoryReport(ostream &out) const
+    {
+        struct Phase
         {
-            if (isLiteral(tac.arg1))
-            {
-                mainAssembly.push_back(string("Mov ") + string("[") + tac.result + string("]") + " " + "," + tac.arg1 + "\n");
-            }
-            else
-            {
-                bool isFound = false;
-                string retVal;
-                for (auto it : regMap)
-                {
-                    if (it.second.variable == tac.arg1)
-                    {
-                        isFound = true;
-                        regMap[it.first].isFree = true;
-                        mainAssembly.push_back(retVal = string("Mov ") + string("[") + tac.result + string("]") + string(" ") + "," + it.first + "\n");
-                    }
-                }
-                if (!isFound)
-                {
-                    cout << tac.arg1 + " not found in regMap";
-                    exit(1);
-                }
-            }
+            int calls = 0;
+            long long allocations = 0, bytes = 0, peakLive = 0;
+            long peakRss = 0;
+        };
+        vector<const char *> order;
+        unordered_map<string, Phase> phases;
+        for (const auto &span : spans)
+        {
+            Phase &phase = phases[span.name];
+            if (phase.calls++ == 0)
+                order.push_back(span.name);
+            phase.allocations += span.allocations;
+            phase.bytes += span.bytes;
+            phase.peakLive = max(phase.peakLive, span.peakLive);
+            phase.peakRss = max(phase.peakRss, span.peakRss);
         }
-        else
+        stable_sort(order.begin(), order.end(), [&](const char *a, const char *b)
+                    { return firstStart(a) < firstStart(b); });
+        char line[160];
+        snprintf(line, sizeof line, "memory report: %lld allocations, %.3f MB allocated, %.3f MB peak live, %.3f MB peak RSS\n",
+                 AllocationTracker::allocations.load(), AllocationTracker::bytes.load() / 1048576.0,
+                 AllocationTracker::peak.load() / 1048576.0, AllocationTracker::peakRss() / 1024.0);
+        out << line;
+        snprintf(line, sizeof line, "  %-18s %8s %12s %12s %14s %14s\n", "phase", "calls", "allocations", "MB", "peak live MB",
+                 "peak RSS MB");
+        out << line;
+        for (const char *name : order)
         {
-            // case one when both args are digits
-            if (isLiteral(tac.arg1) && isLiteral(tac.arg2))
-            {
-                // load one operand in reg
-                // use that reg as temp and add second
-                string reg = getFreeRegister();
-                if (reg == "null")
-                {
-                    cout << "out of registers";
-                    exit(1);
-                }
-                regMap[reg].isFree = false;
-                regMap[reg].variable = tac.result;
-                string retVal = string("Mov ") + reg + string(" ") + "," + tac.arg1 + "\n";
-                string ins = insMap[tac.op];
-                retVal += ins + string(" ") + reg + string(" ") + "," + tac.arg2 + "\n";
-                mainAssembly.push_back(retVal);
-            }
-            // case one when one is digit and other is temp
-            else if ((isLiteral(tac.arg1) && startsWithTAndNumber(tac.arg2)) || (isLiteral(tac.arg2) && startsWithTAndNumber(tac.arg1)))
-            {
-                // finding literal and temp
-                string literal;
-                string temp;
-                if (isLiteral(tac.arg1))
-                {
-                    literal = tac.arg1;
-                    temp = tac.arg2;
-                }
-                else
-                {
-                    literal = tac.arg2;
-                    temp = tac.arg1;
-                }
-                string tempReg = getTempRegister(temp);
-                if (tempReg == "null")
-                {
-                    cout << temp + " is not assigned any reg";
-                    exit(1);
-                }
-                regMap[tempReg].variable = tac.result;
-                string ins = insMap[tac.op];
-                mainAssembly.push_back(ins + " " + tempReg + " " + "," + literal + "\n");
-            }
-            // case one when one is digit and other is var
-            else if ((isLiteral(tac.arg1) && isAlphanumeric(tac.arg2)) || (isLiteral(tac.arg2) && isAlphanumeric(tac.arg1)))
-            {
-                // finding literal and temp
-                string literal;
-                string var;
-                if (isLiteral(tac.arg1))
-                {
-                    literal = tac.arg1;
-                    var = tac.arg2;
-                }
-                else
-                {
-                    literal = tac.arg2;
-                    var = tac.arg1;
-                }
-                string tempReg = getFreeRegister();
-                if (tempReg == "null")
-                {
-                    cout << "no register avaiable for " + var;
-                    exit(1);
-                }
-                regMap[tempReg].variable = tac.result;
-                regMap[tempReg].isFree = false;
-
-                string ins = insMap[tac.op];
-                string retVal = string("Mov") + " " + tempReg + "," + "[" + var + "]" + "\n";
-                retVal += ins + " " + tempReg + " " + "," + literal + "\n";
-                mainAssembly.push_back(retVal);
-            }
-            // case one when one is temp and other is var
-            else if ((startsWithTAndNumber(tac.arg1) && isAlphanumeric(tac.arg2)) || (startsWithTAndNumber(tac.arg2) && isAlphanumeric(tac.arg1)))
-            {
-                // finding literal and temp
-                string temp;
-                string var;
-                if (startsWithTAndNumber(tac.arg1))
-                {
-                    temp = tac.arg1;
-                    var = tac.arg2;
-                }
-                else
-                {
-                    temp = tac.arg2;
-                    var = tac.arg1;
-                }
-                string tempReg = getTempRegister(temp);
-                if (tempReg == "null")
-                {
-                    cout << temp + " is not assigned any reg";
-                    exit(1);
-                }
-
-                regMap[tempReg].variable = tac.result;
-
-                string ins = insMap[tac.op];
-                mainAssembly.push_back(ins + " " + tempReg + " " + "," + "[" + var + "]" + "\n");
-            }
-            // case one when both are var
-            else if ((isAlphanumeric(tac.arg1) && isAlphanumeric(tac.arg2)))
-            {
-                string var1 = tac.arg1;
-                string var2 = tac.arg2;
+            const Phase &phase = phases[name];
+            snprintf(line, sizeof line, "  %-18s %8d %12lld %12.3f %14.3f %14.3f\n", name, phase.calls, phase.allocations,
+                     phase.bytes / 1048576.0, phase.peakLive / 1048576.0, phase.peakRss / 1024.0);
+            out << line;
+        }
+    }
 
-                string tempReg = getFreeRegister();
-                if (tempReg == "null")
-                {
-                    cout << "no register is available";
-                    exit(1);
-                }
+    // trace-event JSON for chrome://tracing and Perfetto: one complete ("X") event per span
+    string chromeTrace(long long total) const
+    {
+        string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        json += "{\"name\":\"compile\",\"cat\":\"compiler\",\"ph\":\"X\",\"ts\":0,\"dur\":" + to_string(total) +
+                ",\"pid\":1,\"tid\":0}";
+        for (const auto &span : spans)
+        {
+            bool perFunction = !span.detail.empty();
+            json += ",\n{\"name\":\"" + (perFunction ? span.detail : string(span.name)) + "\",\"cat\":\"" +
+                    span.name + "\",\"ph\":\"X\",\"ts\":" + to_string(span.start) + ",\"dur\":" +
+                    to_string(span.duration) + ",\"pid\":1,\"tid\":" + to_string(span.thread);
+            if (memoryReport)
+                json += ",\"args\":{\"allocations\":" + to_string(span.allocations) + ",\"bytes\":" + to_string(span.bytes) +
+                        ",\"peak_live\":" + to_string(span.peakLive) + ",\"peak_rss_kb\":" + to_string(span.peakRss) + "}";
+            json += "}";
+        }
+        return json + "\n]}\n";
+    }
 
-                regMap[tempReg].variable = tac.result;
-                regMap[tempReg].isFree = false;
+private:
+    chrono::steady_clock::time_point origin;
+    mutex spansLock;
+    vector<Span> spans;
 
-                string ins = insMap[tac.op];
-                string retVal = string("Mov") + " " + tempReg + " " + "," + var1 + "\n";
-                retVal += ins + " " + tempReg + " " + "," + " " + var2 + "\n";
-                mainAssembly.push_back(retVal);
-            }
+    long long firstStart(const char *name) const
+    {
+        for (const auto &span : spans)
+        {
+            if (strcmp(span.name, name) == 0)
+                return span.start;
         }
+        return 0;
     }
 
-    void generateFunctionAssembly(TAC tac)
+    static void finish()
     {
-        if (tac.result == "if")
+        PhaseTrace &trace = get();
+        lock_guard<mutex> lock(trace.spansLock);
+        long long total = trace.now();
+        AllocationTracker::enabled = false;
+        if (trace.report)
+            trace.printReport(cerr, total);
+        if (trace.memoryReport)
+            trace.printMemoryReport(cerr);
+        if (!trace.tracePath.empty())
         {
-            if (tac.op == ">")
-            {
-                functions.push_back(insMap[">i"] + " " + tac.arg2 + "\n"); // arg2 is label
-            }
-            else if (tac.op == "<")
-            {
-                functions.push_back(insMap["<i"] + " " + tac.arg2 + "\n"); // arg2 is label
-            }
-            else if (tac.op == "==")
-            {
-                functions.push_back(insMap["==i"] + " " + tac.arg2 + "\n"); // arg2 is label
-            }
-            else if (tac.op == "<=")
-            {
-                functions.push_back(insMap["<=i"] + " " + tac.arg2 + "\n"); // arg2 is label
-            }
-            else if (tac.op == ">=")
-            {
-                functions.push_back(insMap[">=i"] + " " + tac.arg2 + "\n"); // arg2 is label
-            }
+            FdWriter out(trace.tracePath);
+            out.write(trace.chromeTrace(total));
         }
-        else if (tac.result == "goto")
+    }
+};
+
+bool PhaseTrace::enabled = false;
+
+// Times the enclosing scope as one span named `name`; `detail` names the
+// function for per-function spans. A single flag test when tracing is off.
+class PhaseTimer
+{
+public:
+    PhaseTimer(const char *name, const string &detail = string())
+    {
+        if (!PhaseTrace::enabled)
+            return;
+        active = true;
+        span = {name, detail, PhaseTrace::get().now(), 0, PhaseTrace::threadId()};
+        if (AllocationTracker::enabled)
         {
-            functions.push_back(insMap["goto"] + " " + tac.arg1 + "\n"); // arg1 is label
+            span.allocations = AllocationTracker::allocations.load(memory_order_relaxed);
+            span.bytes = AllocationTracker::bytes.load(memory_order_relaxed);
+            outerPeak = AllocationTracker::resetPeak();
         }
-        else if (tac.result == "label")
+    }
+    ~PhaseTimer()
+    {
+        if (!active)
+            return;
+        span.duration = PhaseTrace::get().now() - span.start;
+        if (AllocationTracker::enabled)
         {
-            functions.push_back(tac.arg1 + "\n"); // arg1 is label
+            span.allocations = AllocationTracker::allocations.load(memory_order_relaxed) - span.allocations;
+            span.bytes = AllocationTracker::bytes.load(memory_order_relaxed) - span.bytes;
+            span.peakLive = AllocationTracker::peak.load(memory_order_relaxed);
+            span.peakRss = AllocationTracker::peakRss();
+            AllocationTracker::restorePeak(outerPeak);
         }
-        else if (tac.result == "print")
-        {
-            // string retVal = "push eax\npush edx \n";
-            // retVal += string("Mov EAX,") + " [" + tac.op + "]" + "\n";
-            // retVal += "mov edx, offset newLine \n";
-            // retVal += "Call writeDec \n";
-            // retVal += "call WriteString \n";
-            // retVal += "pop edx\npop eax \n";
+        PhaseTrace::get().add(move(span));
+    }
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
 
-            string retVal = "push eax\n";
-            retVal += string("Mov EAX,") + " [" + tac.op + "]" + "\n";
-            retVal += "Call writeDec \n";
-            retVal += "call CRLF \n";
-            retVal += "pop eax \n";
+private:
+    bool active = false;
+    PhaseTrace::Span span{};
+    long long outerPeak = 0; // the enclosing span's high-water mark, put back when this one ends
+};
 
-            functions.push_back(retVal);
-        }
+// One line of output: an instruction with up to two operands, a label ("L1:")
+// or a directive kept whole in `op` ("findFact PROC", "LOCAL f:dword").
+struct AsmInstruction
+{
+    string op;
+    string dst;
+    string src;
+    AsmInstruction(string op, string dst = "", string src = "") : op(op), dst(dst), src(src) {}
 
-        else if (tac.result == "input")
+    bool isLabel() const { return !op.empty() && op.back() == ':'; }
+    // "op dst, src" and a newline
+    void writeTo(FdWriter &out) const
+    {
+        out.write(op);
+        if (!dst.empty())
         {
-            string retVal = "push eax\n";
-            retVal += "Call ReadInt \n";
-            retVal += string("Mov ") + "[" + tac.op + "]" + ", " + "EAX" + "\n";
-            retVal += "pop eax \n";
-            functions.push_back(retVal);
+            out.put(' ');
+            out.write(dst);
         }
-        else if (tac.result == "function")
+        if (!src.empty())
         {
-            string func = tac.arg1 + " " + "PROC" + "\n";
-            functions.push_back(func);
-            // get function local variables
-            int numberOfLocalVar = 0;
-            for (auto ds : getDataSegmentForScope(tac.arg1))
-            {
-                functions.push_back(ds);
-                numberOfLocalVar++;
-            }
-            int numberOfParams = stoi(tac.arg2);
-            if (numberOfParams > 0)
-            {
-                int index = 8 + 4 * (numberOfLocalVar); // points to last param
-                vector<string> parms = tac.extras;
-                string paramStr = "";
-                for (int i = numberOfParams - 1; i >= 0; i--)
-                {
-                    string param = "MOV EAX, [esp+" + to_string(index) + "] \n";
-                    param += "MOV [" + parms[i] + "], EAX \n";
-                    index += 4;
-                    paramStr += param;
-                }
-                functions.push_back(paramStr);
-            }
+            out.write(", ", 2);
+            out.write(src);
         }
-        else if (tac.result == "call")
-        {
-            string retVal = "PUSHAD\n";
+        out.put('\n');
+    }
+};
+
+// A peephole pattern looks at the window starting at `i` and rewrites it in
+// place, returning true when it changed something.
+struct PeepholeRule
+{
+    string name;
+    function<bool(vector<AsmInstruction> &code, size_t i)> apply;
+};
 
-            int numberOfParams = stoi(tac.arg2);
-            if (numberOfParams > 0)
+class PeepholeOptimizer
+{
+public:
+    PeepholeOptimizer()
+    {
+        // Mov [x], reg ; Mov reg, [x]  ->  Mov [x], reg
+        addRule("store-load", [](vector<AsmInstruction> &code, size_t i)
+                {
+            if (i + 1 >= code.size() || !isOp(code[i], "mov") || !isOp(code[i + 1], "mov"))
+                return false;
+            if (!isMemory(code[i].dst) || !sameName(code[i].dst, code[i + 1].src) || !sameName(code[i].src, code[i + 1].dst))
+                return false;
+            code.erase(code.begin() + i + 1);
+            return true; });
+        // Mov reg, [x] ; Mov [x], reg  ->  Mov reg, [x], unless reg indexes x
+        addRule("load-store", [](vector<AsmInstruction> &code, size_t i)
+                {
+            if (i + 1 >= code.size() || !isOp(code[i], "mov") || !isOp(code[i + 1], "mov"))
+                return false;
+            if (!isMemory(code[i].src) || contains(code[i].src, code[i].dst) || !sameName(code[i].src, code[i + 1].dst) || !sameName(code[i].dst, code[i + 1].src))
+                return false;
+            code.erase(code.begin() + i + 1);
+            return true; });
+        // pop reg ; push reg between two uses that save the same register
+        addRule("pop-push", [](vector<AsmInstruction> &code, size_t i)
+                {
+            if (i + 2 >= code.size() || !isOp(code[i], "pop") || !isOp(code[i + 1], "push") || !sameName(code[i].dst, code[i + 1].dst))
+                return false;
+            // the register is only dead if the next instruction overwrites it
+            const AsmInstruction &next = code[i + 2];
+            bool overwritten = isOp(next, "mov") && sameName(next.dst, code[i].dst) && !contains(next.src, code[i].dst);
+            overwritten = overwritten || (sameName(code[i].dst, "eax") && isOp(next, "call") && sameName(next.dst, "ReadInt"));
+            if (!overwritten)
+                return false;
+            code.erase(code.begin() + i, code.begin() + i + 2);
+            return true; });
+        addRule("push-pop", [](vector<AsmInstruction> &code, size_t i)
+                {
+            if (i + 1 >= code.size() || !isOp(code[i], "push") || !isOp(code[i + 1], "pop") || !sameName(code[i].dst, code[i + 1].dst))
+                return false;
+            code.erase(code.begin() + i, code.begin() + i + 2);
+            return true; });
+        // Add/Sub reg, 0 and Imul reg, 1; branches always follow their own Cmp
+        addRule("identity", [](vector<AsmInstruction> &code, size_t i)
+                {
+            const AsmInstruction &ins = code[i];
+            bool identity = (isOp(ins, "add") || isOp(ins, "sub")) && ins.src == "0";
+            identity = identity || (isOp(ins, "imul") && ins.src == "1");
+            identity = identity || (isOp(ins, "mov") && sameName(ins.dst, ins.src));
+            if (!identity)
+                return false;
+            code.erase(code.begin() + i);
+            return true; });
+        // JMP L with only labels before L:
+        addRule("jump-to-next", [](vector<AsmInstruction> &code, size_t i)
+                {
+            if (!isOp(code[i], "jmp"))
+                return false;
+            for (size_t j = i + 1; j < code.size() && code[j].isLabel(); j++)
             {
-                vector<string> parms = tac.extras;
-                for (int i = 0; i < parms.size(); i++)
+                if (code[j].op == code[i].dst + ":")
                 {
-                    try
-                    {
-                        int num = stoi(parms[i]);
-                        retVal += "PUSH " + to_string(num) + "\n";
-                    }
-                    catch (const std::exception &e)
-                    {
-                        string var = parms[i];
-                        retVal += "PUSH [" + var + "]\n";
-                    }
+                    code.erase(code.begin() + i);
+                    return true;
                 }
             }
-            retVal += "CALL " + tac.arg1 + "\n";
-            retVal += "ADD ESP, " + to_string(numberOfParams * 4) + "\n";
-            retVal += "POPAD\n";
+            return false; });
+    }
 
-            functions.push_back(retVal);
-        }
-        else if (tac.result == "return")
-        {
-            string func = string("ret") + "\n";
-            functions.push_back(func);
-            func = tac.arg1 + " endp\n";
-            functions.push_back(func);
-            funcRegMap["eax"].isFree = true;
-            funcRegMap["ebx"].isFree = true;
-            funcRegMap["ecx"].isFree = true;
-            funcRegMap["edx"].isFree = true;
-        }
+    void addRule(const string &name, function<bool(vector<AsmInstruction> &, size_t)> apply)
+    {
+        rules.push_back(PeepholeRule{name, apply});
+    }
 
-        else if (tac.arg2.empty())
+    void run(vector<AsmInstruction> &code)
+    {
+        instructionsBefore += countInstructions(code);
+        bool changed = true;
+        while (changed)
         {
-            if (isLiteral(tac.arg1))
-            {
-                functions.push_back(string("Mov ") + string("[") + tac.result + string("]") + " " + "," + tac.arg1 + "\n");
-            }
-            else
+            changed = false;
+            for (size_t i = 0; i < code.size(); i++)
             {
-                bool isFound = false;
-                string retVal;
-                for (auto it : funcRegMap)
+                for (const auto &rule : rules)
                 {
-                    if (it.second.variable == tac.arg1)
+                    if (rule.apply(code, i))
                     {
-                        isFound = true;
-                        funcRegMap[it.first].isFree = true;
-                        functions.push_back(retVal = string("Mov ") + string("[") + tac.result + string("]") + string(" ") + "," + it.first + "\n");
+                        ruleHits[rule.name]++;
+                        changed = true;
+                        i = i > 2 ? i - 2 : 0; // a removal can complete an earlier pattern
+                        break;
                     }
                 }
-                if (!isFound)
-                {
-                    cout << tac.arg1 + " not found in funcRegMap";
-                    exit(1);
-                }
+                if (i >= code.size())
+                    break;
             }
         }
-        else
-        {
-            // case one when both args are digits
-            if (isLiteral(tac.arg1) && isLiteral(tac.arg2))
-            {
-                // load one operand in reg
-                // use that reg as temp and add second
-                string reg = getFreeRegisterForFunction();
-                if (reg == "null")
-                {
-                    cout << "out of registers";
-                    exit(1);
-                }
-                funcRegMap[reg].isFree = false;
-                funcRegMap[reg].variable = tac.result;
-                string retVal = string("Mov ") + reg + string(" ") + "," + tac.arg1 + "\n";
-                string ins = insMap[tac.op];
-                retVal += ins + string(" ") + reg + string(" ") + "," + tac.arg2 + "\n";
-                functions.push_back(retVal);
-            }
-            // case one when one is digit and other is temp
-            else if ((isLiteral(tac.arg1) && startsWithTAndNumber(tac.arg2)) || (isLiteral(tac.arg2) && startsWithTAndNumber(tac.arg1)))
-            {
-                // finding literal and temp
-                string literal;
-                string temp;
-                if (isLiteral(tac.arg1))
-                {
-                    literal = tac.arg1;
-                    temp = tac.arg2;
-                }
-                else
-                {
-                    literal = tac.arg2;
-                    temp = tac.arg1;
-                }
-                string tempReg = getTempRegisterForFunction(temp);
-                if (tempReg == "null")
-                {
-                    cout << temp + " is not assigned any reg";
-                    exit(1);
-                }
-                funcRegMap[tempReg].variable = tac.result;
-                string ins = insMap[tac.op];
-                functions.push_back(ins + " " + tempReg + " " + "," + literal + "\n");
-            }
-            // case one when one is digit and other is var
-            else if ((isLiteral(tac.arg1) && isAlphanumeric(tac.arg2)) || (isLiteral(tac.arg2) && isAlphanumeric(tac.arg1)))
-            {
-                // finding literal and temp
-                string literal;
-                string var;
-                if (isLiteral(tac.arg1))
-                {
-                    literal = tac.arg1;
-                    var = tac.arg2;
-                }
-                else
-                {
-                    literal = tac.arg2;
-                    var = tac.arg1;
-                }
-                string tempReg = getFreeRegisterForFunction();
-                if (tempReg == "null")
-                {
-                    cout << "no register avaiable for " + var;
-                    exit(1);
-                }
-                funcRegMap[tempReg].variable = tac.result;
-                funcRegMap[tempReg].isFree = false;
+        instructionsAfter += countInstructions(code);
+    }
 
-                string ins = insMap[tac.op];
-                string retVal = string("Mov") + " " + tempReg + "," + "[" + var + "]" + "\n";
-                retVal += ins + " " + tempReg + " " + "," + literal + "\n";
-                functions.push_back(retVal);
-            }
-            // case one when one is temp and other is var
-            else if ((startsWithTAndNumber(tac.arg1) && isAlphanumeric(tac.arg2)) || (startsWithTAndNumber(tac.arg2) && isAlphanumeric(tac.arg1)))
-            {
-                // finding literal and temp
-                string temp;
-                string var;
-                if (startsWithTAndNumber(tac.arg1))
-                {
-                    temp = tac.arg1;
-                    var = tac.arg2;
-                }
-                else
-                {
-                    temp = tac.arg2;
-                    var = tac.arg1;
-                }
-                string tempReg = getTempRegisterForFunction(temp);
-                if (tempReg == "null")
-                {
-                    cout << temp + " is not assigned any reg";
-                    exit(1);
-                }
+    // the same rules with fresh counters, for optimizing one region on another thread
+    PeepholeOptimizer fork() const
+    {
+        PeepholeOptimizer copy = *this;
+        copy.ruleHits.clear();
+        copy.instructionsBefore = copy.instructionsAfter = 0;
+        return copy;
+    }
 
-                funcRegMap[tempReg].variable = tac.result;
+    void merge(const PeepholeOptimizer &other)
+    {
+        for (const auto &hit : other.ruleHits)
+            ruleHits[hit.first] += hit.second;
+        instructionsBefore += other.instructionsBefore;
+        instructionsAfter += other.instructionsAfter;
+    }
 
-                string ins = insMap[tac.op];
-                functions.push_back(ins + " " + tempReg + " " + "," + "[" + var + "]" + "\n");
-            }
-            // case one when both are var
-            else if ((isAlphanumeric(tac.arg1) && isAlphanumeric(tac.arg2)))
-            {
-                string var1 = tac.arg1;
-                string var2 = tac.arg2;
+    void printStats(ostream &out) const
+    {
+        int removed = instructionsBefore - instructionsAfter;
+        double percent = instructionsBefore ? 100.0 * removed / instructionsBefore : 0;
+        out << "peephole: removed " << removed << " of " << instructionsBefore << " instructions (" << percent << "%)\n";
+        for (const auto &rule : rules)
+        {
+            auto it = ruleHits.find(rule.name);
+            out << "  " << rule.name << ": " << (it == ruleHits.end() ? 0 : it->second) << "\n";
+        }
+    }
 
-                string tempReg = getFreeRegisterForFunction();
-                if (tempReg == "null")
-                {
-                    cout << "no register is available";
-                    exit(1);
-                }
+private:
+    vector<PeepholeRule> rules;
+    unordered_map<string, int> ruleHits;
+    int instructionsBefore = 0;
+    int instructionsAfter = 0;
 
-                funcRegMap[tempReg].variable = tac.result;
-                funcRegMap[tempReg].isFree = false;
+    static string lower(const string &str)
+    {
+        string result = str;
+        transform(result.begin(), result.end(), result.begin(), ::tolower);
+        return result;
+    }
+    static bool isOp(const AsmInstruction &ins, const string &op) { return lower(ins.op) == op; }
+    static bool sameName(const string &a, const string &b) { return !a.empty() && lower(a) == lower(b); }
+    static bool contains(const string &operand, const string &reg) { return lower(operand).find(lower(reg)) != string::npos; }
+    static bool isMemory(const string &operand) { return operand.find('[') != string::npos; }
 
-                string ins = insMap[tac.op];
-                string retVal = string("Mov") + " " + tempReg + " " + "," + var1 + "\n";
-                retVal += ins + " " + tempReg + " " + "," + " " + var2 + "\n";
-                functions.push_back(retVal);
-            }
-        }
+    static int countInstructions(const vector<AsmInstruction> &code)
+    {
+        return count_if(code.begin(), code.end(), [](const AsmInstruction &ins)
+                        { return !ins.isLabel(); });
     }
-    // string getAssembly(TAC tac)
-    // {
-    //     if (tac.result == "if")
-    //     {
-    //         if (tac.op == ">")
-    //         {
-    //             return insMap[">i"] + " " + tac.arg2 + "\n"; // arg2 is label
-    //         }
-    //         else if (tac.op == "<")
-    //         {
-    //             return insMap["<i"] + " " + tac.arg2 + "\n"; // arg2 is label
-    //         }
-    //         else if (tac.op == "==")
-    //         {
-    //             return insMap["==i"] + " " + tac.arg2 + "\n"; // arg2 is label
-    //         }
-    //         else if (tac.op == "<=")
-    //         {
-    //             return insMap["<=i"] + " " + tac.arg2 + "\n"; // arg2 is label
-    //         }
-    //         else if (tac.op == ">=")
-    //         {
-    //             return insMap[">=i"] + " " + tac.arg2 + "\n"; // arg2 is label
-    //         }
-    //     }
-    //     else if (tac.result == "goto")
-    //     {
-    //         return insMap["goto"] + " " + tac.arg1 + "\n"; // arg1 is label
-    //     }
-    //     else if (tac.result == "label")
-    //     {
-    //         return tac.arg1 + "\n"; // arg1 is label
-    //     }
-    //     else if (tac.result == "print")
-    //     {
-    //         // string retVal = "push eax\npush edx \n";
-    //         // retVal += string("Mov EAX,") + " [" + tac.op + "]" + "\n";
-    //         // retVal += "mov edx, offset newLine \n";
-    //         // retVal += "Call writeDec \n";
-    //         // retVal += "call WriteString \n";
-    //         // retVal += "pop edx\npop eax \n";
-
-    //         string retVal = "push eax\n";
-    //         retVal += string("Mov EAX,") + " [" + tac.op + "]" + "\n";
-    //         retVal += "Call writeDec \n";
-    //         retVal += "call CRLF \n";
-    //         retVal += "pop eax \n";
-
-    //         return retVal;
-    //     }
+};
 
-    //     else if (tac.result == "input")
-    //     {
-    //         string retVal = "push eax\n";
-    //         retVal += "Call ReadInt \n";
-    //         retVal += string("Mov ") + "[" + tac.op + "]" + ", " + "EAX" + "\n";
-    //         retVal += "pop eax \n";
-    //         return retVal;
-    //     }
-    //     else if (tac.result == "call")
-    //     {
-    //         string retVal = "PUSHAD\n";
-
-    //         int numberOfParams = stoi(tac.arg2);
-    //         if (numberOfParams > 0)
-    //         {
-    //             vector<string> parms = tac.extras;
-    //             for (int i = 0; i < parms.size(); i++)
-    //             {
-    //                 try
-    //                 {
-    //                     int num = stoi(parms[i]);
-    //                     retVal += "PUSH " + to_string(num) + "\n";
-    //                 }
-    //                 catch (const std::exception &e)
-    //                 {
-    //                     string var = parms[i];
-    //                     retVal += "PUSH [" + var + "]\n";
-    //                 }
-    //             }
-    //         }
-    //         retVal += "CALL " + tac.arg1 + "\n";
-    //         retVal += "ADD ESP, " + to_string(numberOfParams * 4) + "\n";
-    //         retVal += "POPAD\n";
-
-    //         return retVal;
-    //     }
-    //     else if (tac.arg2.empty())
-    //     {
-    //         if (isLiteral(tac.arg1))
-    //         {
-    //             return string("Mov ") + string("[") + tac.result + string("]") + " " + "," + tac.arg1 + "\n";
-    //         }
-    //         else
-    //         {
-    //             bool isFound = false;
-    //             string retVal;
-    //             for (auto it : regMap)
-    //             {
-    //                 if (it.second.variable == tac.arg1)
-    //                 {
-    //                     isFound = true;
-    //                     regMap[it.first].isFree = true;
-    //                     return retVal = string("Mov ") + string("[") + tac.result + string("]") + string(" ") + "," + it.first + "\n";
-    //                 }
-    //             }
-    //             if (!isFound)
-    //             {
-    //                 cout << tac.arg1 + " not found in regMap";
-    //                 exit(1);
-    //             }
-    //         }
-    //     }
-    //     else
-    //     {
-    //         // case one when both args are digits
-    //         if (isLiteral(tac.arg1) && isLiteral(tac.arg2))
-    //         {
-    //             // load one operand in reg
-    //             // use that reg as temp and add second
-    //             string reg = getFreeRegister();
-    //             if (reg == "null")
-    //             {
-    //                 cout << "out of registers";
-    //                 exit(1);
-    //             }
-    //             regMap[reg].isFree = false;
-    //             regMap[reg].variable = tac.result;
-    //             string retVal = string("Mov ") + reg + string(" ") + "," + tac.arg1 + "\n";
-    //             string ins = insMap[tac.op];
-    //             retVal += ins + string(" ") + reg + string(" ") + "," + tac.arg2 + "\n";
-    //             return retVal;
-    //         }
-    //         // case one when one is digit and other is temp
-    //         else if ((isLiteral(tac.arg1) && startsWithTAndNumber(tac.arg2)) || (isLiteral(tac.arg2) && startsWithTAndNumber(tac.arg1)))
-    //         {
-    //             // finding literal and temp
-    //             string literal;
-    //             string temp;
-    //             if (isLiteral(tac.arg1))
-    //             {
-    //                 literal = tac.arg1;
-    //                 temp = tac.arg2;
-    //             }
-    //             else
-    //             {
-    //                 literal = tac.arg2;
-    //                 temp = tac.arg1;
-    //             }
-    //             string tempReg = getTempRegister(temp);
-    //             if (tempReg == "null")
-    //             {
-    //                 cout << temp + " is not assigned any reg";
-    //                 exit(1);
-    //             }
-    //             regMap[tempReg].variable = tac.result;
-    //             string ins = insMap[tac.op];
-    //             return ins + " " + tempReg + " " + "," + literal + "\n";
-    //         }
-    //         // case one when one is digit and other is var
-    //         else if ((isLiteral(tac.arg1) && isAlphanumeric(tac.arg2)) || (isLiteral(tac.arg2) && isAlphanumeric(tac.arg1)))
-    //         {
-    //             // finding literal and temp
-    //             string literal;
-    //             string var;
-    //             if (isLiteral(tac.arg1))
-    //             {
-    //                 literal = tac.arg1;
-    //                 var = tac.arg2;
-    //             }
-    //             else
-    //             {
-    //                 literal = tac.arg2;
-    //                 var = tac.arg1;
-    //             }
-    //             string tempReg = getFreeRegister();
-    //             if (tempReg == "null")
-    //             {
-    //                 cout << "no register avaiable for " + var;
-    //                 exit(1);
-    //             }
-    //             regMap[tempReg].variable = tac.result;
-    //             regMap[tempReg].isFree = false;
-
-    //             string ins = insMap[tac.op];
-    //             string retVal = string("Mov") + " " + tempReg + "," + "[" + var + "]" + "\n";
-    //             retVal += ins + " " + tempReg + " " + "," + literal + "\n";
-    //             return retVal;
-    //         }
-    //         // case one when one is temp and other is var
-    //         else if ((startsWithTAndNumber(tac.arg1) && isAlphanumeric(tac.arg2)) || (startsWithTAndNumber(tac.arg2) && isAlphanumeric(tac.arg1)))
-    //         {
-    //             // finding literal and temp
-    //             string temp;
-    //             string var;
-    //             if (startsWithTAndNumber(tac.arg1))
-    //             {
-    //                 temp = tac.arg1;
-    //                 var = tac.arg2;
-    //             }
-    //             else
-    //             {
-    //                 temp = tac.arg2;
-    //                 var = tac.arg1;
-    //             }
-    //             string tempReg = getTempRegister(temp);
-    //             if (tempReg == "null")
-    //             {
-    //                 cout << temp + " is not assigned any reg";
-    //                 exit(1);
-    //             }
-
-    //             regMap[tempReg].variable = tac.result;
-
-    //             string ins = insMap[tac.op];
-    //             return ins + " " + tempReg + " " + "," + "[" + var + "]" + "\n";
-    //         }
-    //         // case one when both are var
-    //         else if ((isAlphanumeric(tac.arg1) && isAlphanumeric(tac.arg2)))
-    //         {
-    //             string var1 = tac.arg1;
-    //             string var2 = tac.arg2;
-
-    //             string tempReg = getFreeRegister();
-    //             if (tempReg == "null")
-    //             {
-    //                 cout << "no register is available";
-    //                 exit(1);
-    //             }
-
-    //             regMap[tempReg].variable = tac.result;
-    //             regMap[tempReg].isFree = false;
-
-    //             string ins = insMap[tac.op];
-    //             string retVal = string("Mov") + " " + tempReg + " " + "," + var1 + "\n";
-    //             retVal += ins + " " + tempReg + " " + "," + " " + var2 + "\n";
-    //             return retVal;
-    //         }
-    //     }
-    // }
+// A temp's lifetime in TAC positions and where it lives for all of it.
+struct LiveInterval
+{
+    string value; // a temp, or a variable with its whole live range
+    int start;
+    int end;
+    double weight = 0;          // accesses, scaled by 10 per enclosing loop
+    string reg;                 // empty once spilled to the temp's stack slot
+    bool acrossDivide = false; // live across IDiv, which clobbers EAX and EDX
+    bool acrossCall = false;   // live across a call, which may clobber EAX, ECX and EDX
+
+    LiveInterval(const string &value, int start, int end) : value(value), start(start), end(end) {}
+
+    double spillCost() const { return weight / (end - start + 1); }
+    // true when an instruction inside the interval overwrites reg
+    bool clobbered(const string &reg) const
+    {
+        bool divideRegister = reg == "eax" || reg == "edx";
+        return (acrossDivide && divideRegister) || (acrossCall && (divideRegister || reg == "ecx"));
+    }
+};
+
+// Linear-scan register allocation (Poletto & Sarkar) for the temps of one
+// region. Temps are expression values defined once and used once or twice,
+// so an interval never needs splitting: a spilled temp simply keeps its value
+// in a stack slot between its definition and its uses. Variables can be
+// promoted by passing their live ranges in; one that gets a register keeps
+// it for its whole range and never touches memory, one that does not stays
+// in its frame slot. When every register is busy at some instruction one is
+// held back as a scratch register, since memory-to-memory moves and compares
+// need a register in between.
+class LinearScanAllocator
+{
+public:
+    vector<LiveInterval> intervals;
+    string scratch; // reserved scratch register, empty when none was needed
 
-    string getTempRegister(const std::string &temp)
+    LinearScanAllocator(const vector<string> &registers) : registers(registers) {}
+
+    // foldedInto[i] >= 0 when instruction i is computed as part of that later
+    // instruction; its result never lives anywhere and its operands are read there
+    void run(const vector<TAC> &code, const vector<int> &foldedInto, const vector<LiveInterval> &variables = {})
     {
-        for (auto it : regMap)
+        buildIntervals(code, foldedInto, variables);
+        allocate();
+        if (!hasFreeRegisterEverywhere(code.size()))
         {
-            if (it.second.variable == temp)
-                return it.first;
+            scratch = registers.back();
+            registers.pop_back();
+            allocate();
         }
-        return "null";
-    }
-    string getTempRegisterForFunction(const std::string &temp)
-    {
-        for (auto it : funcRegMap)
+        occupancy.assign(code.size(), 0);
+        spanning.assign(code.size(), 0);
+        for (const auto &interval : intervals)
         {
-            if (it.second.variable == temp)
-                return it.first;
+            if (interval.reg.empty())
+                continue;
+            unsigned bit = 1u << registerIndex(interval.reg);
+            for (int i = max(interval.start, 0); i <= interval.end; i++)
+            {
+                occupancy[i] |= bit;
+                if (i > interval.start && i < interval.end)
+                    spanning[i] |= bit;
+            }
         }
-        return "null";
     }
-    string getFreeRegister()
+
+    // register holding a temp or promoted variable, empty when it has none
+    string location(const string &value) const
     {
-        for (auto it : regMap)
-        {
-            if (it.second.isFree)
-                return it.first;
-        }
-        return "null";
+        auto it = index.find(value);
+        return it == index.end() ? "" : intervals[it->second].reg;
+    }
+    bool isSpilled(const string &value) const
+    {
+        auto it = index.find(value);
+        return it != index.end() && intervals[it->second].reg.empty();
     }
-    string getFreeRegisterForFunction()
+
+    // a register no interval holds at instruction i, operands included
+    string freeRegisterAt(int i, const string &except = "") const
     {
-        for (auto it : funcRegMap)
+        for (size_t r = 0; r < registers.size(); r++)
         {
-            if (it.second.isFree)
-                return it.first;
+            if (!(occupancy[i] & (1u << r)) && registers[r] != except)
+                return registers[r];
         }
-        return "null";
+        return scratch != except ? scratch : "";
     }
-    bool startsWithTAndNumber(const std::string &str)
+
+    bool holdsAcross(const string &reg, int i) const
     {
-        // Check if the string is long enough and follows the required format
-        return str.length() >= 2 && str[0] == 't' && std::isdigit(str[1]);
+        size_t r = registerIndex(reg);
+        return r < registers.size() && (spanning[i] & (1u << r));
     }
-    bool isAlphanumeric(const std::string &str)
+
+    static bool isTemp(const string &value)
     {
-        if (startsWithTAndNumber(str))
-            return false;
-        return all_of(str.begin(), str.end(), ::isalnum);
+        return value.length() >= 2 && value[0] == 't' && isdigit(value[1]);
     }
-    bool isLiteral(const std::string &value)
+
+    static string labelName(const string &label)
     {
-        // Check for integer literal
-        if (!value.empty() && std::isdigit(value[0]))
+        return !label.empty() && label.back() == ':' ? label.substr(0, label.size() - 1) : label;
+    }
+
+    // loop depth of every instruction from backward branches, used to weigh accesses
+    static vector<int> loopDepths(const vector<TAC> &code)
+    {
+        unordered_map<string, int> labels;
+        for (int i = 0; i < (int)code.size(); i++)
         {
-            for (char c : value)
+            if (code[i].result == "label")
+                labels[labelName(code[i].arg1)] = i;
+        }
+        vector<int> depth(code.size() + 1, 0);
+        for (int j = 0; j < (int)code.size(); j++)
+        {
+            string target = code[j].result == "goto" ? code[j].arg1 : code[j].result == "if" ? code[j].extras[0] : "";
+            auto it = labels.find(target);
+            if (it != labels.end() && it->second <= j)
             {
-                if (!std::isdigit(c))
-                {
-                    return false;
-                }
+                depth[it->second]++;
+                depth[j + 1]--;
             }
-            return true;
         }
+        for (size_t i = 1; i < depth.size(); i++)
+            depth[i] += depth[i - 1];
+        return depth;
+    }
 
-        // Check for string literal (enclosed in quotes)
-        if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
-        {
-            return true;
-        }
+private:
+    vector<string> registers;
+    unordered_map<string, size_t> index; // temp -> interval
+    vector<unsigned> occupancy;          // per instruction, bit r set while registers[r] is held
+    vector<unsigned> spanning;           // the same, but only where the interval also continues past it
 
-        return false;
+    int registerIndex(const string &reg) const
+    {
+        return find(registers.begin(), registers.end(), reg) - registers.begin();
     }
-    void declareVariablesInDataSegment()
+
+    void buildIntervals(const vector<TAC> &code, const vector<int> &foldedInto, const vector<LiveInterval> &variables)
     {
-        for (auto sym : symbolTable.table)
+        vector<int> depth = loopDepths(code);
+        unordered_set<string> folded;
+        for (int i = 0; i < (int)code.size(); i++)
+        {
+            if (foldedInto[i] >= 0)
+                folded.insert(code[i].result);
+        }
+        auto touch = [&](const string &value, int i)
         {
-            if (sym.second.dataType == "int")
+            if (!isTemp(value) || folded.count(value))
+                return;
+            auto it = index.find(value);
+            if (it == index.end())
+            {
+                index[value] = intervals.size();
+                intervals.emplace_back(value, i, i);
+                it = index.find(value);
+            }
+            LiveInterval &interval = intervals[it->second];
+            interval.end = max(interval.end, i);
+            interval.weight += pow(10.0, min(depth[i], 4));
+        };
+        for (int i = 0; i < (int)code.size(); i++)
+        {
+            const TAC &tac = code[i];
+            if (tac.result == "if")
+            {
+                touch(tac.arg1, i);
+                touch(tac.arg2, i);
+            }
+            else if (tac.result == "call")
+            {
+                for (const auto &arg : tac.extras)
+                    touch(arg, i);
+                touch(tac.op, i); // the returned value
+            }
+            else if (tac.result == "ret")
+            {
+                touch(tac.arg1, i);
+            }
+            else if (tac.result != "goto" && tac.result != "label" && tac.result != "print" && tac.result != "input" &&
+                     tac.result != "function" && tac.result != "return")
             {
-                dataSegmentVariables.push_back(DataSegment(sliceString(sym.first, sym.second.scope), "dword", "", sym.second.scope));
+                int at = foldedInto[i] >= 0 ? foldedInto[i] : i;
+                touch(tac.arg1, at);
+                touch(tac.arg2, at);
+                touch(tac.result, at);
             }
         }
+        if (!variables.empty())
+        {
+            intervals.insert(intervals.end(), variables.begin(), variables.end());
+            stable_sort(intervals.begin(), intervals.end(), [](const LiveInterval &a, const LiveInterval &b)
+                        { return a.start < b.start; });
+            for (size_t k = 0; k < intervals.size(); k++)
+                index[intervals[k].value] = k;
+        }
+        // divisions and calls before each instruction, so an interval counts the ones strictly inside it
+        int n = code.size();
+        vector<int> divides(n + 1, 0), calls(n + 1, 0);
+        for (int i = 0; i < n; i++)
+        {
+            divides[i + 1] = divides[i] + (code[i].op == "/");
+            calls[i + 1] = calls[i] + (code[i].result == "call");
+        }
+        for (auto &interval : intervals)
+        {
+            int first = max(interval.start + 1, 0), last = min(interval.end, n);
+            if (first >= last)
+                continue;
+            interval.acrossDivide = divides[last] > divides[first];
+            interval.acrossCall = calls[last] > calls[first];
+        }
     }
-    string sliceString(const std::string &source, const std::string &lengthReference)
-    {
-        // Calculate how many characters to remove
-        size_t lengthToRemove = lengthReference.length();
 
-        // Ensure we do not remove more characters than the source has
-        if (lengthToRemove >= source.length())
+    // intervals are already sorted by start point
+    void allocate()
+    {
+        vector<LiveInterval *> active;
+        vector<bool> busy(registers.size(), false);
+        for (auto &current : intervals)
         {
-            return ""; // Return an empty string if we remove everything or more
+            current.reg.clear();
+            for (size_t a = 0; a < active.size();)
+            {
+                // an operand's register can hold the result of the instruction that kills it
+                if (active[a]->end <= current.start)
+                {
+                    busy[registerIndex(active[a]->reg)] = false;
+                    active.erase(active.begin() + a);
+                }
+                else
+                    a++;
+            }
+            auto free = find(busy.begin(), busy.end(), false);
+            for (size_t r = 0; (current.acrossDivide || current.acrossCall) && r < registers.size(); r++)
+            {
+                // saves a push/pop pair around every division or call it spans
+                if (!busy[r] && !current.clobbered(registers[r]))
+                {
+                    free = busy.begin() + r;
+                    break;
+                }
+            }
+            if (free != busy.end())
+            {
+                current.reg = registers[free - busy.begin()];
+                *free = true;
+                active.push_back(&current);
+                continue;
+            }
+            // spill the cheapest of the active intervals and the new one
+            LiveInterval *victim = &current;
+            for (auto *candidate : active)
+            {
+                bool cheaper = candidate->spillCost() < victim->spillCost();
+                bool tie = candidate->spillCost() == victim->spillCost() && candidate->end > victim->end;
+                if (cheaper || tie)
+                    victim = candidate;
+            }
+            if (victim != &current)
+            {
+                current.reg = victim->reg;
+                victim->reg.clear();
+                active.erase(find(active.begin(), active.end(), victim));
+                active.push_back(&current);
+            }
         }
-
-        // Return the sliced string
-        return source.substr(0, source.length() - lengthToRemove);
     }
 
-private:
-    unordered_map<string, RegisterInfo> regMap;
-    unordered_map<string, RegisterInfo> funcRegMap;
-    unordered_map<string, string> insMap;
-    vector<DataSegment> dataSegmentVariables;
-    SymbolTable &symbolTable;
-    vector<string> functions;
-    vector<string> mainAssembly;
+    bool hasFreeRegisterEverywhere(size_t size) const
+    {
+        vector<int> live(size + 1, 0);
+        for (const auto &interval : intervals)
+        {
+            if (!interval.reg.empty())
+            {
+                live[max(interval.start, 0)]++;
+                live[interval.end + 1]--;
+            }
+        }
+        int count = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            count += live[i];
+            if (count >= (int)registers.size())
+                return false;
+        }
+        return true;
+    }
 };
 
-struct ASTNode
+// A tree pattern covering a root instruction together with the instruction
+// that computes one of its operands. `cost` returns the estimated instruction
+// count of the combined cover, or -1 when the pair does not have the shape.
+struct TreeRule
 {
-    string value;
-    vector<std::shared_ptr<ASTNode>> children;
-
-    ASTNode(const std::string &val) : value(val) {}
+    string name;
+    function<int(const TAC &root, const TAC &child)> cost;
 };
-using ASTNodePtr = shared_ptr<ASTNode>;
 
-class Lexer
+// Tree-pattern instruction selection in the style of BURS. Temps used once
+// link TAC instructions into expression trees; a tree rule is chosen at a
+// root when it is cheaper than covering root and child separately with the
+// single-node rules (estimated by nodeCost). Folded children are computed
+// inside their root and never get a register of their own.
+class InstructionSelector
 {
-
-private:
-    string src;
-    size_t pos;
-    size_t lineNo;
-    /*
-    It hold positive values.
-    In C++, size_t is an unsigned integer data type used to represent the
-    size of objects in bytes or indices, especially when working with memory-related
-    functions, arrays, and containers like vector or string. You can also use the int data type but size_t is recommended one
-    */
-
 public:
-    Lexer(const string &src)
+    vector<int> foldedInto; // root each instruction was folded into, -1 if none
+    vector<int> child;      // the folded child at each root, -1 if none
+    vector<string> rule;    // tree rule chosen at each root, empty for single-node rules
+    bool variablesInRegisters = false; // variables are expected to be promoted, not in memory
+
+    InstructionSelector()
     {
-        this->src = src;
-        this->pos = 0;
-        this->lineNo = 0;
+        // x = x op y  ->  add/sub [x], y  or  shl [x], k; imul x, y once x is in a register
+        rules.push_back(TreeRule{"rmw", [this](const TAC &root, const TAC &child)
+                                 {
+            if (!isCopy(root) || root.arg1 != child.result || !isArithmetic(child))
+                return -1;
+            const string &x = root.result;
+            if (!isVariable(x) || child.op == "/")
+                return -1;
+            string other = child.arg1 == x ? child.arg2 : (child.op == "+" || child.op == "*") && child.arg2 == x ? child.arg1 : "";
+            if (other.empty())
+                return -1;
+            if (child.op == "*" && powerOfTwo(other) > 0)
+                return 1;
+            if (variablesInRegisters)
+                return 1;
+            // memory to memory is not encodable, and neither is Imul into memory
+            return child.op != "*" && !isVariable(other) ? 1 : -1; }});
+        // t = x + y * {1,2,4,8}  ->  lea reg, [x + y*k]
+        rules.push_back(TreeRule{"lea-scaled", [](const TAC &root, const TAC &child)
+                                 {
+            if (!isArithmetic(root) || root.op != "+" || child.op != "*")
+                return -1;
+            bool literalFirst = isLiteralValue(child.arg1);
+            int k = scale(literalFirst ? child.arg1 : child.arg2);
+            string y = literalFirst ? child.arg2 : child.arg1;
+            if (k == 0 || isLiteralValue(y))
+                return -1;
+            string x = root.arg1 == child.result ? root.arg2 : root.arg1;
+            return 1 + isVariable(y) + isVariable(x); }});
     }
+    // the rules refer back to the selector that owns them
+    InstructionSelector(const InstructionSelector &) = delete;
 
-    vector<Token> tokenize()
+    void select(const vector<TAC> &code)
     {
-        vector<Token> tokens;
-        while (pos < src.size())
+        int n = code.size();
+        foldedInto.assign(n, -1);
+        child.assign(n, -1);
+        rule.assign(n, "");
+        unordered_map<string, int> uses;
+        unordered_map<string, int> definedAt;
+        for (int i = 0; i < n; i++)
         {
-            char current = src[pos];
-
-            if (current == '/')
+            for (const string *value : operands(code[i]))
+                uses[*value]++;
+            if (isArithmetic(code[i]) || isCopy(code[i]))
+                definedAt[code[i].result] = i;
+        }
+        for (int j = 0; j < n; j++)
+        {
+            for (const string *value : operands(code[j]))
             {
-                if (pos + 1 < src.size())
+                auto def = definedAt.find(*value);
+                if (!LinearScanAllocator::isTemp(*value) || uses[*value] != 1 || def == definedAt.end())
+                    continue;
+                int i = def->second;
+                if (i >= j || !rule[i].empty() || !isArithmetic(code[i]) || !canMove(code, i, j))
+                    continue;
+                int separate = nodeCost(code[i]) + nodeCost(code[j]);
+                for (const auto &candidate : rules)
                 {
-                    if (src[pos + 1] == '/')
+                    int cost = candidate.cost(code[j], code[i]);
+                    if (cost >= 0 && cost < separate)
                     {
-                        while (current != '\n')
-                        {
-                            pos++;
-                            current = src[pos];
-                        }
-                        this->lineNo++;
-                        pos++;
-                        continue;
+                        separate = cost;
+                        rule[j] = candidate.name;
+                        child[j] = i;
                     }
                 }
+                if (!rule[j].empty())
+                {
+                    foldedInto[i] = j;
+                    break;
+                }
             }
-            if (current == '\n')
-            {
-                this->lineNo++;
-                pos++;
-                continue;
-            }
-            if (isspace(current))
-            {
-                pos++;
-                continue;
-            }
-            if (isdigit(current))
-            {
-                tokens.push_back(Token{T_NUM, consumeNumber(), this->lineNo});
-                continue;
-            }
-            if (isalpha(current))
-            {
-                string word = consumeWord();
-                if (word == "int")
-                    tokens.push_back(Token{T_INT, word, this->lineNo});
-                else if (word == "if")
-                    tokens.push_back(Token{T_IF, word, this->lineNo});
-                else if (word == "else")
-                    tokens.push_back(Token{T_ELSE, word, this->lineNo});
-                else if (word == "return")
-                    tokens.push_back(Token{T_RETURN, word, this->lineNo});
-                else if (word == "for")
-                    tokens.push_back(Token{T_FOR, word, this->lineNo});
-                else if (word == "while")
-                    tokens.push_back(Token{T_WHILE, word, this->lineNo});
-                else if (word == "print")
-                    tokens.push_back(Token{T_PRINT, word, this->lineNo});
-                else if (word == "input")
-                    tokens.push_back(Token{T_INPUT, word, this->lineNo});
-                else if (word == "def")
-                    tokens.push_back(Token{T_DEF, word, this->lineNo});
-                else if (word == "call")
+        }
+    }
+
+    // estimated instruction count of the cheapest single-node cover
+    static int nodeCost(const TAC &tac)
+    {
+        if (isCopy(tac))
+            return isVariable(tac.result) && isVariable(tac.arg1) ? 2 : 1;
+        if (!isArithmetic(tac))
+            return 0;
+        bool constant = isLiteralValue(tac.arg1) || isLiteralValue(tac.arg2);
+        if (tac.op == "*")
+            return constant ? 2 : 4;
+        if (tac.op == "/")
+            return !isLiteralValue(tac.arg2) ? 25 : powerOfTwo(tac.arg2) > 0 ? 5 : 7;
+        return 2;
+    }
+
+    static bool isArithmetic(const TAC &tac)
+    {
+        return tac.op == "+" || tac.op == "-" || tac.op == "*" || tac.op == "/";
+    }
+    static bool isCopy(const TAC &tac)
+    {
+        return tac.op == "=" && tac.arg2.empty();
+    }
+    static bool isLiteralValue(const string &value)
+    {
+        return !value.empty() && (isdigit(value[0]) || (value[0] == '-' && value.size() > 1));
+    }
+    static bool isVariable(const string &value)
+    {
+        return !value.empty() && !isLiteralValue(value) && !LinearScanAllocator::isTemp(value) && value[0] != '%';
+    }
+    // k when value is the literal 2^k with k >= 1, otherwise 0
+    static int powerOfTwo(const string &value)
+    {
+        if (!isLiteralValue(value) || value.size() > 10)
+            return 0;
+        long long c = stoll(value);
+        if (c < 2 || c > (1LL << 30) || (c & (c - 1)))
+            return 0;
+        int k = 0;
+        while ((1LL << k) < c)
+            k++;
+        return k;
+    }
+    // SIB scale factor for a literal, 0 when it is not one
+    static int scale(const string &value)
+    {
+        return value == "1" || value == "2" || value == "4" || value == "8" ? stoi(value) : 0;
+    }
+
+private:
+    vector<TreeRule> rules;
+
+    static vector<const string *> operands(const TAC &tac)
+    {
+        if (tac.result == "if")
+            return {&tac.arg1, &tac.arg2};
+        if (isArithmetic(tac))
+            return {&tac.arg1, &tac.arg2};
+        if (isCopy(tac))
+            return {&tac.arg1};
+        vector<const string *> values;
+        if (tac.result == "call")
+        {
+            for (const auto &arg : tac.extras)
+                values.push_back(&arg);
+        }
+        if (tac.result == "ret")
+            values.push_back(&tac.arg1);
+        return values;
+    }
+
+    // the child may only move to its root when nothing in between changes its operands
+    static bool canMove(const vector<TAC> &code, int i, int j)
+    {
+        for (int k = i + 1; k < j; k++)
+        {
+            const TAC &tac = code[k];
+            if (tac.result == "label" || tac.result == "call" || tac.result == "ret" || tac.result == "function" || tac.result == "return")
+                return false;
+            string written = tac.result == "input" ? tac.op : isCopy(tac) || isArithmetic(tac) ? tac.result : "";
+            if (!written.empty() && (written == code[i].arg1 || written == code[i].arg2))
+                return false;
+        }
+        return true;
+    }
+};
+
+// Allocation counters; every codegen job keeps its own and they are summed.
+struct RegisterStats
+{
+    int regions = 0;
+    int intervals = 0;
+    int spilled = 0;
+    int spillLoads = 0;
+    int spillStores = 0;
+    int scratchReserved = 0;
+    int frameless = 0;   // leaf defs with every variable in a register
+    int variables = 0;   // variables in the other regions
+    int promoted = 0;    // of those, kept in a register for their whole live range
+    int frameSlots = 0;  // EBP slots in the other regions
+    int frameValues = 0; // variables and spilled temps sharing those slots
+
+    void add(const RegisterStats &other)
+    {
+        regions += other.regions;
+        intervals += other.intervals;
+        spilled += other.spilled;
+        spillLoads += other.spillLoads;
+        spillStores += other.spillStores;
+        scratchReserved += other.scratchReserved;
+        frameless += other.frameless;
+        variables += other.variables;
+        promoted += other.promoted;
+        frameSlots += other.frameSlots;
+        frameValues += other.frameValues;
+    }
+};
+
+// Stack frame of one region. analyze() finds the region's variables in its
+// own code and gives each one live range from liveness over its basic blocks;
+// the register allocator takes those ranges alongside the temps. assign()
+// then gives every value left in memory an EBP offset, and values whose
+// ranges never overlap share a slot. The slots with the most (loop-weighted)
+// accesses get the offsets nearest EBP, so hot values keep a one-byte
+// displacement. Arrays take consecutive slots below all of those.
+class FrameLayout
+{
+public:
+    vector<LiveInterval> variables;     // one range per variable; values set up on entry start at -1
+    vector<string> zeroed;              // variables read before any write, cleared on entry like the other targets do
+    unordered_map<string, int> offsets; // value -> EBP offset, always negative
+    vector<pair<string, int>> arrays;   // name and size, in declaration order
+    unordered_map<string, int> elements; // array -> EBP offset of element 0
+    unordered_map<string, int> lengths;  // array -> element count
+    int slots = 0;
+    int values = 0; // variables and temps given a slot
+    int arrayWords = 0;
+
+    int size() const { return 4 * (slots + arrayWords); }
+
+    void analyze(const vector<TAC> &code, const vector<int> &foldedInto)
+    {
+        int n = code.size();
+        vector<int> depth = LinearScanAllocator::loopDepths(code);
+        vector<vector<int>> uses(n), defs(n);
+        unordered_map<string, int> id;
+        vector<string> names;
+        vector<double> weight;
+        unordered_set<string> arrayNames;
+        for (const auto &tac : code)
+        {
+            if (tac.op == "array" && arrayNames.insert(tac.result).second)
+                arrays.emplace_back(tac.result, stoi(tac.arg1));
+        }
+        auto refer = [&](vector<vector<int>> &list, const string &value, int i)
+        {
+            if (!InstructionSelector::isVariable(value) || arrayNames.count(value))
+                return;
+            auto it = id.find(value);
+            if (it == id.end())
+            {
+                it = id.emplace(value, names.size()).first;
+                names.push_back(value);
+                weight.push_back(0);
+            }
+            list[i].push_back(it->second);
+            weight[it->second] += pow(10.0, min(depth[i], 4));
+        };
+        for (int i = 0; i < n; i++)
+        {
+            const TAC &tac = code[i];
+            if (tac.result == "if")
+            {
+                refer(uses, tac.arg1, i);
+                refer(uses, tac.arg2, i);
+            }
+            else if (tac.result == "print")
+                refer(uses, tac.op, i);
+            else if (tac.result == "input")
+                refer(defs, tac.op, i);
+            else if (tac.result == "call")
+            {
+                for (const auto &arg : tac.extras)
+                    refer(uses, arg, i);
+                refer(defs, tac.op, i);
+            }
+            else if (tac.result == "ret")
+                refer(uses, tac.arg1, i);
+            else if (tac.result == "function")
+            {
+                for (const auto &param : tac.extras)
+                    refer(defs, param, i);
+            }
+            else if (tac.result != "label" && tac.result != "goto" && tac.result != "return")
+            {
+                // a folded instruction reads its operands at its root
+                int at = foldedInto[i] >= 0 ? foldedInto[i] : i;
+                refer(uses, tac.arg1, at);
+                refer(uses, tac.arg2, at);
+                refer(defs, tac.result, at);
+            }
+        }
+
+        // basic blocks: a label starts one, a jump or ret ends one
+        vector<int> starts;
+        unordered_map<string, int> blockOfLabel;
+        for (int i = 0; i < n; i++)
+        {
+            const string &previous = i > 0 ? code[i - 1].result : "";
+            if (i == 0 || code[i].result == "label" || previous == "goto" || previous == "if" || previous == "ret")
+                starts.push_back(i);
+            if (code[i].result == "label")
+                blockOfLabel[LinearScanAllocator::labelName(code[i].arg1)] = starts.size() - 1;
+        }
+        int blocks = starts.size();
+        starts.push_back(n);
+        vector<vector<int>> successors(blocks);
+        for (int b = 0; b < blocks; b++)
+        {
+            const TAC &last = code[starts[b + 1] - 1];
+            if (last.result == "goto" || last.result == "if")
+                successors[b].push_back(blockOfLabel.at(LinearScanAllocator::labelName(last.result == "goto" ? last.arg1 : last.extras[0])));
+            if (last.result != "goto" && last.result != "ret" && last.result != "return" && b + 1 < blocks)
+                successors[b].push_back(b + 1);
+        }
+
+        // live variables as bitsets, solved backwards to a fixed point
+        int words = (names.size() + 63) / 64;
+        vector<vector<uint64_t>> gen(blocks, vector<uint64_t>(words)), kill = gen, in = gen, out = gen;
+        auto set = [](vector<uint64_t> &bits, int v, bool on)
+        {
+            if (on)
+                bits[v / 64] |= 1ull << (v % 64);
+            else
+                bits[v / 64] &= ~(1ull << (v % 64));
+        };
+        for (int b = 0; b < blocks; b++)
+        {
+            for (int i = starts[b + 1] - 1; i >= starts[b]; i--)
+            {
+                for (int v : defs[i])
+                {
+                    set(gen[b], v, false);
+                    set(kill[b], v, true);
+                }
+                for (int v : uses[i])
+                    set(gen[b], v, true);
+            }
+        }
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (int b = blocks - 1; b >= 0; b--)
+            {
+                for (int w = 0; w < words; w++)
+                {
+                    uint64_t live = 0;
+                    for (int next : successors[b])
+                        live |= in[next][w];
+                    out[b][w] = live;
+                    uint64_t entry = gen[b][w] | (live & ~kill[b][w]);
+                    changed = changed || entry != in[b][w];
+                    in[b][w] = entry;
+                }
+            }
+        }
+
+        // one range per variable, from the first to the last point it is live
+        // or referenced; values set up by the prologue start before the code
+        vector<int> lo(names.size(), INT_MAX), hi(names.size(), -1);
+        auto extend = [&](int v, int i)
+        {
+            lo[v] = min(lo[v], i);
+            hi[v] = max(hi[v], i);
+        };
+        auto forEach = [&](const vector<uint64_t> &bits, const function<void(int)> &visit)
+        {
+            for (int v = 0; v < (int)names.size(); v++)
+            {
+                if (bits[v / 64] >> (v % 64) & 1)
+                    visit(v);
+            }
+        };
+        for (int b = 0; b < blocks; b++)
+        {
+            for (int i = starts[b]; i < starts[b + 1]; i++)
+            {
+                for (int v : uses[i])
+                    extend(v, i);
+                for (int v : defs[i])
+                    extend(v, i);
+            }
+            forEach(out[b], [&](int v)
+                    { extend(v, starts[b + 1] - 1); });
+            forEach(in[b], [&](int v)
+                    { extend(v, starts[b]); });
+        }
+        if (blocks > 0)
+        {
+            forEach(in[0], [&](int v)
+                    {
+                zeroed.push_back(names[v]);
+                lo[v] = -1; });
+        }
+        if (n > 0 && code[0].result == "function")
+        {
+            for (int v : defs[0])
+                lo[v] = -1;
+        }
+
+        for (int v = 0; v < (int)names.size(); v++)
+        {
+            variables.emplace_back(names[v], lo[v], hi[v]);
+            variables.back().weight = weight[v];
+        }
+    }
+
+    // slots for the values that stayed in memory
+    void assign(vector<LiveInterval> ranges)
+    {
+        stable_sort(ranges.begin(), ranges.end(), [](const LiveInterval &a, const LiveInterval &b)
+                    { return a.start < b.start; });
+
+        // interval-graph colouring: a slot is free again once its range has
+        // ended, and an operand's slot can take the result of the instruction
+        // that last reads it
+        vector<pair<int, int>> active; // end, slot
+        priority_queue<int, vector<int>, greater<int>> free;
+        vector<double> slotWeight;
+        vector<int> slotOf(ranges.size());
+        for (int r = 0; r < (int)ranges.size(); r++)
+        {
+            for (size_t a = 0; a < active.size();)
+            {
+                if (active[a].first <= ranges[r].start)
+                {
+                    free.push(active[a].second);
+                    active.erase(active.begin() + a);
+                }
+                else
+                    a++;
+            }
+            if (free.empty())
+            {
+                free.push(slotWeight.size());
+                slotWeight.push_back(0);
+            }
+            slotOf[r] = free.top();
+            free.pop();
+            slotWeight[slotOf[r]] += ranges[r].weight;
+            active.push_back({ranges[r].end, slotOf[r]});
+        }
+
+        vector<int> order(slotWeight.size());
+        for (int k = 0; k < (int)order.size(); k++)
+            order[k] = k;
+        stable_sort(order.begin(), order.end(), [&](int a, int b)
+                    { return slotWeight[a] > slotWeight[b]; });
+        vector<int> rank(order.size());
+        for (int k = 0; k < (int)order.size(); k++)
+            rank[order[k]] = k;
+        for (int r = 0; r < (int)ranges.size(); r++)
+            offsets[ranges[r].value] = -4 * (rank[slotOf[r]] + 1);
+        slots = slotWeight.size();
+        values = ranges.size();
+        for (const auto &array : arrays)
+        {
+            arrayWords += array.second;
+            elements[array.first] = -4 * (slots + arrayWords);
+            lengths[array.first] = array.second;
+        }
+    }
+};
+
+// Intel-syntax text for the vectorizer's operations, shared by the MASM and
+// GAS backends. %vK lives in xmmK, or ymmK with AVX2, and xmm6 and xmm7 are
+// scratch. SSE2 has no 32-bit lane multiply, so v* multiplies the even and
+// the odd lanes with Pmuludq and interleaves the low halves of the products.
+class VectorAsm
+{
+public:
+    bool avx2 = false;
+
+    VectorAsm(function<void(const string &, const string &, const string &)> emit, bool avx2)
+        : avx2(avx2), emit(emit) {}
+
+    // the ops the Vectorizer emits; print, input and call keep a variable name in op
+    static bool handles(const string &op)
+    {
+        return op == "vload" || op == "vstore" || op == "vsplat" || op == "vsum" || op == "vend" || op == "v+" ||
+               op == "v-" || op == "v*" || op == "v<<";
+    }
+
+    string reg(const string &value) const { return (avx2 ? "ymm" : "xmm") + value.substr(2); }
+    string memory(const string &address) const { return (avx2 ? "YMMWORD PTR " : "XMMWORD PTR ") + address; }
+
+    // value is a 32-bit register or memory operand, or empty for zero
+    void splat(const string &vector, const string &value)
+    {
+        string x = reg(vector);
+        string low = "xmm" + vector.substr(2);
+        if (value.empty())
+            avx2 ? emit("vpxor", x, x + ", " + x) : emit("pxor", x, x);
+        else if (avx2)
+        {
+            emit("vmovd", low, value);
+            emit("vpbroadcastd", x, low);
+        }
+        else
+        {
+            emit("movd", x, value);
+            emit("pshufd", x, x + ", 0");
+        }
+    }
+
+    void load(const string &vector, const string &address) { emit(avx2 ? "vmovdqu" : "movdqu", reg(vector), memory(address)); }
+    void store(const string &address, const string &vector) { emit(avx2 ? "vmovdqu" : "movdqu", memory(address), reg(vector)); }
+
+    void arithmetic(const string &op, const string &result, const string &lhs, const string &rhs)
+    {
+        string d = reg(result), a = reg(lhs);
+        if (op == "v<<")
+        {
+            if (avx2)
+                emit("vpslld", d, a + ", " + rhs);
+            else
+            {
+                if (d != a)
+                    emit("movdqa", d, a);
+                emit("pslld", d, rhs);
+            }
+            return;
+        }
+        string b = reg(rhs);
+        if (avx2)
+        {
+            emit(op == "v+" ? "vpaddd" : op == "v-" ? "vpsubd" : "vpmulld", d, a + ", " + b);
+            return;
+        }
+        if (op == "v*")
+        {
+            emit("pshufd", "xmm6", a + ", 245"); // odd lanes into the even positions
+            emit("pshufd", "xmm7", b + ", 245");
+            emit("pmuludq", "xmm6", "xmm7");
+            emit("pshufd", "xmm6", "xmm6, 8"); // low halves of the products
+            emit("movdqa", "xmm7", a);
+            emit("pmuludq", "xmm7", b);
+            emit("pshufd", "xmm7", "xmm7, 8");
+            emit("punpckldq", "xmm7", "xmm6");
+            emit("movdqa", d, "xmm7");
+            return;
+        }
+        string instruction = op == "v+" ? "paddd" : "psubd";
+        if (d == a)
+            emit(instruction, d, b);
+        else if (d == b && op == "v+")
+            emit(instruction, d, a);
+        else if (d == b)
+        {
+            emit("movdqa", "xmm6", a);
+            emit(instruction, "xmm6", b);
+            emit("movdqa", d, "xmm6");
+        }
+        else
+        {
+            emit("movdqa", d, a);
+            emit(instruction, d, b);
+        }
+    }
+
+    // total of the lanes into a 32-bit register or memory operand
+    void sum(const string &result, const string &vector)
+    {
+        string x = "xmm" + vector.substr(2);
+        if (avx2)
+        {
+            emit("vextracti128", "xmm6", reg(vector) + ", 1");
+            emit("vpaddd", "xmm6", "xmm6, " + x);
+            emit("vpshufd", "xmm7", "xmm6, 78");
+            emit("vpaddd", "xmm6", "xmm6, xmm7");
+            emit("vpshufd", "xmm7", "xmm6, 177");
+            emit("vpaddd", "xmm6", "xmm6, xmm7");
+            emit("vmovd", result, "xmm6");
+            return;
+        }
+        emit("pshufd", "xmm6", x + ", 78"); // swap the halves
+        emit("paddd", "xmm6", x);
+        emit("pshufd", "xmm7", "xmm6, 177"); // swap neighbours
+        emit("paddd", "xmm6", "xmm7");
+        emit("movd", result, "xmm6");
+    }
+
+    // the upper ymm halves are cleared before any SSE code runs again
+    void end()
+    {
+        if (avx2)
+            emit("vzeroupper", "", "");
+    }
+
+private:
+    function<void(const string &, const string &, const string &)> emit;
+};
+
+// Lowers one region (a def or the main program) to MASM. A job owns its
+// selector, allocator, stats and output and only reads the opcode map, so
+// regions can be lowered on any thread.
+//
+// Calls are fastcall-style: the first two arguments go in ECX and EDX, the
+// rest are pushed left to right and popped by the caller, and the value comes
+// back in EAX. The caller saves EAX, ECX and EDX only around calls they hold a
+// temp across; a def pushes the EBX, ESI and EDI it uses below its frame.
+// Everything else lives in the EBP frame FrameLayout plans.
+class RegionCodegen
+{
+public:
+    vector<AsmInstruction> output;
+    RegisterStats stats;
+    bool checksBounds = false;   // some element access calls outOfBounds
+    bool returnsValue = false;   // some call site reads this def's value
+    bool promoteVariables = true; // variables may live in registers instead of frame slots
+    bool avx2 = false;            // vector loops use ymm registers
+
+    RegionCodegen(const unordered_map<string, string> &insMap) : insMap(insMap) {}
+
+    void run(const vector<TAC> &code)
+    {
+        vector<AsmInstruction> &out = output;
+        InstructionSelector selector;
+        selector.variablesInRegisters = promoteVariables;
+        selector.select(code);
+        bool isFunction = !code.empty() && code.front().result == "function";
+        scope = isFunction ? code.front().arg1 : "main";
+        loops = 0;
+        vector<string> registers;
+        if (isFunction && assignRegisterHomes(code, registers))
+        {
+            allocator.reset(new LinearScanAllocator(registers));
+            allocator->run(code, selector.foldedInto);
+            bool spills = any_of(allocator->intervals.begin(), allocator->intervals.end(), [](const LiveInterval &interval)
+                                 { return interval.reg.empty(); });
+            if (spills)
+            {
+                // a spilled temp needs a frame after all
+                allocator.reset();
+                homes.clear();
+            }
+        }
+        frameless = allocator != nullptr;
+        stats.frameless += frameless;
+        layout = FrameLayout();
+        // frameless defs also need it to know which variables start at zero
+        layout.analyze(code, selector.foldedInto);
+        if (!frameless)
+        {
+            // variables compete for registers with the temps over their live ranges
+            allocator.reset(new LinearScanAllocator({"eax", "ebx", "ecx", "edx", "esi", "edi"}));
+            allocator->run(code, selector.foldedInto, promoteVariables ? layout.variables : vector<LiveInterval>());
+
+            // arguments past the second are read where the caller pushed them
+            unordered_set<string> onStack;
+            const vector<string> &params = isFunction ? code.front().extras : vector<string>();
+            for (int p = 2; p < (int)params.size(); p++)
+            {
+                homes[params[p]] = "DWORD PTR [ebp+" + to_string(8 + 4 * ((int)params.size() - 1 - p)) + "]";
+                onStack.insert(params[p]);
+            }
+            vector<LiveInterval> inMemory;
+            for (const auto &interval : allocator->intervals)
+            {
+                bool temp = LinearScanAllocator::isTemp(interval.value);
+                if (interval.reg.empty() && !onStack.count(interval.value))
+                    inMemory.push_back(interval);
+                stats.spilled += temp && interval.reg.empty();
+                stats.promoted += !temp && !interval.reg.empty();
+            }
+            for (const auto &variable : layout.variables)
+            {
+                if (!promoteVariables && !onStack.count(variable.value))
+                    inMemory.push_back(variable);
+            }
+            stats.variables += layout.variables.size();
+            layout.assign(inMemory);
+            for (const auto &slot : layout.offsets)
+                homes[slot.first] = "DWORD PTR [ebp" + to_string(slot.second) + "]";
+            stats.frameSlots += layout.slots;
+            stats.frameValues += layout.values;
+        }
+        stats.regions++;
+        stats.intervals += allocator->intervals.size();
+        stats.scratchReserved += !allocator->scratch.empty();
+
+        if (!isFunction && layout.size() > 0)
+            generateFrame(out);
+        if (!isFunction)
+            clearUninitialized(out);
+        for (int i = 0; i < (int)code.size(); i++)
+        {
+            const TAC &tac = code[i];
+            if (selector.foldedInto[i] >= 0)
+            {
+                continue; // emitted as part of its root
+            }
+            else if (selector.rule[i] == "rmw")
+            {
+                generateReadModifyWrite(tac, code[selector.child[i]], i, out);
+            }
+            else if (selector.rule[i] == "lea-scaled")
+            {
+                generateScaledAdd(tac, code[selector.child[i]], i, out);
+            }
+            else if (tac.result == "if")
+            {
+                generateBranch(tac, i, out);
+            }
+            else if (tac.result == "goto")
+            {
+                out.emplace_back(insMap.at("goto"), tac.arg1); // arg1 is label
+            }
+            else if (tac.result == "label")
+            {
+                out.emplace_back(tac.arg1); // arg1 is label
+            }
+            else if (tac.result == "print")
+            {
+                out.emplace_back("push", "eax");
+                out.emplace_back("Mov", "EAX", operand(tac.op));
+                out.emplace_back("Call", "writeDec");
+                out.emplace_back("call", "CRLF");
+                out.emplace_back("pop", "eax");
+            }
+            else if (tac.result == "input")
+            {
+                string dst = operand(tac.op, true);
+                if (dst == "eax")
+                {
+                    out.emplace_back("Call", "ReadInt");
+                    continue;
+                }
+                out.emplace_back("push", "eax");
+                out.emplace_back("Call", "ReadInt");
+                out.emplace_back("Mov", dst, "EAX");
+                out.emplace_back("pop", "eax");
+            }
+            else if (tac.result == "function")
+            {
+                out.emplace_back(tac.arg1 + " PROC");
+                generateEntry(tac, out);
+            }
+            else if (tac.result == "call")
+            {
+                generateCall(tac, i, out);
+            }
+            else if (tac.result == "ret")
+            {
+                string value = operand(tac.arg1);
+                if (returnsValue && value != "eax")
+                    out.emplace_back("Mov", "eax", value);
+                out.emplace_back("ret");
+            }
+            else if (VectorAsm::handles(tac.op))
+            {
+                generateVector(tac, i, out);
+            }
+            else if (tac.op == "array")
+            {
+                generateClear(tac, i, out);
+            }
+            else if (tac.op == "[]")
+            {
+                generateLoad(tac, i, out);
+            }
+            else if (tac.op == "[]=")
+            {
+                generateStore(tac, i, out);
+            }
+            else if (tac.result == "return")
+            {
+                if (i == 0 || code[i - 1].result != "ret")
+                {
+                    if (returnsValue)
+                        out.emplace_back("Xor", "eax", "eax"); // falling off the end returns 0
+                    out.emplace_back("ret");
+                }
+                saveCalleeRegisters(out);
+                out.emplace_back(tac.arg1 + " endp");
+            }
+            else if (tac.arg2.empty())
+            {
+                string dst = operand(tac.result, true);
+                string src = operand(tac.arg1);
+                if (dst == src)
+                    continue;
+                if (isMemory(dst) && isMemory(src))
+                {
+                    // memory to memory needs a register in between
+                    string reg = allocator->freeRegisterAt(i);
+                    out.emplace_back("Mov", reg, src);
+                    src = reg;
+                }
+                out.emplace_back("Mov", dst, src);
+            }
+            else if (tac.op == "/")
+            {
+                generateDivision(tac, i, out);
+            }
+            else
+            {
+                generateArithmetic(tac, i, out);
+            }
+        }
+        allocator.reset();
+        homes.clear();
+    }
+
+    // A leaf def with at most two parameters keeps its variables in registers:
+    // the parameters stay where the caller put them and the others take the
+    // remaining non-EAX registers. EDX is left out when the def divides. The
+    // temps get what is left, which always includes EAX.
+    bool assignRegisterHomes(const vector<TAC> &code, vector<string> &remaining)
+    {
+        const vector<string> &params = code.front().extras;
+        if (params.size() > 2)
+            return false;
+        vector<string> variables(params.begin(), params.end());
+        unordered_set<string> seen(params.begin(), params.end());
+        auto note = [&](const string &value)
+        {
+            if (InstructionSelector::isVariable(value) && seen.insert(value).second)
+                variables.push_back(value);
+        };
+        bool divides = false;
+        for (const auto &tac : code)
+        {
+            if (tac.result == "call" || tac.op == "array")
+                return false;
+            divides = divides || tac.op == "/";
+            if (tac.result == "if")
+            {
+                note(tac.arg1);
+                note(tac.arg2);
+            }
+            else if (tac.result == "print" || tac.result == "input")
+                note(tac.op);
+            else if (tac.result == "ret")
+                note(tac.arg1);
+            else if (tac.result != "label" && tac.result != "goto" && tac.result != "function" && tac.result != "return")
+            {
+                note(tac.result);
+                note(tac.arg1);
+                note(tac.arg2);
+            }
+        }
+
+        vector<string> pool = {"ecx", "edx", "ebx", "esi", "edi"};
+        if (divides)
+            pool.erase(pool.begin() + 1);
+        if (variables.size() > pool.size())
+            return false;
+        if (!params.empty())
+            homes[params[0]] = "ecx";
+        if (params.size() > 1 && !divides)
+            homes[params[1]] = "edx";
+        remaining = {"eax"};
+        for (const auto &reg : pool)
+        {
+            bool taken = false;
+            for (const auto &home : homes)
+                taken = taken || home.second == reg;
+            if (taken)
+                continue;
+            auto next = find_if(variables.begin(), variables.end(), [&](const string &v)
+                                { return !homes.count(v); });
+            if (next != variables.end())
+                homes[*next] = reg;
+            else
+                remaining.push_back(reg);
+        }
+        return true;
+    }
+
+    // frameless defs only move the second argument when EDX is not its home;
+    // the others set up the EBP frame and store the register arguments
+    void generateEntry(const TAC &function, vector<AsmInstruction> &out)
+    {
+        const vector<string> &params = function.extras;
+        if (frameless)
+        {
+            savesAt = out.size();
+            if (params.size() > 1 && homes[params[1]] != "edx")
+                out.emplace_back("Mov", homes[params[1]], "edx");
+            clearUninitialized(out);
+            return;
+        }
+        generateFrame(out);
+        // the register arguments move to their homes in parallel
+        string first = params.size() > 0 ? operand(params[0], true) : "ecx";
+        string second = params.size() > 1 ? operand(params[1], true) : "edx";
+        if (first == "edx" && second == "ecx")
+            out.emplace_back("Xchg", "ecx", "edx");
+        else if (first == "edx")
+        {
+            if (second != "edx")
+                out.emplace_back("Mov", second, "edx");
+            out.emplace_back("Mov", "edx", "ecx");
+        }
+        else
+        {
+            if (first != "ecx")
+                out.emplace_back("Mov", first, "ecx");
+            if (second != "edx")
+                out.emplace_back("Mov", second, "edx");
+        }
+        // promoted stack arguments are loaded once
+        for (int p = 2; p < (int)params.size(); p++)
+        {
+            string reg = allocator->location(params[p]);
+            if (!reg.empty())
+                out.emplace_back("Mov", reg, homes[params[p]]);
+        }
+        clearUninitialized(out);
+    }
+
+    void clearUninitialized(vector<AsmInstruction> &out)
+    {
+        for (const auto &variable : layout.zeroed)
+            out.emplace_back("Mov", operand(variable, true), "0");
+    }
+
+    // EBP frame below the return address; callee-saved pushes go after it
+    void generateFrame(vector<AsmInstruction> &out)
+    {
+        out.emplace_back("push", "ebp");
+        out.emplace_back("Mov", "ebp", "esp");
+        int size = layout.size();
+        if (size >= 4096)
+        {
+            // Windows commits the stack one guard page at a time, so a large frame touches each page in order
+            string probe = loopLabel("probe");
+            out.emplace_back("Mov", "eax", to_string(size / 4096));
+            out.emplace_back(probe + ":");
+            out.emplace_back("Sub", "esp", "4096");
+            out.emplace_back("Test", "DWORD PTR [esp]", "esp");
+            out.emplace_back("Sub", "eax", "1");
+            out.emplace_back("Jnz", probe);
+            size %= 4096;
+        }
+        if (size > 0)
+            out.emplace_back("Sub", "esp", to_string(size));
+        savesAt = out.size();
+    }
+
+    string loopLabel(const string &kind)
+    {
+        return "L" + kind + "_" + scope + "_" + to_string(loops++);
+    }
+
+    // element of an array: a literal index folds into the displacement
+    string element(const string &array, const string &index)
+    {
+        return "DWORD PTR " + address(array, index);
+    }
+    string address(const string &array, const string &index)
+    {
+        int offset = layout.elements.at(array);
+        if (isLiteral(index))
+            return "[ebp" + to_string(offset + 4 * stoi(index)) + "]";
+        return "[ebp+" + index + "*4" + to_string(offset) + "]";
+    }
+
+    // the vectorizer's loops; the index of vload and vstore is the loop variable
+    void generateVector(const TAC &tac, int i, vector<AsmInstruction> &out)
+    {
+        VectorAsm vec([&out](const string &op, const string &dst, const string &src)
+                      { out.emplace_back(op, dst, src); },
+                      avx2);
+        if (tac.op == "vsplat")
+        {
+            string value = tac.arg1 == "0" ? "" : operand(tac.arg1);
+            if (isLiteral(value))
+            {
+                string reg = allocator->freeRegisterAt(i);
+                out.emplace_back("Mov", reg, value);
+                value = reg;
+            }
+            vec.splat(tac.result, value);
+        }
+        else if (tac.op == "vload" || tac.op == "vstore")
+        {
+            bool load = tac.op == "vload";
+            string index = operand(load ? tac.arg2 : tac.arg1);
+            if (isMemory(index))
+            {
+                string reg = allocator->freeRegisterAt(i);
+                out.emplace_back("Mov", reg, index);
+                index = reg;
+            }
+            if (load)
+                vec.load(tac.result, address(tac.arg1, index));
+            else
+                vec.store(address(tac.result, index), tac.arg2);
+        }
+        else if (tac.op == "vsum")
+            vec.sum(operand(tac.result, true), tac.arg1);
+        else if (tac.op == "vend")
+            vec.end();
+        else
+            vec.arithmetic(tac.op, tac.result, tac.arg1, tac.arg2);
+    }
+
+    // an array declaration clears it every time it runs, like the other targets
+    void generateClear(const TAC &tac, int i, vector<AsmInstruction> &out)
+    {
+        int size = stoi(tac.arg1);
+        if (size <= 4)
+        {
+            for (int k = 0; k < size; k++)
+                out.emplace_back("Mov", element(tac.result, to_string(k)), "0");
+            return;
+        }
+        // count down from the last element with a register nothing holds here
+        string counter = allocator->freeRegisterAt(i);
+        string loop = loopLabel("clear");
+        out.emplace_back("Mov", counter, tac.arg1);
+        out.emplace_back(loop + ":");
+        out.emplace_back("Mov", "DWORD PTR [ebp+" + counter + "*4" + to_string(layout.elements.at(tac.result) - 4) + "]", "0");
+        out.emplace_back("Sub", counter, "1");
+        out.emplace_back("Jnz", loop);
+    }
+
+    // an index in a register is compared with the size like the VM does; outOfBounds
+    // takes the index and the size on the stack, prints the message and exits
+    void checkIndex(const string &array, const string &index, vector<AsmInstruction> &out)
+    {
+        if (isLiteral(index))
+            return;
+        string size = to_string(layout.lengths.at(array));
+        string inBounds = loopLabel("bounds");
+        out.emplace_back("Cmp", index, size);
+        out.emplace_back("Jb", inBounds); // unsigned, so negative indices fail too
+        out.emplace_back("push", size);
+        out.emplace_back("push", index);
+        out.emplace_back("Call", "outOfBounds");
+        out.emplace_back(inBounds + ":");
+        checksBounds = true;
+    }
+
+    // t = a[i]; an index in memory is loaded into the register that receives the element
+    void generateLoad(const TAC &tac, int i, vector<AsmInstruction> &out)
+    {
+        string dst = operand(tac.result, true);
+        string index = operand(tac.arg2);
+        string work = isRegister(dst) ? dst : allocator->freeRegisterAt(i);
+        if (isMemory(index))
+        {
+            out.emplace_back("Mov", work, index);
+            index = work;
+        }
+        checkIndex(tac.arg1, index, out);
+        out.emplace_back("Mov", work, element(tac.arg1, index));
+        if (work != dst)
+            out.emplace_back("Mov", dst, work);
+    }
+
+    // a[i] = v; with both in memory the value moves through the stack
+    void generateStore(const TAC &tac, int i, vector<AsmInstruction> &out)
+    {
+        string index = operand(tac.arg1);
+        string value = operand(tac.arg2);
+        string reg = allocator->freeRegisterAt(i);
+        if (isMemory(index))
+        {
+            out.emplace_back("Mov", reg, index);
+            index = reg;
+            reg = allocator->freeRegisterAt(i, reg);
+        }
+        checkIndex(tac.result, index, out);
+        string address = element(tac.result, index);
+        if (isMemory(value) && reg.empty())
+        {
+            out.emplace_back("push", value);
+            out.emplace_back("pop", address);
+            return;
+        }
+        if (isMemory(value))
+        {
+            out.emplace_back("Mov", reg, value);
+            value = reg;
+        }
+        out.emplace_back("Mov", address, value);
+    }
+
+    void generateCall(const TAC &call, int i, vector<AsmInstruction> &out)
+    {
+        // a variable taking the result is overwritten, not restored
+        string result = call.op.empty() ? "" : allocator->location(call.op);
+        vector<string> saved;
+        for (const string reg : {"eax", "ecx", "edx"})
+        {
+            if (reg != result && allocator->holdsAcross(reg, i))
+                saved.push_back(reg);
+        }
+        for (const auto &reg : saved)
+            out.emplace_back("push", reg);
+
+        const vector<string> &args = call.extras;
+        for (size_t a = 2; a < args.size(); a++)
+            out.emplace_back("push", operand(args[a]));
+        string first = args.size() > 0 ? operand(args[0]) : "ecx";
+        string second = args.size() > 1 ? operand(args[1]) : "edx";
+        if (first == "edx" && second == "ecx")
+            out.emplace_back("Xchg", "ecx", "edx");
+        else if (second == "ecx")
+        {
+            // ECX still holds the second argument, so EDX is loaded first
+            out.emplace_back("Mov", "edx", "ecx");
+            if (first != "ecx")
+                out.emplace_back("Mov", "ecx", first);
+        }
+        else
+        {
+            if (first != "ecx")
+                out.emplace_back("Mov", "ecx", first);
+            if (second != "edx")
+                out.emplace_back("Mov", "edx", second);
+        }
+        out.emplace_back("Call", call.arg1);
+        if (args.size() > 2)
+            out.emplace_back("ADD", "ESP", to_string(4 * (args.size() - 2)));
+
+        if (!call.op.empty())
+        {
+            string dst = operand(call.op, true);
+            if (dst != "eax")
+                out.emplace_back("Mov", dst, "eax");
+        }
+        for (auto it = saved.rbegin(); it != saved.rend(); ++it)
+            out.emplace_back("pop", *it);
+    }
+
+    // EBX, ESI and EDI belong to the caller, so a def pushes the ones it
+    // writes once its frame is set up; every ret pops them and the frame
+    void saveCalleeRegisters(vector<AsmInstruction> &out)
+    {
+        vector<string> saves;
+        for (const string reg : {"ebx", "esi", "edi"})
+        {
+            bool used = false;
+            for (size_t k = savesAt; k < out.size() && !used; k++)
+                used = out[k].dst.find(reg) != string::npos || out[k].src.find(reg) != string::npos;
+            if (used)
+                saves.push_back(reg);
+        }
+        if (saves.empty() && frameless)
+            return;
+        vector<AsmInstruction> body(out.begin() + savesAt, out.end());
+        out.erase(out.begin() + savesAt, out.end());
+        for (const auto &reg : saves)
+            out.emplace_back("push", reg);
+        for (auto &ins : body)
+        {
+            if (ins.op == "ret")
+            {
+                for (auto it = saves.rbegin(); it != saves.rend(); ++it)
+                    out.emplace_back("pop", *it);
+                if (!frameless)
+                    out.emplace_back("Leave");
+            }
+            out.push_back(move(ins));
+        }
+    }
+
+    // x = x op y as one instruction on x's home, chosen by the "rmw" tree rule
+    void generateReadModifyWrite(const TAC &copy, const TAC &child, int i, vector<AsmInstruction> &out)
+    {
+        string var = operand(copy.result, true);
+        string other = child.arg1 == copy.result ? child.arg2 : child.arg1;
+        if (child.op == "*" && InstructionSelector::powerOfTwo(other) > 0)
+        {
+            out.emplace_back("Shl", var, to_string(InstructionSelector::powerOfTwo(other)));
+            return;
+        }
+        other = operand(other);
+        if (child.op == "*" && isMemory(var))
+        {
+            // Imul only writes a register
+            string reg = allocator->freeRegisterAt(i);
+            out.emplace_back("Mov", reg, var);
+            out.emplace_back("Imul", reg, other);
+            out.emplace_back("Mov", var, reg);
+            return;
+        }
+        if (isMemory(other) && isMemory(var))
+        {
+            // a spilled value is reloaded; memory to memory is not encodable
+            string reg = allocator->freeRegisterAt(i);
+            out.emplace_back("Mov", reg, other);
+            other = reg;
+        }
+        out.emplace_back(insMap.at(child.op), var, other);
+    }
+
+    // t = x + y*k as one Lea, chosen by the "lea-scaled" tree rule
+    void generateScaledAdd(const TAC &root, const TAC &child, int i, vector<AsmInstruction> &out)
+    {
+        bool literalFirst = isLiteral(child.arg1);
+        int k = stoi(literalFirst ? child.arg1 : child.arg2);
+        string y = operand(literalFirst ? child.arg2 : child.arg1);
+        string x = operand(root.arg1 == child.result ? root.arg2 : root.arg1);
+        string dst = operand(root.result, true);
+        string work = isRegister(dst) ? dst : allocator->freeRegisterAt(i);
+        string scaled = k == 1 ? "" : "*" + to_string(k);
+        if (!isRegister(y))
+        {
+            // the index must be a register; keep x intact if the result took its register
+            string reg = x == work ? allocator->freeRegisterAt(i) : work;
+            out.emplace_back("Mov", reg, y);
+            y = reg;
+        }
+        if (isRegister(x))
+            out.emplace_back("Lea", work, "[" + x + " + " + y + scaled + "]");
+        else if (isLiteral(x))
+            out.emplace_back("Lea", work, "[" + y + scaled + " + " + x + "]");
+        else if (y != work)
+        {
+            out.emplace_back("Mov", work, x);
+            out.emplace_back("Lea", work, "[" + work + " + " + y + scaled + "]");
+        }
+        else
+        {
+            if (k > 1)
+                out.emplace_back("Shl", work, to_string(InstructionSelector::powerOfTwo(to_string(k))));
+            out.emplace_back("Add", work, x);
+        }
+        if (work != dst)
+            out.emplace_back("Mov", dst, work);
+    }
+
+    // single-node rules for + - *, cheapest first
+    void generateArithmetic(const TAC &tac, int i, vector<AsmInstruction> &out)
+    {
+        string a = operand(tac.arg1);
+        string b = operand(tac.arg2);
+        string dst = operand(tac.result, true);
+        if (isLiteral(a) && isLiteral(b))
+        {
+            out.emplace_back("Mov", dst, to_string(fold(tac.op, stoll(a), stoll(b))));
+            return;
+        }
+        string work = isRegister(dst) ? dst : allocator->freeRegisterAt(i);
+        if ((tac.op == "+" || tac.op == "*") && isLiteral(a))
+            swap(a, b); // constants go second
+        if (tac.op == "*" && isLiteral(b))
+        {
+            generateMultiplyByConstant(work, a, stoi(b), out);
+        }
+        else if (tac.op != "*" && isRegister(a) && a != work && (isLiteral(b) || (tac.op == "+" && isRegister(b) && b != work)))
+        {
+            // three-address add without disturbing the operands
+            out.emplace_back("Lea", work, "[" + a + (tac.op == "+" ? " + " : " - ") + b + "]");
+        }
+        else if (work == b && work != a)
+        {
+            // the result took over b's register
+            out.emplace_back(insMap.at(tac.op), work, a);
+            if (tac.op == "-")
+                out.emplace_back("Neg", work); // b - a = -(a - b)
+        }
+        else
+        {
+            if (work != a)
+                out.emplace_back("Mov", work, a);
+            out.emplace_back(insMap.at(tac.op), work, b);
+        }
+        if (work != dst)
+            out.emplace_back("Mov", dst, work);
+    }
+
+    void generateMultiplyByConstant(const string &work, const string &a, int c, vector<AsmInstruction> &out)
+    {
+        auto load = [&]()
+        {
+            if (work != a)
+                out.emplace_back("Mov", work, a);
+        };
+        int shift = InstructionSelector::powerOfTwo(to_string(c));
+        if (c == 0)
+        {
+            out.emplace_back("Mov", work, "0");
+            return;
+        }
+        if (c == 1 || c == -1 || shift)
+        {
+            load();
+            if (c == -1)
+                out.emplace_back("Neg", work);
+            if (shift)
+                out.emplace_back("Shl", work, to_string(shift));
+            return;
+        }
+        // c = m * 2^k with m in {3, 5, 9}: x + x*(m-1) is one Lea
+        for (int m : {3, 5, 9})
+        {
+            int k = c > 0 && c % m == 0 ? (c / m == 1 ? 0 : InstructionSelector::powerOfTwo(to_string(c / m))) : -1;
+            if (k < 0 || (k == 0 && c != m))
+                continue;
+            string base = isRegister(a) ? a : work;
+            if (!isRegister(a))
+                load();
+            out.emplace_back("Lea", work, "[" + base + " + " + base + "*" + to_string(m - 1) + "]");
+            if (k)
+                out.emplace_back("Shl", work, to_string(k));
+            return;
+        }
+        // three-operand Imul reads a register or memory directly
+        out.emplace_back("Imul", work, a + ", " + to_string(c));
+    }
+
+    // IDiv divides EDX:EAX, so values living in EAX or EDX across it are saved.
+    // Constant divisors use a bias and Sar for powers of two and a
+    // multiply-high by a magic number otherwise (Hacker's Delight 10-1).
+    void generateDivision(const TAC &tac, int i, vector<AsmInstruction> &out)
+    {
+        string a = operand(tac.arg1);
+        string b = operand(tac.arg2);
+        string dst = operand(tac.result, true);
+        int c = isLiteral(b) ? stoi(b) : 0;
+        if (isLiteral(a) && c != 0)
+        {
+            out.emplace_back("Mov", dst, to_string(fold("/", stoll(a), c)));
+            return;
+        }
+        if (c == 1 || c == -1)
+        {
+            string work = isRegister(dst) ? dst : allocator->freeRegisterAt(i);
+            if (work != a)
+                out.emplace_back("Mov", work, a);
+            if (c == -1)
+                out.emplace_back("Neg", work);
+            if (work != dst)
+                out.emplace_back("Mov", dst, work);
+            return;
+        }
+
+        vector<string> saved;
+        for (const string reg : {"eax", "edx"})
+        {
+            if (reg != dst && allocator->holdsAcross(reg, i))
+                saved.push_back(reg);
+        }
+        for (const auto &reg : saved)
+            out.emplace_back("push", reg);
+
+        string result = "eax";
+        int magnitude = c < 0 ? -c : c;
+        int shift = InstructionSelector::powerOfTwo(to_string(magnitude));
+        if (c != 0 && c != INT32_MIN && shift)
+        {
+            // round toward zero: add 2^k - 1 to negative dividends before shifting
+            if (a != "eax")
+                out.emplace_back("Mov", "eax", a);
+            out.emplace_back("Cdq");
+            out.emplace_back("And", "edx", to_string(magnitude - 1));
+            out.emplace_back("Add", "eax", "edx");
+            out.emplace_back("Sar", "eax", to_string(shift));
+            if (c < 0)
+                out.emplace_back("Neg", "eax");
+        }
+        else if (c != 0 && c != INT32_MIN)
+        {
+            int32_t magic;
+            int magicShift;
+            magicNumber(magnitude, magic, magicShift);
+            string x = a;
+            bool onStack = a == "eax" || a == "edx" || isLiteral(a);
+            if (onStack)
+            {
+                out.emplace_back("push", a);
+                x = "DWORD PTR [esp]";
+            }
+            out.emplace_back("Mov", "eax", to_string(magic));
+            out.emplace_back("Imul", x); // EDX = high half of magic * x
+            if (magic < 0)
+                out.emplace_back("Add", "edx", x);
+            if (magicShift)
+                out.emplace_back("Sar", "edx", to_string(magicShift));
+            out.emplace_back("Mov", "eax", "edx");
+            out.emplace_back("Shr", "eax", "31");
+            out.emplace_back("Add", "edx", "eax"); // +1 for negative quotients
+            if (c < 0)
+                out.emplace_back("Neg", "edx");
+            if (onStack)
+                out.emplace_back("ADD", "ESP", "4");
+            result = "edx";
+        }
+        else
+        {
+            out.emplace_back("push", b); // the divisor is read from the stack
+            if (a != "eax")
+                out.emplace_back("Mov", "eax", a);
+            // INT_MIN / -1 traps in IDiv: negate both so it divides by 1 and wraps
+            string divide = loopLabel("div");
+            out.emplace_back("Cmp", "DWORD PTR [esp]", "-1");
+            out.emplace_back("Jne", divide);
+            out.emplace_back("Neg", "eax");
+            out.emplace_back("Neg", "DWORD PTR [esp]");
+            out.emplace_back(divide + ":");
+            out.emplace_back("Cdq");
+            out.emplace_back(insMap.at("/"), "DWORD PTR [esp]");
+            out.emplace_back("ADD", "ESP", "4");
+        }
+        if (dst != result)
+            out.emplace_back("Mov", dst, result);
+        for (auto it = saved.rbegin(); it != saved.rend(); ++it)
+            out.emplace_back("pop", *it);
+    }
+
+    // magic multiplier and shift for signed division by d >= 2
+    static void magicNumber(int32_t d, int32_t &magic, int &shift)
+    {
+        const uint32_t two31 = 0x80000000u;
+        uint32_t ad = d;
+        uint32_t t = two31;
+        uint32_t anc = t - 1 - t % ad;
+        int p = 31;
+        uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+        uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+        uint32_t delta;
+        do
+        {
+            p++;
+            q1 *= 2, r1 *= 2;
+            if (r1 >= anc)
+                q1++, r1 -= anc;
+            q2 *= 2, r2 *= 2;
+            if (r2 >= ad)
+                q2++, r2 -= ad;
+            delta = ad - r2;
+        } while (q1 < delta || (q1 == delta && r1 == 0));
+        magic = (int32_t)(q2 + 1);
+        shift = p - 32;
+    }
+
+    // 32-bit wrapping arithmetic for constant operands, like the VM
+    static int32_t fold(const string &op, long long a, long long b)
+    {
+        uint32_t x = (uint32_t)a, y = (uint32_t)b;
+        if (op == "+")
+            return (int32_t)(x + y);
+        if (op == "-")
+            return (int32_t)(x - y);
+        if (op == "*")
+            return (int32_t)(x * y);
+        if ((int32_t)y == -1)
+            return (int32_t)(0u - x);
+        return (int32_t)x / (int32_t)y;
+    }
+
+    static bool isMemory(const string &operand) { return operand.find('[') != string::npos; }
+    static bool isRegister(const string &operand)
+    {
+        return !operand.empty() && !isMemory(operand) && !isdigit(operand[0]) && operand[0] != '-';
+    }
+
+    // if lhs op rhs goto label: one Cmp and a signed conditional jump
+    void generateBranch(const TAC &tac, int i, vector<AsmInstruction> &out)
+    {
+        string lhs = tac.arg1;
+        string rhs = tac.arg2;
+        string op = tac.op;
+        string label = tac.extras[0];
+        if (isLiteral(lhs) && isLiteral(rhs))
+        {
+            int a = stoi(lhs), b = stoi(rhs);
+            bool taken = op == ">" ? a > b : op == "<" ? a < b : op == ">=" ? a >= b : op == "<=" ? a <= b : op == "==" ? a == b : a != b;
+            if (taken)
+                out.emplace_back(insMap.at("goto"), label);
+            return;
+        }
+        if (isLiteral(lhs))
+        {
+            // Cmp needs a register or memory on the left, so mirror the comparison
+            swap(lhs, rhs);
+            op = op == ">" ? "<" : op == "<" ? ">" : op == ">=" ? "<=" : op == "<=" ? ">=" : op;
+        }
+
+        string left = operand(lhs);
+        string right = operand(rhs);
+        if (isMemory(left) && isMemory(right))
+        {
+            // memory to memory compare needs a register in between
+            string reg = allocator->freeRegisterAt(i);
+            out.emplace_back("Mov", reg, left);
+            left = reg;
+        }
+        out.emplace_back("Cmp", left, right);
+        out.emplace_back(insMap.at(op + "i"), label);
+    }
+
+    // register, [ebp-N] slot, argument or literal for a TAC value
+    string operand(const string &value, bool isWrite = false)
+    {
+        if (isLiteral(value))
+            return value;
+        string reg = allocator->location(value);
+        if (!reg.empty())
+            return reg;
+        if (LinearScanAllocator::isTemp(value))
+            (isWrite ? stats.spillStores : stats.spillLoads)++;
+        auto home = homes.find(value);
+        if (home != homes.end())
+            return home->second;
+        return "[" + value + "]";
+    }
+    static bool isLiteral(const std::string &value)
+    {
+        // Check for integer literal
+        if (!value.empty() && std::isdigit(value[0]))
+        {
+            for (char c : value)
+            {
+                if (!std::isdigit(c))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Check for string literal (enclosed in quotes)
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        {
+            return true;
+        }
+
+        return false;
+    }
+private:
+    const unordered_map<string, string> &insMap;
+    unique_ptr<LinearScanAllocator> allocator; // the current region's allocation
+    FrameLayout layout;                        // the current region's stack slots
+    unordered_map<string, string> homes;       // register, argument or frame slot of each value
+    bool frameless = false;
+    size_t savesAt = 0; // where the callee-saved pushes go
+    string scope;       // region name, for labels the codegen makes up
+    int loops = 0;
+};
+
+// Runs independent jobs on a fixed number of threads. Each worker gets a
+// round-robin share of the jobs in its own deque and takes from the back;
+// once that is empty it steals from the front of the others, so a few large
+// defs do not leave the remaining threads idle. The calling thread works too.
+class WorkStealingPool
+{
+public:
+    // threads <= 0 uses one per core
+    WorkStealingPool(int threads) : threads(threads > 0 ? threads : max(1u, thread::hardware_concurrency())) {}
+
+    void run(const vector<function<void()>> &jobs)
+    {
+        int workers = min<int>(threads, jobs.size());
+        if (workers <= 1)
+        {
+            for (const auto &job : jobs)
+                job();
+            return;
+        }
+        vector<deque<int>> queues(workers);
+        vector<mutex> locks(workers);
+        for (int j = 0; j < (int)jobs.size(); j++)
+            queues[j % workers].push_back(j);
+
+        auto work = [&](int self)
+        {
+            while (true)
+            {
+                int job = -1;
+                for (int k = 0; job < 0 && k < workers; k++)
+                {
+                    int victim = (self + k) % workers;
+                    lock_guard<mutex> lock(locks[victim]);
+                    if (queues[victim].empty())
+                        continue;
+                    if (k == 0)
+                    {
+                        job = queues[victim].back();
+                        queues[victim].pop_back();
+                    }
+                    else
+                    {
+                        job = queues[victim].front();
+                        queues[victim].pop_front();
+                    }
+                }
+                if (job < 0)
+                    return; // jobs are never added once started, so every queue is drained
+                jobs[job]();
+            }
+        };
+        vector<thread> pool;
+        for (int w = 1; w < workers; w++)
+            pool.emplace_back(work, w);
+        work(0);
+        for (auto &t : pool)
+            t.join();
+    }
+
+private:
+    int threads;
+};
+
+class Assembly
+{
+public:
+    int threads = 1; // codegen jobs run on this many threads, 0 for one per core
+    bool promoteVariables = true;
+    bool avx2 = false;
+
+    // streams the program to out instruction by instruction
+    void write(FdWriter &out)
+    {
+        out.write("Include Irvine32.inc\n");
+        if (usesVectors)
+            out.write(".686p\n.xmm\n");
+        out.write(".stack 4086\n.data\n");
+        if (checksBounds)
+            out.write("boundsIndex BYTE \"Error: index \",0\nboundsSize BYTE \" is out of bounds for an array of \",0\n");
+        out.write(".code\nmain proc\n");
+        // generate main assembly
+        for (const auto &ins : mainAssembly)
+        {
+            ins.writeTo(out);
+        }
+        out.write("invoke ExitProcess,0\nmain endp\n");
+        // generate functions
+        for (const auto &function : functions)
+        {
+            for (const auto &ins : function)
+            {
+                ins.writeTo(out);
+            }
+        }
+        if (checksBounds)
+        {
+            // [esp+4] is the index and [esp+8] the size; it never returns
+            out.write("outOfBounds PROC\nMov edx, OFFSET boundsIndex\nCall WriteString\nMov eax, DWORD PTR [esp+4]\nCall writeDec\n");
+            out.write("Mov edx, OFFSET boundsSize\nCall WriteString\nMov eax, DWORD PTR [esp+8]\nCall writeDec\ncall CRLF\n");
+            out.write("invoke ExitProcess,1\noutOfBounds endp\n");
+        }
+        out.write("end main\n");
+    }
+
+    Assembly(SymbolTable &symbolTable) : symbolTable(symbolTable)
+    {
+        insMap["+"] = "Add";
+        insMap["-"] = "Sub";
+        insMap["*"] = "Imul";
+        insMap["/"] = "IDiv";
+        insMap[">i"] = "JG";
+        insMap["<i"] = "JL";
+        insMap["<=i"] = "JLE";
+        insMap[">=i"] = "JGE";
+        insMap["==i"] = "JE";
+        insMap["!=i"] = "JNE";
+        insMap["goto"] = "JMP";
+    }
+
+    // Lowers every region as its own job on `threads` threads: each def goes
+    // to `functions` in source order, everything else to main. The output is
+    // the same as a serial run whatever order the jobs finish in.
+    void generate(const vector<TAC> &tacList)
+    {
+        PhaseTimer timer("codegen");
+        vector<vector<TAC>> regions;
+        vector<string> scopes;
+        vector<TAC> mainCode;
+        bool isFunction = false;
+        for (const auto &tac : tacList)
+        {
+            if (tac.result == "function")
+            {
+                isFunction = true;
+                regions.emplace_back();
+                scopes.push_back(tac.arg1);
+            }
+            (isFunction ? regions.back() : mainCode).push_back(tac);
+            if (tac.result == "return")
+                isFunction = false;
+        }
+        regions.push_back(mainCode);
+        scopes.push_back("main");
+
+        unordered_set<string> valueUsed;
+        for (const auto &tac : tacList)
+        {
+            if (tac.result == "call" && !tac.op.empty())
+                valueUsed.insert(tac.arg1);
+            usesVectors = usesVectors || tac.op == "vend";
+        }
+        vector<RegionCodegen> codegens;
+        codegens.reserve(regions.size());
+        vector<function<void()>> jobs;
+        for (int r = 0; r < (int)regions.size(); r++)
+        {
+            codegens.emplace_back(insMap);
+            codegens.back().returnsValue = valueUsed.count(scopes[r]) > 0;
+            codegens.back().promoteVariables = promoteVariables;
+            codegens.back().avx2 = avx2;
+            jobs.push_back([&, r]()
+                           {
+                               PhaseTimer timer("function codegen", scopes[r]);
+                               codegens[r].run(regions[r]); });
+        }
+        WorkStealingPool(threads).run(jobs);
+
+        for (auto &codegen : codegens)
+        {
+            stats.add(codegen.stats);
+            checksBounds = checksBounds || codegen.checksBounds;
+        }
+        mainAssembly = move(codegens.back().output);
+        codegens.pop_back();
+        for (auto &codegen : codegens)
+            functions.push_back(move(codegen.output));
+    }
+
+    void printRegisterStats(ostream &out) const
+    {
+        out << "regalloc: " << stats.intervals << " intervals in " << stats.regions << " regions, "
+            << stats.spilled << " spilled\n";
+        out << "  spill loads: " << stats.spillLoads << ", spill stores: " << stats.spillStores << "\n";
+        out << "  regions with a reserved scratch register: " << stats.scratchReserved << "\n";
+        out << "  frameless leaf defs: " << stats.frameless << "\n";
+        out << "  promoted variables: " << stats.promoted << " of " << stats.variables << "\n";
+        out << "  frame slots: " << stats.frameSlots << " for " << stats.frameValues << " variables and spilled temps\n";
+    }
+    bool startsWithTAndNumber(const std::string &str)
+    {
+        // Check if the string is long enough and follows the required format
+        return str.length() >= 2 && str[0] == 't' && std::isdigit(str[1]);
+    }
+    bool isAlphanumeric(const std::string &str)
+    {
+        if (startsWithTAndNumber(str))
+            return false;
+        return all_of(str.begin(), str.end(), ::isalnum);
+    }
+    // regions are optimized in parallel, each by its own copy of the rules
+    void runPeephole(PeepholeOptimizer &peephole)
+    {
+        vector<vector<AsmInstruction> *> regions = {&mainAssembly};
+        for (auto &function : functions)
+            regions.push_back(&function);
+        vector<PeepholeOptimizer> optimizers(regions.size(), peephole.fork());
+        vector<function<void()>> jobs;
+        for (int r = 0; r < (int)regions.size(); r++)
+        {
+            jobs.push_back([&, r]()
+                           { optimizers[r].run(*regions[r]); });
+        }
+        WorkStealingPool(threads).run(jobs);
+        for (const auto &optimizer : optimizers)
+            peephole.merge(optimizer);
+    }
+    string sliceString(const std::string &source, const std::string &lengthReference)
+    {
+        // Calculate how many characters to remove
+        size_t lengthToRemove = lengthReference.length();
+
+        // Ensure we do not remove more characters than the source has
+        if (lengthToRemove >= source.length())
+        {
+            return ""; // Return an empty string if we remove everything or more
+        }
+
+        // Return the sliced string
+        return source.substr(0, source.length() - lengthToRemove);
+    }
+
+private:
+    RegisterStats stats;
+    bool usesVectors = false;
+    bool checksBounds = false;
+    unordered_map<string, string> insMap;
+    SymbolTable &symbolTable;
+    vector<vector<AsmInstruction>> functions; // one per def, in source order
+    vector<AsmInstruction> mainAssembly;
+};
+
+struct ASTNode
+{
+    string value;
+    vector<std::shared_ptr<ASTNode>> children;
+
+    ASTNode(const std::string &val) : value(val) {}
+};
+using ASTNodePtr = shared_ptr<ASTNode>;
+
+class Lexer
+{
+
+private:
+    string src;
+    size_t pos;
+    size_t lineNo;
+    /*
+    It hold positive values.
+    In C++, size_t is an unsigned integer data type used to represent the
+    size of objects in bytes or indices, especially when working with memory-related
+    functions, arrays, and containers like vector or string. You can also use the int data type but size_t is recommended one
+    */
+
+public:
+    Lexer(const string &src)
+    {
+        this->src = src;
+        this->pos = 0;
+        this->lineNo = 0;
+    }
+
+    vector<Token> tokenize()
+    {
+        vector<Token> tokens;
+        while (pos < src.size())
+        {
+            char current = src[pos];
+
+            if (current == '/')
+            {
+                if (pos + 1 < src.size())
+                {
+                    if (src[pos + 1] == '/')
+                    {
+                        while (current != '\n')
+                        {
+                            pos++;
+                            current = src[pos];
+                        }
+                        this->lineNo++;
+                        pos++;
+                        continue;
+                    }
+                }
+            }
+            if (current == '\n')
+            {
+                this->lineNo++;
+                pos++;
+                continue;
+            }
+            if (isspace(current))
+            {
+                pos++;
+                continue;
+            }
+            if (isdigit(current))
+            {
+                string number = consumeNumber();
+                // values are 32-bit ints; later stages convert literals with stoi
+                size_t digits = number.find_first_not_of('0');
+                string significant = digits == string::npos ? "0" : number.substr(digits);
+                if (significant.size() > 10 || (significant.size() == 10 && significant > "2147483647"))
+                {
+                    cout << "Error: integer literal " << number << " is out of range on line " << this->lineNo << endl;
+                    exit(1);
+                }
+                tokens.push_back(Token{T_NUM, number, this->lineNo});
+                continue;
+            }
+            if (isalpha(current))
+            {
+                string word = consumeWord();
+                if (word == "int")
+                    tokens.push_back(Token{T_INT, word, this->lineNo});
+                else if (word == "if")
+                    tokens.push_back(Token{T_IF, word, this->lineNo});
+                else if (word == "else")
+                    tokens.push_back(Token{T_ELSE, word, this->lineNo});
+                else if (word == "return")
+                    tokens.push_back(Token{T_RETURN, word, this->lineNo});
+                else if (word == "for")
+                    tokens.push_back(Token{T_FOR, word, this->lineNo});
+                else if (word == "while")
+                    tokens.push_back(Token{T_WHILE, word, this->lineNo});
+                else if (word == "print")
+                    tokens.push_back(Token{T_PRINT, word, this->lineNo});
+                else if (word == "input")
+                    tokens.push_back(Token{T_INPUT, word, this->lineNo});
+                else if (word == "def")
+                    tokens.push_back(Token{T_DEF, word, this->lineNo});
+                else if (word == "call")
                     tokens.push_back(Token{T_CALL, word, this->lineNo});
                 else
-                    tokens.push_back(Token{T_ID, word, this->lineNo});
-                continue;
+                    tokens.push_back(Token{T_ID, word, this->lineNo});
+                continue;
+            }
+            // cheking operators with two char
+            string tempCurr = "";
+            tempCurr += current;
+            tempCurr += src[pos + 1];
+
+            if (tempCurr == ">=")
+            {
+                tokens.push_back(Token{T_GTE, ">=", this->lineNo});
+                pos += 2;
+                continue;
+            }
+            else if (tempCurr == "<=")
+            {
+                tokens.push_back(Token{T_STE, "<=", this->lineNo});
+                pos += 2;
+                continue;
+            }
+            else if (tempCurr == "==")
+            {
+                tokens.push_back(Token{T_EQUALITY, "==", this->lineNo});
+                pos += 2;
+                continue;
+            }
+
+            switch (current)
+            {
+            case '=':
+                tokens.push_back(Token{T_ASSIGN, "=", this->lineNo});
+                break;
+            case '+':
+                tokens.push_back(Token{T_PLUS, "+", this->lineNo});
+                break;
+            case '-':
+                tokens.push_back(Token{T_MINUS, "-", this->lineNo});
+                break;
+            case '*':
+                tokens.push_back(Token{T_MUL, "*", this->lineNo});
+                break;
+            case '/':
+                tokens.push_back(Token{T_DIV, "/", this->lineNo});
+                break;
+            case '(':
+                tokens.push_back(Token{T_LPAREN, "(", this->lineNo});
+                break;
+            case ')':
+                tokens.push_back(Token{T_RPAREN, ")", this->lineNo});
+                break;
+            case '{':
+                tokens.push_back(Token{T_LBRACE, "{", this->lineNo});
+                break;
+            case '}':
+                tokens.push_back(Token{T_RBRACE, "}", this->lineNo});
+                break;
+            case ';':
+                tokens.push_back(Token{T_SEMICOLON, ";", this->lineNo});
+                break;
+            case '>':
+                tokens.push_back(Token{T_GT, ">", this->lineNo});
+                break;
+            case '<':
+                tokens.push_back(Token{T_ST, "<", this->lineNo});
+                break;
+            case ',':
+                tokens.push_back(Token{T_COMMA, "<", this->lineNo});
+                break;
+            case '[':
+                tokens.push_back(Token{T_LBRACKET, "[", this->lineNo});
+                break;
+            case ']':
+                tokens.push_back(Token{T_RBRACKET, "]", this->lineNo});
+                break;
+
+            default:
+                cout << "Unexpected character: " << current << endl;
+                exit(1);
+            }
+            pos++;
+        }
+        tokens.push_back(Token{T_EOF, "", this->lineNo});
+        return tokens;
+    }
+
+    string consumeNumber()
+    {
+        size_t start = pos;
+        while (pos < src.size() && isdigit(src[pos]))
+            pos++;
+        return src.substr(start, pos - start);
+    }
+
+    string consumeWord()
+    {
+        size_t start = pos;
+        while (pos < src.size() && isalnum(src[pos]))
+        {
+            char x = src[pos];
+            pos++;
+        }
+        return src.substr(start, pos - start);
+    }
+};
+
+class Parser
+{
+
+public:
+    Parser(const vector<Token> &tokens, SymbolTable &symbolTable) : symbolTable(symbolTable)
+    {
+        this->tokens = tokens;
+        this->pos = 0;
+        // this->symbolTable = symbolTable;
+        tokenMap[T_INT] = "int";
+        tokenMap[T_ID] = "identifier";
+        tokenMap[T_NUM] = "number";
+        tokenMap[T_IF] = "if";
+        tokenMap[T_ELSE] = "else";
+        tokenMap[T_RETURN] = "return";
+        tokenMap[T_ASSIGN] = "=";    // Assignment operator
+        tokenMap[T_PLUS] = "+";      // Addition operator
+        tokenMap[T_MINUS] = "-";     // Subtraction operator
+        tokenMap[T_MUL] = "*";       // Multiplication operator
+        tokenMap[T_DIV] = "/";       // Division operator
+        tokenMap[T_LPAREN] = "(";    // Left parenthesis
+        tokenMap[T_RPAREN] = ")";    // Right parenthesis
+        tokenMap[T_LBRACE] = "{";    // Left brace
+        tokenMap[T_RBRACE] = "}";    // Right brace
+        tokenMap[T_SEMICOLON] = ";"; // Semicolon
+        tokenMap[T_GT] = ">";        // Greater-than operator
+        tokenMap[T_ST] = "<";
+        tokenMap[T_GTE] = ">=";
+        tokenMap[T_EQUALITY] = "==";
+        tokenMap[T_STE] = "<=";
+        tokenMap[T_EOF] = "end of file";
+        tokenMap[T_FOR] = "for";
+        tokenMap[T_WHILE] = "while";
+        tokenMap[T_PRINT] = "print";
+        tokenMap[T_INPUT] = "input";
+        tokenMap[T_DEF] = "def";
+        tokenMap[T_CALL] = "call";
+        tokenMap[T_LBRACKET] = "[";
+        tokenMap[T_RBRACKET] = "]";
+    }
+
+    shared_ptr<ASTNode> parseProgram()
+    {
+        shared_ptr<ASTNode> node;
+        // while (tokens[pos].type != T_EOF)
+        // {
+        //     node = parseStatement();
+        // }
+        node = parseBlock();
+        if (!quiet)
+            cerr << "Parsing completed successfully! No Syntax Error" << endl;
+        return node;
+    }
+
+    bool quiet = false; // no success message, for the benchmark's repeated compiles
+    std::vector<TAC> tacList;
+    int tempCounter = 0;
+    int labelCounter = 0;
+
+    static bool isArithmetic(const string &value)
+    {
+        return value == "+" || value == "-" || value == "*" || value == "/";
+    }
+    // Sethi-Ullman number of an expression subtree. Variables and literals
+    // need no register since they can be memory or immediate operands.
+    int registerNeed(const shared_ptr<ASTNode> &node)
+    {
+        if (node->value == "index")
+            return max(1, registerNeed(node->children[1])); // the element is loaded into a register
+        if (!isArithmetic(node->value))
+            return 0;
+        auto it = registerNeeds.find(node.get());
+        if (it != registerNeeds.end())
+            return it->second;
+        int left = registerNeed(node->children[0]);
+        int right = registerNeed(node->children[1]);
+        int need = left == right ? left + 1 : max(left, right);
+        registerNeeds[node.get()] = need;
+        return need;
+    }
+    bool containsCall(const shared_ptr<ASTNode> &node)
+    {
+        if (node->value == "call")
+            return true;
+        if (node->value == "index")
+            return containsCall(node->children[1]);
+        if (!isArithmetic(node->value))
+            return false;
+        auto it = callsInside.find(node.get());
+        if (it != callsInside.end())
+            return it->second;
+        bool calls = containsCall(node->children[0]) || containsCall(node->children[1]);
+        callsInside[node.get()] = calls;
+        return calls;
+    }
+    // arguments are evaluated left to right; dest receives the returned value and is empty when unused
+    void generateCall(const shared_ptr<ASTNode> &node, const string &dest)
+    {
+        auto funcName = node->children[0];                  // first child is name
+        int numberOfParam = stoi(node->children[1]->value); // second child is no of param
+        vector<string> params;
+        for (int i = 0; i < numberOfParam; i++)
+        {
+            params.push_back(generateTAC(node->children[2 + i]));
+        }
+        tacList.emplace_back("call", dest, funcName->value, to_string(numberOfParam), params);
+    }
+    std::string generateTemp()
+    {
+        return "t" + std::to_string(tempCounter++);
+    }
+    std::string generateLabel()
+    {
+        return "L" + std::to_string(labelCounter++);
+    }
+    // condition that fails to hold, so `if` and loop bodies are the fall-through path
+    std::string invertCondition(const std::string &op)
+    {
+        if (op == ">")
+            return "<=";
+        if (op == "<")
+            return ">=";
+        if (op == ">=")
+            return "<";
+        if (op == "<=")
+            return ">";
+        if (op == "==")
+            return "!=";
+        return "==";
+    }
+    // conditions lower straight to a compare and branch: if lhs op rhs goto label
+    TAC generateConditionTAC(const std::shared_ptr<ASTNode> &node, const std::string &label, bool negate = false)
+    {
+        // Ensure the node has 2 children: left operand and right operand
+        if (node->children.size() < 2 || !(node->value == ">" || node->value == "<" || node->value == ">=" || node->value == "<=" || node->value == "=="))
+        {
+            throw std::runtime_error("Invalid condition node structure");
+        }
+
+        std::string lhs = generateTAC(node->children[0]); // Left-hand side operand
+        std::string rhs = generateTAC(node->children[1]); // Right-hand side operand
+        std::string op = negate ? invertCondition(node->value) : node->value;
+
+        return TAC("if", op, lhs, rhs, {label});
+    }
+    std::string generateTAC(const std::shared_ptr<ASTNode> &node)
+    {
+        if (!node)
+            return "";
+
+        if (node->value == "print")
+        {
+            std::string exprResult = generateTAC(node->children[0]);
+            tacList.emplace_back("print", exprResult, "(", ")"); // op is expRes
+            return "";
+        }
+        else if (node->value == "input")
+        {
+            std::string exprResult = generateTAC(node->children[0]);
+            tacList.emplace_back("input", exprResult, "(", ")"); // op is expRes
+            return "";
+        }
+        else if (node->value == "function")
+        {
+
+            auto funcName = node->children[0];                  // first child is name
+            int numberOfParam = stoi(node->children[2]->value); // third child is no of param
+            vector<string> params;
+            for (int i = 0; i < numberOfParam; i++)
+            {
+                params.push_back(node->children[3 + i]->value);
+            }
+            tacList.emplace_back("function", "", funcName->value, to_string(numberOfParam), params);
+
+            generateTAC(node->children[1]); // second child is code
+            tacList.emplace_back("return", "", funcName->value);
+
+            return "";
+        }
+        else if (node->value == "call")
+        {
+            // a call inside an expression; statements use generateCall directly
+            std::string temp = generateTemp();
+            generateCall(node, temp);
+            return temp;
+        }
+        else if (node->value == "ret")
+        {
+            std::string value = node->children.empty() ? "0" : generateTAC(node->children[0]);
+            tacList.emplace_back("ret", "", value);
+            return "";
+        }
+        else if (node->value == "for")
+        {
+            std::string labelLoop = generateLabel();
+            std::string labelEnd = generateLabel();
+
+            // first child initializaion
+            auto initialization = generateTAC(node->children[0]);
+            // tacList.emplace_back(initialization);
+
+            // Condition is the second child, leaving the loop when it fails
+            tacList.emplace_back("label", "", labelLoop + ":");
+            tacList.push_back(generateConditionTAC(node->children[1], labelEnd, true));
+
+            // inc dec is the third child, run after the body
+            generateTAC(node->children[3]);
+            generateTAC(node->children[2]);
+            tacList.emplace_back("goto", " ", labelLoop); // Back edge to the condition
+
+            tacList.emplace_back("label", "", labelEnd + ":");
+
+            // End label
+            // tacList.emplace_back("label", "", labelEnd + ":");
+            return "";
+        }
+        else if (node->value == "while")
+        {
+            std::string labelLoop = generateLabel();
+            std::string labelEnd = generateLabel();
+
+            // Condition is the first child, leaving the loop when it fails
+            tacList.emplace_back("label", "", labelLoop + ":");
+            tacList.push_back(generateConditionTAC(node->children[0], labelEnd, true));
+
+            generateTAC(node->children[1]);
+            tacList.emplace_back("goto", " ", labelLoop); // Back edge to the condition
+
+            tacList.emplace_back("label", "", labelEnd + ":");
+            return "";
+        }
+        else if (node->value == "if")
+        {
+            std::string labelElse = generateLabel();
+            std::string labelEnd = generateLabel();
+
+            // Check for the 'else' block (third child if present)
+            if (node->children.size() > 2)
+            {
+                // Condition is the first child, jumping to the 'else' block when it fails
+                tacList.push_back(generateConditionTAC(node->children[0], labelElse, true));
+                generateTAC(node->children[1]);
+
+                tacList.emplace_back("goto", " ", labelEnd); // Jump over the 'else' block
+
+                // Label for the 'else' block
+                tacList.emplace_back("label", "", labelElse + ":");
+                generateTAC(node->children[2]);
+            }
+            else
+            {
+                tacList.push_back(generateConditionTAC(node->children[0], labelEnd, true));
+
+                // Generate TAC for the 'if' block (second child)
+                generateTAC(node->children[1]);
+            }
+
+            // End label
+            tacList.emplace_back("label", "", labelEnd + ":");
+            return "";
+        }
+
+        else if (node->value == "block")
+        {
+            for (const auto &child : node->children)
+            {
+                if (child && child->value == "call")
+                    generateCall(child, ""); // the returned value is unused
+                else
+                    generateTAC(child);
+            }
+            return "";
+        }
+        else if (node->value == "array")
+        {
+            // declaring an array clears it, every time the declaration runs
+            tacList.emplace_back(node->children[0]->value, "array", node->children[1]->value);
+            return "";
+        }
+        else if (node->value == "index")
+        {
+            std::string index = generateTAC(node->children[1]);
+            std::string temp = generateTemp();
+            tacList.emplace_back(temp, "[]", node->children[0]->value, index);
+            return temp;
+        }
+        else if (node->value == "store")
+        {
+            // a[i] = e: the index is evaluated before the value
+            std::string index = generateTAC(node->children[1]);
+            std::string value = generateTAC(node->children[2]);
+            tacList.emplace_back(node->children[0]->value, "[]=", index, value);
+            return "";
+        }
+        else if (node->value == "declaration")
+        {
+            std::string varName = node->children[1]->value;
+            if (node->children.size() > 2 && node->children[2]->value == "call")
+                generateCall(node->children[2], varName);
+            else if (node->children.size() > 2)
+            {
+                std::string exprResult = generateTAC(node->children[2]);
+                tacList.emplace_back(varName, "=", exprResult);
+            }
+            return "";
+        }
+        else if (node->value == "assignment")
+        {
+            std::string varName = node->children[0]->value;
+            if (node->children[1]->value == "call")
+            {
+                generateCall(node->children[1], varName); // the value goes straight to the variable
+                return "";
+            }
+            std::string exprResult = generateTAC(node->children[1]);
+            tacList.emplace_back(varName, "=", exprResult);
+            return "";
+        }
+        else if (isArithmetic(node->value))
+        {
+            // evaluate the side needing more registers first (Sethi-Ullman). A call
+            // clobbers registers, so a side with one goes first; calls on both
+            // sides keep source order for their side effects.
+            int leftNeed = registerNeed(node->children[0]);
+            int rightNeed = registerNeed(node->children[1]);
+            bool leftCalls = containsCall(node->children[0]);
+            bool rightCalls = containsCall(node->children[1]);
+            bool rightFirst = leftCalls || rightCalls ? rightCalls && !leftCalls : rightNeed > leftNeed;
+            std::string left, right;
+            if (rightFirst)
+            {
+                right = generateTAC(node->children[1]);
+                left = generateTAC(node->children[0]);
+                // two-address code reuses the left operand's register
+                if (node->value == "+" || node->value == "*")
+                    swap(left, right);
+            }
+            else
+            {
+                left = generateTAC(node->children[0]);
+                right = generateTAC(node->children[1]);
+            }
+            std::string temp = generateTemp();
+            tacList.emplace_back(temp, node->value, left, right);
+            return temp;
+        }
+        else if (isLiteral(node->value) || isIdentifier(node->value))
+        {
+            return node->value;
+        }
+        else
+        {
+            throw std::runtime_error("Unknown AST node type: " + node->value);
+        }
+    }
+    bool isLiteral(const std::string &value)
+    {
+        // Check for integer literal
+        if (!value.empty() && std::isdigit(value[0]))
+        {
+            for (char c : value)
+            {
+                if (!std::isdigit(c))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Check for string literal (enclosed in quotes)
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        {
+            return true;
+        }
+
+        return false;
+    }
+
+    // Check if a string is a valid identifier (e.g., variable name)
+    bool isIdentifier(const std::string &value)
+    {
+        if (value.empty() || !std::isalpha(value[0]) && value[0] != '_')
+        {
+            return false; // Identifiers must start with a letter or underscore
+        }
+
+        for (char c : value)
+        {
+            if (!std::isalnum(c) && c != '_')
+            {
+                return false; // Identifiers can only contain letters, digits, or underscores
+            }
+        }
+
+        return true;
+    }
+    // Helper function to print TAC instructions
+    void printTAC(const vector<string> &instructions)
+    {
+        for (const string &instr : instructions)
+        {
+            cout << instr << endl;
+        }
+    }
+
+private:
+    vector<Token> tokens;
+    size_t pos;
+
+    SymbolTable &symbolTable;
+
+    unordered_map<int, string> tokenMap;
+    unordered_map<const ASTNode *, int> registerNeeds; // memoised Sethi-Ullman numbers
+    unordered_map<const ASTNode *, bool> callsInside;  // memoised containsCall
+    // Map each enum value to its corresponding string representation
+
+    shared_ptr<ASTNode> parseStatement(string scope = "main")
+    {
+        if (tokens[pos].type == T_INT)
+        {
+            return parseDeclaration(scope);
+        }
+        else if (tokens[pos].type == T_ID)
+        {
+            return parseAssignment(scope);
+        }
+        else if (tokens[pos].type == T_IF)
+        {
+            return parseIfStatement(scope);
+        }
+        else if (tokens[pos].type == T_PRINT)
+        {
+            return parsePrintStatement(scope);
+        }
+        else if (tokens[pos].type == T_INPUT)
+        {
+            return parseInputStatement(scope);
+        }
+        else if (tokens[pos].type == T_FOR)
+        {
+            return parseForLoop(scope);
+        }
+        else if (tokens[pos].type == T_WHILE)
+        {
+            return parseWhileLoop(scope);
+        }
+        else if (tokens[pos].type == T_DEF)
+        {
+            return parseFunction();
+        }
+        else if (tokens[pos].type == T_CALL)
+        {
+            return parseFunctionCall(scope);
+        }
+        else if (tokens[pos].type == T_RETURN)
+        {
+            return parseReturnStatement(scope);
+        }
+        else if (tokens[pos].type == T_LBRACE)
+        {
+            parseBlock();
+        }
+        else
+        {
+            cout << "Syntax error: unexpected token " << tokens[pos].value << endl;
+            exit(1);
+        }
+        return nullptr;
+    }
+
+    shared_ptr<ASTNode> parseBlock(string scope = "main")
+    {
+        expect(T_LBRACE);
+        auto blockNode = make_shared<ASTNode>("block");
+        while (tokens[pos].type != T_RBRACE && tokens[pos].type != T_EOF)
+        {
+            auto statementNode = parseStatement(scope);
+            blockNode->children.push_back(statementNode);
+        }
+        expect(T_RBRACE);
+        return blockNode;
+    }
+
+    shared_ptr<ASTNode> parsePrintStatement(string scope = "main")
+    {
+        auto printStat = tokens[pos].value;
+        expect(T_PRINT);
+        expect(T_LPAREN);
+
+        string varName = tokens[pos].value;
+        expect(T_ID); // Expect the variable identifier
+
+        size_t line = symbolTable.symbolExists(varName, scope);
+        if (line == -1)
+        {
+            cout << "Error: Variable " << varName << " not declared!" << endl;
+            exit(1);
+        }
+        expectScalar(varName, scope);
+
+        expect(T_RPAREN);
+        expect(T_SEMICOLON);
+
+        auto printNode = std::make_shared<ASTNode>("print");
+        printNode->children.push_back(make_shared<ASTNode>(varName));
+
+        return printNode;
+    }
+    shared_ptr<ASTNode> parseInputStatement(string scope = "main")
+    {
+        expect(T_INPUT);
+        expect(T_LPAREN);
+
+        string varName = tokens[pos].value;
+        expect(T_ID); // Expect the variable identifier
+
+        size_t line = symbolTable.symbolExists(varName, scope);
+        if (line == -1)
+        {
+            cout << "Error: Variable " << varName << " not declared!" << endl;
+            exit(1);
+        }
+        expectScalar(varName, scope);
+
+        expect(T_RPAREN);
+        expect(T_SEMICOLON);
+
+        auto inputNode = std::make_shared<ASTNode>("input");
+        inputNode->children.push_back(make_shared<ASTNode>(varName));
+
+        return inputNode;
+    }
+    shared_ptr<ASTNode> parseFunction()
+    {
+        auto def = tokens[pos].value;
+
+        expect(T_DEF);
+
+        string funcName = tokens[pos].value;
+        expect(T_ID); // Expect the function identifier
+
+        size_t line = symbolTable.symbolExists(funcName);
+        if (line != -1)
+        {
+            cout << "Error: function " << funcName << " already declared! on Line " << line << endl;
+            exit(1);
+        }
+        symbolTable.addSymbol(funcName, def, tokens[pos].lineNo);
+
+        expect(T_LPAREN);
+        vector<shared_ptr<ASTNode>> parameters;
+        if (tokens[pos].type != T_RPAREN) // Check if parameters exist
+        {
+            do
+            {
+                string paramName = tokens[pos].value;
+                expect(T_ID); // Expect parameter name
+
+                // Check for duplicate parameter names
+                for (const auto &param : parameters)
+                {
+                    if (param->value == paramName)
+                    {
+                        cout << "Error: duplicate parameter name '" << paramName << "' in function " << funcName << "!" << endl;
+                        exit(1);
+                    }
+                }
+                symbolTable.addSymbol(paramName, "int", tokens[pos].lineNo, "", funcName);
+                // Add parameter as an ASTNode
+                parameters.push_back(make_shared<ASTNode>(paramName));
+                if (tokens[pos].type == T_COMMA)
+                {
+                    expect(T_COMMA);
+                    if (tokens[pos].type == T_RPAREN)
+                    {
+                        cout << "Error: Expect param name on Line " << tokens[pos].lineNo << endl;
+                        exit(1);
+                    }
+                }
+
+            } while (tokens[pos].type != T_RPAREN); // Consume ',' if there are more parameters
+        }
+        expect(T_RPAREN);
+        auto funcBlock = parseBlock(funcName);
+
+        auto funcNode = std::make_shared<ASTNode>("function");
+        funcNode->children.push_back(make_shared<ASTNode>(funcName));
+        funcNode->children.push_back(funcBlock);
+        funcNode->children.push_back(make_shared<ASTNode>(to_string(parameters.size()))); // number of params
+        for (auto param : parameters)
+        {
+            funcNode->children.push_back(param);
+        }
+
+        return funcNode;
+    }
+    shared_ptr<ASTNode> parseFunctionCall(string scope = "main")
+    {
+        auto funcNode = parseCallExpression(scope);
+        expect(T_SEMICOLON);
+        return funcNode;
+    }
+    // call name(args) without the semicolon; it is also a factor that yields the returned value
+    shared_ptr<ASTNode> parseCallExpression(string scope = "main")
+    {
+        expect(T_CALL);
+        string funcName = tokens[pos].value;
+        expect(T_ID); // Expect the function identifier
+
+        size_t line = symbolTable.symbolExists(funcName);
+        if (line == -1)
+        {
+            cout << "Error: function " << funcName << " is not declared " << line << endl;
+            exit(1);
+        }
+        expect(T_LPAREN);
+        vector<shared_ptr<ASTNode>> parameters;
+        if (tokens[pos].type != T_RPAREN)
+        {
+            do
+            {
+                string paramName = tokens[pos].value;
+                if (tokens[pos].type == T_ID && (tokens[pos + 1].type == T_COMMA || tokens[pos + 1].type == T_RPAREN))
+                {
+                    size_t line = symbolTable.symbolExists(paramName, scope);
+                    if (line == -1)
+                    {
+                        cout << "Error: variable " << paramName << " is not declared in this scope " << scope << line << endl;
+                        exit(1);
+                    }
+                }
+                // arguments are expressions, evaluated left to right
+                parameters.push_back(parseExpression(scope));
+                // Add parameter as an ASTNode
+                if (tokens[pos].type == T_COMMA)
+                {
+                    expect(T_COMMA);
+                    if (tokens[pos].type == T_RPAREN)
+                    {
+                        cout << "Error: Expect param name on Line " << tokens[pos].lineNo << endl;
+                        exit(1);
+                    }
+                }
+
+            } while (tokens[pos].type != T_RPAREN); // Consume ',' if there are more parameters
+        }
+        expect(T_RPAREN);
+        auto funcNode = std::make_shared<ASTNode>("call");
+        funcNode->children.push_back(make_shared<ASTNode>(funcName));
+        funcNode->children.push_back(make_shared<ASTNode>(to_string(parameters.size()))); // number of params
+        for (auto param : parameters)
+        {
+            funcNode->children.push_back(param);
+        }
+
+        return funcNode;
+    }
+    shared_ptr<ASTNode> parseForLoop(string scope = "main")
+    {
+        auto forNode = std::make_shared<ASTNode>("for");
+
+        expect(T_FOR);
+        expect(T_LPAREN);
+
+        auto initialization = parseAssignment(scope);
+
+        // expect(T_SEMICOLON);
+
+        auto condition = parseExpression(scope);
+
+        expect(T_SEMICOLON);
+
+        auto incDec = parseAssignment(scope);
+
+        expect(T_RPAREN);
+
+        forNode->children.push_back(initialization);
+        forNode->children.push_back(condition);
+        forNode->children.push_back(incDec);
+
+        auto forBlock = parseBlock(scope);
+        forNode->children.push_back(forBlock);
+
+        return forNode;
+    }
+    shared_ptr<ASTNode> parseWhileLoop(string scope = "main")
+    {
+        auto whileNode = std::make_shared<ASTNode>("while");
+
+        expect(T_WHILE);
+        expect(T_LPAREN);
+
+        auto condition = parseExpression(scope);
+
+        expect(T_RPAREN);
+
+        auto whileBlock = parseBlock(scope);
+        whileNode->children.push_back(condition);
+        whileNode->children.push_back(whileBlock);
+
+        return whileNode;
+    }
+    shared_ptr<ASTNode> parseDeclaration(string scope = "main")
+    {
+        auto type = tokens[pos].value;
+        expect(T_INT); // Expect 'int'
+        string varName = tokens[pos].value;
+        expect(T_ID); // Expect the variable identifier
+
+        size_t line = symbolTable.symbolExists(varName, scope);
+        if (line != -1)
+        {
+            cout << "Error: Variable " << varName << " already declared! on Line " << line << endl;
+            exit(1);
+        }
+        if (tokens[pos].type == T_LBRACKET)
+            return parseArrayDeclaration(varName, scope);
+        symbolTable.addSymbol(varName, type, tokens[pos].lineNo, "", scope);
+        expect(T_SEMICOLON); // Expect the semicolon at the end of the declaration
+
+        auto declNode = std::make_shared<ASTNode>("declaration");
+        declNode->children.push_back(make_shared<ASTNode>(type));
+        declNode->children.push_back(make_shared<ASTNode>(varName));
+
+        return declNode;
+    }
+    // int name[size]; with a literal size
+    shared_ptr<ASTNode> parseArrayDeclaration(const string &varName, string scope)
+    {
+        expect(T_LBRACKET);
+        string size = tokens[pos].value;
+        size_t lineNo = tokens[pos].lineNo;
+        expect(T_NUM);
+        // arrays live in the stack frame of every backend
+        if (size.size() > 5 || stoi(size) == 0 || stoi(size) > 65536)
+        {
+            cout << "Error: array " << varName << " needs a size between 1 and 65536 on line " << lineNo << endl;
+            exit(1);
+        }
+        expect(T_RBRACKET);
+        symbolTable.addSymbol(varName, "array", lineNo, size, scope);
+        expect(T_SEMICOLON);
+
+        auto arrayNode = std::make_shared<ASTNode>("array");
+        arrayNode->children.push_back(make_shared<ASTNode>(varName));
+        arrayNode->children.push_back(make_shared<ASTNode>(size));
+        return arrayNode;
+    }
+
+    // [index] after an array name; literal indices are checked against the size here
+    shared_ptr<ASTNode> parseIndex(const string &name, string scope)
+    {
+        size_t lineNo = tokens[pos].lineNo;
+        int size = symbolTable.arraySize(name, scope);
+        if (size == 0)
+        {
+            cout << "Error: " << name << " is not an array on line " << lineNo << endl;
+            exit(1);
+        }
+        expect(T_LBRACKET);
+        auto index = parseExpression(scope);
+        expect(T_RBRACKET);
+        if (isLiteral(index->value) && (index->value.size() > 9 || stoi(index->value) >= size))
+        {
+            cout << "Error: index " << index->value << " is out of bounds for " << name << "[" << size << "] on line " << lineNo << endl;
+            exit(1);
+        }
+        auto indexNode = std::make_shared<ASTNode>("index");
+        indexNode->children.push_back(make_shared<ASTNode>(name));
+        indexNode->children.push_back(index);
+        return indexNode;
+    }
+
+    void expectScalar(const string &name, string scope)
+    {
+        if (symbolTable.arraySize(name, scope) > 0)
+        {
+            cout << "Error: array " << name << " needs an index on line " << tokens[pos].lineNo << endl;
+            exit(1);
+        }
+    }
+
+    shared_ptr<ASTNode> parseAssignment(string scope = "main")
+    {
+        string id = tokens[pos].value;
+        expect(T_ID);
+
+        size_t line = symbolTable.symbolExists(id, scope);
+        if (line == -1)
+        {
+            cout << "Error: Variable " << id << " not declared!" << endl;
+            exit(1);
+        }
+        if (tokens[pos].type == T_LBRACKET)
+        {
+            auto element = parseIndex(id, scope);
+            expect(T_ASSIGN);
+            auto value = parseExpression(scope);
+            expect(T_SEMICOLON);
+            auto storeNode = std::make_shared<ASTNode>("store");
+            storeNode->children.push_back(element->children[0]);
+            storeNode->children.push_back(element->children[1]);
+            storeNode->children.push_back(value);
+            return storeNode;
+        }
+        expectScalar(id, scope);
+        expect(T_ASSIGN);
+        auto expNode = parseExpression(scope);
+        // symbolTable.updateVariableValue(id, tokens[pos - 1].value); may be problem
+        expect(T_SEMICOLON);
+
+        auto assignNode = std::make_shared<ASTNode>("assignment");
+        assignNode->children.push_back(make_shared<ASTNode>(id));
+        assignNode->children.push_back(expNode);
+
+        return assignNode;
+    }
+
+    shared_ptr<ASTNode> parseIfStatement(string scope = "main")
+    {
+        expect(T_IF);
+        auto ifNode = std::make_shared<ASTNode>("if");
+        expect(T_LPAREN);
+
+        auto condition = parseExpression(scope);
+        ifNode->children.push_back(condition);
+
+        expect(T_RPAREN);
+
+        auto ifBlock = parseBlock(scope);
+        ifNode->children.push_back(ifBlock);
+
+        if (tokens[pos].type == T_ELSE)
+        {
+            expect(T_ELSE);
+
+            auto elseBlock = parseBlock(scope);
+            ifNode->children.push_back(elseBlock);
+        }
+        return ifNode;
+    }
+
+    // return expr; or a bare return; which returns 0
+    shared_ptr<ASTNode> parseReturnStatement(string scope = "main")
+    {
+        if (scope == "main")
+        {
+            cout << "Error: return outside a function on line " << tokens[pos].lineNo << endl;
+            exit(1);
+        }
+        expect(T_RETURN);
+        auto returnNode = std::make_shared<ASTNode>("ret");
+        if (tokens[pos].type != T_SEMICOLON)
+            returnNode->children.push_back(parseExpression(scope));
+        expect(T_SEMICOLON);
+        return returnNode;
+    }
+
+    shared_ptr<ASTNode> parseExpression(string scope = "main")
+    {
+        auto node = parseTerm(scope);
+        while (tokens[pos].type == T_PLUS || tokens[pos].type == T_MINUS || tokens[pos].type == T_GT || tokens[pos].type == T_ST || tokens[pos].type == T_GTE || tokens[pos].type == T_STE || tokens[pos].type == T_EQUALITY)
+        {
+            auto op = tokens[pos].value;
+            pos++;
+            auto right = parseTerm(scope);
+            auto opNode = make_shared<ASTNode>(op);
+            opNode->children.push_back(node);
+            opNode->children.push_back(right);
+            node = opNode; // Update the root of the expression tree
+        }
+        return node;
+        // if (tokens[pos].type == T_GT)
+        // {
+        //     pos++;
+        //     parseExpression(); // After relational operator, parse the next expression
+        // }
+    }
+
+    shared_ptr<ASTNode> parseTerm(string scope = "main")
+    {
+        auto node = parseFactor(scope);
+        while (tokens[pos].type == T_MUL || tokens[pos].type == T_DIV)
+        {
+            auto op = tokens[pos].value;
+            pos++;
+            auto right = parseFactor(scope);
+            auto opNode = make_shared<ASTNode>(op);
+            opNode->children.push_back(node);
+            opNode->children.push_back(right);
+            node = opNode; // Update the root of the term tree
+        }
+        return node;
+    }
+
+    shared_ptr<ASTNode> parseFactor(string scope = "main")
+    {
+        if (tokens[pos].type == T_ID && tokens[pos + 1].type == T_LBRACKET)
+        {
+            string name = tokens[pos].value;
+            pos++;
+            return parseIndex(name, scope);
+        }
+        if (tokens[pos].type == T_NUM || tokens[pos].type == T_ID)
+        {
+            auto factor = tokens[pos].value;
+            if (tokens[pos].type == T_ID)
+                expectScalar(factor, scope);
+            auto node = make_shared<ASTNode>(factor);
+            pos++;
+            return node;
+        }
+        else if (tokens[pos].type == T_LPAREN)
+        {
+            expect(T_LPAREN);
+            auto node = parseExpression(scope);
+            expect(T_RPAREN);
+            return node;
+        }
+        else if (tokens[pos].type == T_CALL)
+        {
+            return parseCallExpression(scope);
+        }
+        else
+        {
+            cout << "Syntax error: unexpected token " << tokens[pos].value << endl;
+            exit(1);
+        }
+        return nullptr;
+    }
+
+    void expect(TokenType type)
+    {
+        if (tokens[pos].type == type)
+        {
+            pos++;
+        }
+        else
+        {
+            cout << "Syntax error: expected " << tokenMap[type] << " but found " << tokens[pos].value << " on line no: " << tokens[pos].lineNo << endl;
+            exit(1);
+        }
+    }
+
+    // just for function call
+    int expectTwoToken(TokenType type1, TokenType type2)
+    {
+        if (tokens[pos].type == type1)
+        {
+            pos++;
+            return 1;
+        }
+        else if (tokens[pos].type == type2)
+        {
+            pos++;
+            return 2;
+        }
+        else
+        {
+            cout << "Syntax error: expected " << tokenMap[type1] << " or " << tokenMap[type2] << " but found " << tokens[pos].value << " on line no: " << tokens[pos].lineNo << endl;
+            exit(1);
+        }
+    }
+};
+
+struct TACRegion
+{
+    string scope;     // "main" or the function name
+    vector<TAC> code; // functions keep their function/return markers
+    TACRegion(string scope = "main") : scope(scope) {}
+};
+
+class TACUtils
+{
+public:
+    static bool isTemp(const std::string &str)
+    {
+        return str.length() >= 2 && str[0] == 't' && std::isdigit(str[1]);
+    }
+    static bool isLiteral(const std::string &str)
+    {
+        return !str.empty() && all_of(str.begin(), str.end(), ::isdigit);
+    }
+    static bool isVariable(const std::string &str)
+    {
+        if (str.empty() || !std::isalpha(str[0]) || isTemp(str))
+            return false;
+        return all_of(str.begin(), str.end(), ::isalnum);
+    }
+    // vector values are named %v0, %v1, ... by the vectorizer
+    static bool isVector(const std::string &str)
+    {
+        return !str.empty() && str[0] == '%';
+    }
+    static bool isMarker(const TAC &tac)
+    {
+        return tac.result == "function" || tac.result == "return";
+    }
+    // `count k` from Profile::instrument; a variable named count is only ever assigned with an op
+    static bool isCounter(const TAC &tac)
+    {
+        return tac.result == "count" && tac.op.empty();
+    }
+    // an `if` whose condition was negated is taken when it used to fall through
+    static void invertCounts(TAC &tac)
+    {
+        if (tac.hits >= 0)
+            tac.taken = tac.hits - tac.taken;
+    }
+    // removes the trailing arithmetic that only computed the `dead` temps; expression
+    // temps have a single use, and divisions and element loads stay for their run-time checks
+    static void dropDeadTemps(vector<TAC> &code, unordered_set<string> dead)
+    {
+        while (!code.empty() && isTemp(code.back().result) && dead.count(code.back().result))
+        {
+            const TAC &last = code.back();
+            if (last.op != "=" && last.op != "+" && last.op != "-" && last.op != "*")
+                break;
+            dead.insert(last.arg1);
+            dead.insert(last.arg2);
+            code.pop_back();
+        }
+    }
+    // labels are stored as "L0:" in label TACs and "L0" in jumps
+    static string labelName(const string &label)
+    {
+        if (!label.empty() && label.back() == ':')
+            return label.substr(0, label.size() - 1);
+        return label;
+    }
+
+    // splits the flat list into main and one region per function, in source order
+    static vector<TACRegion> split(const vector<TAC> &tacList)
+    {
+        vector<TACRegion> regions;
+        regions.push_back(TACRegion("main"));
+        bool isFunction = false;
+        for (const auto &tac : tacList)
+        {
+            if (tac.result == "function")
+            {
+                isFunction = true;
+                regions.push_back(TACRegion(tac.arg1));
+            }
+            if (isFunction)
+                regions.back().code.push_back(tac);
+            else
+                regions[0].code.push_back(tac);
+            if (tac.result == "return")
+                isFunction = false;
+        }
+        return regions;
+    }
+    // functions first, then main; codegen routes each region on its own so the assembly is unchanged
+    static vector<TAC> join(const vector<TACRegion> &regions)
+    {
+        vector<TAC> tacList;
+        for (size_t i = 1; i < regions.size(); i++)
+            tacList.insert(tacList.end(), regions[i].code.begin(), regions[i].code.end());
+        tacList.insert(tacList.end(), regions[0].code.begin(), regions[0].code.end());
+        return tacList;
+    }
+
+    // renames variables/temps through `values` and jump targets through `labels`
+    static void rename(TAC &tac, const unordered_map<string, string> &values, const unordered_map<string, string> &labels)
+    {
+        auto value = [&](string &s)
+        {
+            auto it = values.find(s);
+            if (it != values.end())
+                s = it->second;
+        };
+        auto label = [&](string &s)
+        {
+            bool hasColon = !s.empty() && s.back() == ':';
+            auto it = labels.find(labelName(s));
+            if (it != labels.end())
+                s = it->second + (hasColon ? ":" : "");
+        };
+
+        if (tac.result == "if")
+        {
+            value(tac.arg1);
+            value(tac.arg2);
+            label(tac.extras[0]);
+        }
+        else if (tac.result == "goto" || tac.result == "label")
+            label(tac.arg1);
+        else if (tac.result == "print" || tac.result == "input")
+            value(tac.op);
+        else if (tac.result == "call" || tac.result == "function")
+        {
+            if (tac.result == "call")
+                value(tac.op); // the returned value's destination, empty when unused
+            for (auto &arg : tac.extras)
+                value(arg);
+        }
+        else if (tac.result == "ret")
+            value(tac.arg1);
+        else if (tac.result != "return" && !isCounter(tac))
+        {
+            value(tac.result);
+            value(tac.arg1);
+            value(tac.arg2);
+        }
+    }
+};
+
+// Branch and call counts of a run. Every `if` and `call` is numbered before
+// inlining and the passes copy the number along with the instruction, so the
+// counts of all copies add up. An instrumented build places its counters
+// right after numbering, ahead of the passes. Counter 2*id counts executions and 2*id+1 the
+// times an `if` fell through. The file is a header with the source hash and
+// the number of ids, then one "executed fell-through" line per id.
+class Profile
+{
+public:
+    uint64_t hash = 14695981039346656037ull;
+    int ids = 0;
+    vector<long long> counters;
+
+    Profile(const string &source)
+    {
+        for (unsigned char c : source)
+            hash = (hash ^ c) * 1099511628211ull; // FNV-1a
+    }
+
+    void stamp(vector<TAC> &tacList)
+    {
+        ids = 0;
+        for (auto &tac : tacList)
+        {
+            if (tac.result == "if" || tac.result == "call")
+                tac.profileId = ids++;
+        }
+        counters.assign(2 * ids, 0);
+    }
+
+    string header() const { return "profile " + to_string(hash) + " " + to_string(ids) + "\n"; }
+
+    string text() const
+    {
+        string text = header();
+        for (int id = 0; id < ids; id++)
+            text += to_string(counters[2 * id]) + " " + to_string(counters[2 * id + 1]) + "\n";
+        return text;
+    }
+
+    // reads counts recorded for this program and copies them onto its stamped TACs
+    void use(const string &path, vector<TAC> &tacList)
+    {
+        ifstream file(path);
+        if (!file)
+        {
+            cout << "Error: cannot open " << path << endl;
+            exit(1);
+        }
+        string line;
+        getline(file, line);
+        if (line + "\n" != header())
+        {
+            cout << "Error: profile " << path << " was recorded for a different program" << endl;
+            exit(1);
+        }
+        for (auto &counter : counters)
+        {
+            if (!(file >> counter))
+            {
+                cout << "Error: profile " << path << " is truncated" << endl;
+                exit(1);
+            }
+        }
+        for (auto &tac : tacList)
+        {
+            if (tac.profileId < 0)
+                continue;
+            tac.hits = counters[2 * tac.profileId];
+            if (tac.result == "if")
+                tac.taken = tac.hits - counters[2 * tac.profileId + 1];
+        }
+    }
+
+    // counts every numbered `if` before and after it and every numbered call before it
+    void instrument(vector<TAC> &tacList) const
+    {
+        vector<TAC> code;
+        for (const auto &tac : tacList)
+        {
+            if (tac.profileId >= 0)
+                code.emplace_back("count", "", to_string(2 * tac.profileId));
+            code.push_back(tac);
+            if (tac.profileId >= 0 && tac.result == "if")
+                code.emplace_back("count", "", to_string(2 * tac.profileId + 1));
+        }
+        tacList = code;
+    }
+};
+
+// Runs the program at compile time for at most `budget` TAC steps. A program
+// that finishes without reading input becomes the list of values it prints.
+// One that reads input is run up to its first `input` in main, or the call in
+// main that leads to one; the residual prints what came before, restores
+// main's variables and arrays and jumps to that point. Division by zero, an
+// index out of bounds or an exhausted budget leave the program unchanged, so
+// errors and long runs still happen at run time.
+class PartialEvaluator
+{
+public:
+    PartialEvaluator(Parser &parser, SymbolTable &symbolTable, int budget = 1000000)
+        : parser(parser), symbolTable(symbolTable), budget(budget) {}
+
+    void run()
+    {
+        regions = TACUtils::split(parser.tacList);
+        for (size_t i = 0; i < regions.size(); i++)
+            functionIndex[regions[i].scope] = i;
+        for (const auto &region : regions)
+            decoded.push_back(decode(region));
+
+        Frame frame;
+        int32_t result;
+        size_t resume = 0;
+        Status status = execute(0, frame, result, 0, &resume);
+        if (status == FINISHED)
+        {
+            regions.resize(1);
+            regions[0].code = printed();
+            complete = true;
+        }
+        else if (status == NEEDS_INPUT && resume > 0)
+            residual(frame, resume);
+        else
+            return;
+        precomputedPrints = (int)outputs.size();
+        parser.tacList = TACUtils::join(regions);
+    }
+
+    bool isComplete() const { return complete; }
+    int getPrecomputedPrints() const { return precomputedPrints; }
+
+private:
+    enum Status
+    {
+        FINISHED,
+        NEEDS_INPUT,
+        FAILED
+    };
+    enum Kind
+    {
+        SKIP,
+        COPY,
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        JUMP,
+        BRANCH,
+        PRINT,
+        INPUT,
+        CALL,
+        RET,
+        ARRAY,
+        LOAD,
+        STORE,
+        FAIL // a jump to a missing label or a call that cannot be made
+    };
+    // a variable's slot, or a literal when slot is -1
+    struct Operand
+    {
+        int slot = -1;
+        int32_t literal = 0;
+    };
+    // one TAC with its names resolved to slots and its label to an index
+    struct Step
+    {
+        Kind kind = SKIP;
+        string relop;
+        int dst = -1;
+        Operand lhs, rhs;
+        size_t target = 0;
+        vector<Operand> args;
+    };
+    struct Decoded
+    {
+        vector<Step> steps;
+        vector<string> names; // slot -> variable, temp or array
+        vector<bool> isArray;
+        bool hasArrays = false;
+        vector<int> params;
+        unordered_map<string, int> slots;
+    };
+    struct Frame
+    {
+        vector<int32_t> values;
+        vector<vector<int32_t>> arrays;
+    };
+    static const int maxDepth = 1000;
+    static const size_t maxOutputs = 10000;
+
+    Parser &parser;
+    SymbolTable &symbolTable;
+    int budget;
+    long long steps = 0;
+    bool complete = false;
+    int precomputedPrints = 0;
+    vector<TACRegion> regions;
+    vector<Decoded> decoded;
+    unordered_map<string, size_t> functionIndex;
+    vector<int32_t> outputs;
+
+    static int slot(Decoded &d, const string &name)
+    {
+        auto it = d.slots.find(name);
+        if (it != d.slots.end())
+            return it->second;
+        d.names.push_back(name);
+        d.isArray.push_back(false);
+        return d.slots[name] = (int)d.names.size() - 1;
+    }
+    static Operand operand(Decoded &d, const string &value)
+    {
+        Operand o;
+        if (TACUtils::isLiteral(value))
+            o.literal = stoi(value);
+        else
+            o.slot = slot(d, value);
+        return o;
+    }
+
+    Decoded decode(const TACRegion &region)
+    {
+        Decoded d;
+        unordered_map<string, size_t> labels;
+        const vector<TAC> &code = region.code;
+        for (size_t k = 0; k < code.size(); k++)
+        {
+            if (code[k].result == "label")
+                labels[TACUtils::labelName(code[k].arg1)] = k;
+        }
+        if (!code.empty() && code.front().result == "function")
+        {
+            for (const auto &param : code.front().extras)
+                d.params.push_back(slot(d, param));
+        }
+        for (const auto &tac : code)
+        {
+            Step step;
+            if (tac.result == "goto" || tac.result == "if")
+            {
+                auto it = labels.find(TACUtils::labelName(tac.result == "goto" ? tac.arg1 : tac.extras[0]));
+                step.kind = it == labels.end() ? FAIL : tac.result == "goto" ? JUMP : BRANCH;
+                step.target = it == labels.end() ? 0 : it->second;
+                if (tac.result == "if")
+                {
+                    step.relop = tac.op;
+                    step.lhs = operand(d, tac.arg1);
+                    step.rhs = operand(d, tac.arg2);
+                }
+            }
+            else if (tac.result == "label" || tac.result == "function")
+                step.kind = SKIP;
+            else if (tac.result == "return" || tac.result == "ret")
+            {
+                step.kind = RET;
+                step.lhs = operand(d, tac.result == "ret" ? tac.arg1 : "0");
+            }
+            else if (tac.result == "print" || tac.result == "input")
+            {
+                step.kind = tac.result == "print" ? PRINT : INPUT;
+                step.lhs = operand(d, tac.op);
+            }
+            else if (tac.result == "call")
+            {
+                auto it = functionIndex.find(tac.arg1);
+                bool callable = it != functionIndex.end() && it->second > 0;
+                step.kind = callable ? CALL : FAIL;
+                step.target = callable ? it->second : 0;
+                step.dst = tac.op.empty() ? -1 : slot(d, tac.op);
+                for (const auto &arg : tac.extras)
+                    step.args.push_back(operand(d, arg));
+            }
+            else if (tac.op == "array")
+            {
+                step.kind = ARRAY;
+                step.dst = slot(d, tac.result);
+                step.lhs.literal = stoi(tac.arg1);
+                d.isArray[step.dst] = true;
+                d.hasArrays = true;
+            }
+            else if (tac.op == "[]")
+            {
+                d.hasArrays = true;
+                step.kind = LOAD;
+                step.dst = slot(d, tac.result);
+                step.lhs = operand(d, tac.arg1);
+                step.rhs = operand(d, tac.arg2);
+            }
+            else if (tac.op == "[]=")
+            {
+                d.hasArrays = true;
+                step.kind = STORE;
+                step.dst = slot(d, tac.result);
+                step.lhs = operand(d, tac.arg1);
+                step.rhs = operand(d, tac.arg2);
+            }
+            else
+            {
+                const string &op = tac.op;
+                step.kind = tac.arg2.empty() ? COPY : op == "+" ? ADD : op == "-" ? SUB : op == "*" ? MUL : op == "/" ? DIV : FAIL;
+                step.dst = slot(d, tac.result);
+                step.lhs = operand(d, tac.arg1);
+                if (!tac.arg2.empty())
+                    step.rhs = operand(d, tac.arg2);
+            }
+            d.steps.push_back(step);
+        }
+        return d;
+    }
+
+    static bool holds(const string &op, int32_t lhs, int32_t rhs)
+    {
+        if (op == "<")
+            return lhs < rhs;
+        if (op == "<=")
+            return lhs <= rhs;
+        if (op == ">")
+            return lhs > rhs;
+        if (op == ">=")
+            return lhs >= rhs;
+        if (op == "==")
+            return lhs == rhs;
+        return lhs != rhs;
+    }
+
+    // runs one region; `resume` is set in main only, to the instruction to restart from
+    Status execute(size_t index, Frame &frame, int32_t &result, int depth, size_t *resume)
+    {
+        const Decoded &d = decoded[index];
+        frame.values.resize(d.names.size());
+        if (d.hasArrays)
+            frame.arrays.resize(d.names.size());
+        vector<int32_t> &values = frame.values;
+        auto value = [&](const Operand &o) { return o.slot < 0 ? o.literal : values[o.slot]; };
+        result = 0;
+        size_t pc = 0;
+        while (pc < d.steps.size())
+        {
+            if (++steps > budget)
+                return FAILED;
+            const Step &step = d.steps[pc];
+            switch (step.kind)
+            {
+            case SKIP:
+                break;
+            case COPY:
+                values[step.dst] = value(step.lhs);
+                break;
+            case ADD:
+                values[step.dst] = (int32_t)((uint32_t)value(step.lhs) + (uint32_t)value(step.rhs));
+                break;
+            case SUB:
+                values[step.dst] = (int32_t)((uint32_t)value(step.lhs) - (uint32_t)value(step.rhs));
+                break;
+            case MUL:
+                values[step.dst] = (int32_t)((uint32_t)value(step.lhs) * (uint32_t)value(step.rhs));
+                break;
+            case DIV:
+            {
+                int32_t lhs = value(step.lhs), rhs = value(step.rhs);
+                if (rhs == 0)
+                    return FAILED;
+                values[step.dst] = rhs == -1 ? (int32_t)(0u - (uint32_t)lhs) : lhs / rhs;
+                break;
+            }
+            case JUMP:
+                pc = step.target;
+                continue;
+            case BRANCH:
+                if (holds(step.relop, value(step.lhs), value(step.rhs)))
+                {
+                    pc = step.target;
+                    continue;
+                }
+                break;
+            case PRINT:
+                if (outputs.size() == maxOutputs)
+                    return FAILED;
+                outputs.push_back(value(step.lhs));
+                break;
+            case INPUT:
+                if (resume)
+                    *resume = pc;
+                return NEEDS_INPUT;
+            case CALL:
+            {
+                const Decoded &callee = decoded[step.target];
+                if (depth == maxDepth || callee.params.size() != step.args.size())
+                    return FAILED;
+                Frame inner;
+                inner.values.resize(callee.names.size());
+                for (size_t i = 0; i < step.args.size(); i++)
+                    inner.values[callee.params[i]] = value(step.args[i]);
+                size_t printedBefore = outputs.size();
+                int32_t returned;
+                Status status = execute(step.target, inner, returned, depth + 1, nullptr);
+                if (status == NEEDS_INPUT && resume)
+                {
+                    // restart at the call; what it printed is printed again at run time
+                    outputs.resize(printedBefore);
+                    *resume = pc;
+                }
+                if (status != FINISHED)
+                    return status;
+                if (step.dst >= 0)
+                    values[step.dst] = returned;
+                break;
+            }
+            case RET:
+                result = value(step.lhs);
+                return FINISHED;
+            case ARRAY:
+                frame.arrays[step.dst].assign(step.lhs.literal, 0);
+                break;
+            case LOAD:
+            case STORE:
+            {
+                vector<int32_t> &array = frame.arrays[step.kind == LOAD ? step.lhs.slot : step.dst];
+                int32_t i = value(step.kind == LOAD ? step.rhs : step.lhs);
+                if (i < 0 || i >= (int32_t)array.size())
+                    return FAILED;
+                if (step.kind == LOAD)
+                    values[step.dst] = array[i];
+                else
+                    array[i] = value(step.rhs);
+                break;
+            }
+            case FAIL:
+                return FAILED;
+            }
+            pc++;
+        }
+        return FINISHED;
+    }
+
+    // dest = value using non-negative literals only
+    static void assign(vector<TAC> &code, const string &dest, int32_t value)
+    {
+        if (value >= 0)
+            code.emplace_back(dest, "=", to_string(value));
+        else if (value == INT32_MIN)
+        {
+            code.emplace_back(dest, "-", "0", "2147483647");
+            code.emplace_back(dest, "-", dest, "1");
+        }
+        else
+            code.emplace_back(dest, "-", "0", to_string(-value));
+    }
+
+    vector<TAC> printed()
+    {
+        vector<TAC> code;
+        if (outputs.empty())
+            return code;
+        string name;
+        int counter = 0;
+        do
+        {
+            name = "printed" + to_string(counter++);
+        } while (symbolTable.symbolExists(name) != -1);
+        symbolTable.addSymbol(name, "int", 0);
+        for (int32_t output : outputs)
+        {
+            assign(code, name, output);
+            code.emplace_back("print", name, "(", ")");
+        }
+        return code;
+    }
+
+    // prints, main's state at `resume`, then the original main from there on
+    void residual(const Frame &frame, size_t resume)
+    {
+        const Decoded &d = decoded[0];
+        vector<TAC> &main = regions[0].code;
+        // a temp is used once after its definition, so only the ones still to be used matter
+        unordered_set<string> pending;
+        for (size_t k = resume; k < main.size(); k++)
+        {
+            for (const string *value : {&main[k].op, &main[k].arg1, &main[k].arg2})
+                pending.insert(*value);
+            pending.insert(main[k].extras.begin(), main[k].extras.end());
+        }
+        vector<TAC> code = printed();
+        for (size_t i = 0; i < d.names.size(); i++)
+        {
+            // everything starts out as zero, and arrays not declared yet are declared again
+            if (!d.isArray[i])
+            {
+                if (frame.values[i] != 0 && (!TACUtils::isTemp(d.names[i]) || pending.count(d.names[i])))
+                    assign(code, d.names[i], frame.values[i]);
+                continue;
+            }
+            const vector<int32_t> &array = frame.arrays[i];
+            if (array.empty())
+                continue;
+            code.emplace_back(d.names[i], "array", to_string(array.size()));
+            for (size_t k = 0; k < array.size(); k++)
+            {
+                if (array[k] == 0)
+                    continue;
+                string stored = to_string(array[k]);
+                if (array[k] < 0)
+                {
+                    stored = parser.generateTemp();
+                    assign(code, stored, array[k]);
+                }
+                code.emplace_back(d.names[i], "[]=", to_string(k), stored);
+            }
+        }
+        string label = parser.generateLabel();
+        code.emplace_back("goto", " ", label);
+        code.insert(code.end(), main.begin(), main.begin() + resume);
+        code.emplace_back("label", "", label + ":");
+        code.insert(code.end(), main.begin() + resume, main.end());
+        main = code;
+    }
+};
+
+// Replaces `call` sites of small functions by a renamed copy of the callee body.
+// A call costs the saves of live caller-saved registers, the argument moves or
+// pushes, CALL and the parameter stores in the callee, so bodies up to
+// `threshold` instructions are expanded.
+class Inliner
+{
+public:
+    Inliner(Parser &parser, SymbolTable &symbolTable, int threshold = 16)
+        : parser(parser), symbolTable(symbolTable), threshold(threshold) {}
+
+    void run()
+    {
+        regions = TACUtils::split(parser.tacList);
+        for (size_t i = 1; i < regions.size(); i++)
+            functionIndex[regions[i].scope] = i;
+
+        // callees are visited before callers so nested calls are already expanded
+        for (size_t i = 1; i < regions.size(); i++)
+            visit(i);
+        inlineCalls(regions[0]);
+
+        // drop functions whose every call site was expanded
+        unordered_map<string, int> remainingCalls;
+        for (const auto &region : regions)
+        {
+            for (const auto &tac : region.code)
+            {
+                if (tac.result == "call")
+                    remainingCalls[tac.arg1]++;
+            }
+        }
+        vector<TACRegion> kept;
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            const string &name = regions[i].scope;
+            if (i > 0 && inlinedCalls[name] > 0 && remainingCalls[name] == 0)
+                continue;
+            kept.push_back(regions[i]);
+        }
+        parser.tacList = TACUtils::join(kept);
+    }
+
+    int getInlinedCount() const { return inlinedCount; }
+
+private:
+    static const long long hotCalls = 1000; // profiled executions that make a call site hot
+
+    Parser &parser;
+    SymbolTable &symbolTable;
+    int threshold;
+    int inlinedCount = 0;
+    int freshCounter = 0;
+    vector<TACRegion> regions;
+    unordered_map<string, size_t> functionIndex;
+    unordered_map<string, int> state; // 1 = on the DFS stack, 2 = done
+    unordered_map<string, int> inlinedCalls;
+    // per callee, computed once it is final: callees are done before their callers
+    unordered_map<string, int> bodySizes;
+    unordered_map<string, vector<string>> zeroedLocals;
+
+    void visit(size_t index)
+    {
+        const string name = regions[index].scope;
+        if (state[name] != 0)
+            return;
+        state[name] = 1;
+        for (const auto &tac : regions[index].code)
+        {
+            if (tac.result == "call" && functionIndex.count(tac.arg1))
+                visit(functionIndex[tac.arg1]);
+        }
+        inlineCalls(regions[index]);
+        state[name] = 2;
+    }
+
+    int bodySize(const TACRegion &callee)
+    {
+        auto it = bodySizes.find(callee.scope);
+        if (it != bodySizes.end())
+            return it->second;
+        int size = 0;
+        for (const auto &tac : callee.code)
+        {
+            if (!TACUtils::isMarker(tac) && !TACUtils::isCounter(tac) && tac.result != "label")
+                size++;
+        }
+        return bodySizes[callee.scope] = size;
+    }
+
+    bool shouldInline(const string &caller, const TAC &call)
+    {
+        auto it = functionIndex.find(call.arg1);
+        if (it == functionIndex.end() || call.arg1 == caller || state[call.arg1] == 1)
+            return false; // unknown or recursive
+        int callOverhead = 5 + 2 * stoi(call.arg2);
+        int size = bodySize(regions[it->second]);
+        // with a profile, calls that never ran stay out of line and hot ones may be bigger
+        if (call.hits == 0)
+            return size <= callOverhead;
+        int limit = call.hits >= hotCalls ? 4 * threshold : threshold;
+        return size <= limit || size <= callOverhead;
+    }
+
+    void inlineCalls(TACRegion &region)
+    {
+        vector<TAC> code;
+        for (const auto &tac : region.code)
+        {
+            if (tac.result == "call" && shouldInline(region.scope, tac))
+                expand(tac, region.scope, code);
+            else
+                code.push_back(tac);
+        }
+        region.code = code;
+    }
+
+    string freshVariable(const string &name, const string &scope)
+    {
+        string fresh;
+        do
+        {
+            fresh = name + "inl" + to_string(freshCounter++);
+        } while (symbolTable.symbolExists(fresh, scope) != -1 || symbolTable.symbolExists(fresh) != -1);
+        symbolTable.addSymbol(fresh, "int", 0, "", scope);
+        return fresh;
+    }
+
+    void expand(const TAC &call, const string &scope, vector<TAC> &code)
+    {
+        const TACRegion &callee = regions[functionIndex[call.arg1]];
+        const TAC &header = callee.code.front();
+        unordered_map<string, string> values;
+        unordered_map<string, string> labels;
+
+        auto mapValue = [&](const string &s)
+        {
+            if (s.empty() || values.count(s))
+                return;
+            if (TACUtils::isTemp(s))
+                values[s] = parser.generateTemp();
+            else if (TACUtils::isVariable(s) && symbolTable.symbolExists(s, callee.scope) != -1)
+                values[s] = freshVariable(s, scope);
+        };
+
+        // parameters are copied from the call arguments
+        for (size_t i = 0; i < header.extras.size(); i++)
+        {
+            mapValue(header.extras[i]);
+            code.emplace_back(values[header.extras[i]], "=", call.extras[i]);
+        }
+        // an out-of-line call starts its locals at zero, so each expansion does too
+        auto zeroed = zeroedLocals.find(callee.scope);
+        if (zeroed == zeroedLocals.end())
+            zeroed = zeroedLocals.emplace(callee.scope, readBeforeWritten(callee)).first;
+        for (const auto &local : zeroed->second)
+        {
+            mapValue(local);
+            code.emplace_back(values[local], "=", "0");
+        }
+        vector<TAC> body;
+        for (const auto &tac : callee.code)
+        {
+            if (TACUtils::isMarker(tac))
+                continue;
+            if (tac.result == "label")
+                labels[TACUtils::labelName(tac.arg1)] = parser.generateLabel();
+            else if (tac.result == "print" || tac.result == "input")
+                mapValue(tac.op);
+            else if (tac.result == "call")
+            {
+                mapValue(tac.op);
+                for (const auto &arg : tac.extras)
+                    mapValue(arg);
+            }
+            else if (tac.result == "ret")
+                mapValue(tac.arg1);
+            else if (tac.result != "goto" && !TACUtils::isCounter(tac))
+            {
+                mapValue(tac.result);
+                mapValue(tac.arg1);
+                mapValue(tac.arg2);
+            }
+            body.push_back(tac);
+        }
+        // labels may be jumped to before they are defined, so rename after collecting them
+        for (auto &tac : body)
+            TACUtils::rename(tac, values, labels);
+
+        // `ret v` becomes a copy to the call's destination and a jump past the body;
+        // a temp destination is assigned once, so several returns go through a variable
+        const string &dest = call.op;
+        bool fallsOff = body.empty() || body.back().result != "ret";
+        int returns = count_if(body.begin(), body.end(), [](const TAC &tac) { return tac.result == "ret"; });
+        bool needsExit = returns > 1 || (returns == 1 && fallsOff);
+        string holder = dest;
+        if (needsExit && TACUtils::isTemp(dest))
+            holder = freshVariable("ret", scope);
+        string exitLabel = needsExit ? parser.generateLabel() : "";
+        for (size_t i = 0; i < body.size(); i++)
+        {
+            if (body[i].result != "ret")
+            {
+                code.push_back(body[i]);
+                continue;
+            }
+            if (!holder.empty())
+                code.emplace_back(holder, "=", body[i].arg1);
+            else
+                TACUtils::dropDeadTemps(code, {body[i].arg1}); // the value is unused
+            if (i + 1 < body.size())
+                code.emplace_back("goto", " ", exitLabel);
+        }
+        if (fallsOff && !holder.empty())
+            code.emplace_back(holder, "=", "0");
+        if (needsExit)
+            code.emplace_back("label", "", exitLabel + ":");
+        if (holder != dest)
+            code.emplace_back(dest, "=", holder);
+
+        inlinedCount++;
+        inlinedCalls[call.arg1]++;
+    }
+
+    // Scalar locals the callee may read before writing them. Writes only count
+    // in the straight-line code before the first label or branch; arrays are
+    // cleared by their own `array` instruction.
+    vector<string> readBeforeWritten(const TACRegion &callee)
+    {
+        const vector<string> &params = callee.code.front().extras;
+        unordered_set<string> written(params.begin(), params.end()), arrays, seen;
+        vector<string> locals;
+        bool straight = true;
+        auto read = [&](const string &value)
+        {
+            if (TACUtils::isVariable(value) && !written.count(value) && seen.insert(value).second &&
+                symbolTable.symbolExists(value, callee.scope) != -1)
+                locals.push_back(value);
+        };
+        auto write = [&](const string &value)
+        {
+            if (straight)
+                written.insert(value);
+        };
+        for (const auto &tac : callee.code)
+        {
+            if (TACUtils::isMarker(tac) || TACUtils::isCounter(tac))
+                continue;
+            if (tac.op == "array")
+                arrays.insert(tac.result);
+            else if (tac.result == "label" || tac.result == "goto")
+                straight = false;
+            else if (tac.result == "if")
+            {
+                read(tac.arg1);
+                read(tac.arg2);
+                straight = false;
+            }
+            else if (tac.result == "print")
+                read(tac.op);
+            else if (tac.result == "input")
+                write(tac.op);
+            else if (tac.result == "call")
+            {
+                for (const auto &arg : tac.extras)
+                    read(arg);
+                write(tac.op);
+            }
+            else if (tac.result == "ret")
+                read(tac.arg1);
+            else if (tac.op == "[]=")
+            {
+                read(tac.arg1);
+                read(tac.arg2);
+            }
+            else
+            {
+                if (tac.op != "[]")
+                    read(tac.arg1);
+                read(tac.arg2);
+                write(tac.result);
+            }
+        }
+        locals.erase(remove_if(locals.begin(), locals.end(), [&](const string &local)
+                               { return arrays.count(local) > 0; }),
+                     locals.end());
+        return locals;
+    }
+
+};
+
+struct BasicBlock
+{
+    string label;     // leading label without ':', empty for fall-through only blocks
+    vector<TAC> code; // the label TAC, if any, is the first instruction
+    vector<int> succs;
+    vector<int> preds;
+};
+
+// Basic blocks of one region in layout order. Function markers stay inside the
+// first and last block so flatten() gives back a complete region.
+class ControlFlowGraph
+{
+public:
+    vector<BasicBlock> blocks;
+
+    ControlFlowGraph(const vector<TAC> &code)
+    {
+        for (const auto &tac : code)
+        {
+            bool startsBlock = blocks.empty() || tac.result == "label";
+            if (!blocks.empty() && !blocks.back().code.empty())
+            {
+                const string &last = blocks.back().code.back().result;
+                if (last == "goto" || last == "if" || last == "ret")
+                    startsBlock = true;
+            }
+            if (startsBlock && (blocks.empty() || !blocks.back().code.empty()))
+                blocks.push_back(BasicBlock());
+            if (tac.result == "label" && blocks.back().code.empty())
+                blocks.back().label = TACUtils::labelName(tac.arg1);
+            blocks.back().code.push_back(tac);
+        }
+        computeEdges();
+    }
+
+    void computeEdges()
+    {
+        labels.clear();
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            blocks[i].succs.clear();
+            blocks[i].preds.clear();
+            if (!blocks[i].label.empty())
+                labels[blocks[i].label] = i;
+        }
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            const TAC *last = blocks[i].code.empty() ? nullptr : &blocks[i].code.back();
+            bool fallsThrough = true;
+            if (last && last->result == "goto")
+            {
+                fallsThrough = false;
+                addEdge(i, last->arg1);
+            }
+            else if (last && last->result == "ret")
+            {
+                fallsThrough = false;
+            }
+            else if (last && last->result == "if")
+            {
+                addEdge(i, last->extras[0]);
+            }
+            if (fallsThrough && i + 1 < blocks.size())
+            {
+                blocks[i].succs.push_back(i + 1);
+                blocks[i + 1].preds.push_back(i);
+            }
+        }
+    }
+
+    vector<TAC> flatten() const
+    {
+        vector<TAC> code;
+        for (const auto &block : blocks)
+            code.insert(code.end(), block.code.begin(), block.code.end());
+        return code;
+    }
+
+    // by the labels as of the last computeEdges()
+    int findBlock(const string &label) const
+    {
+        auto it = labels.find(label);
+        return it == labels.end() ? -1 : it->second;
+    }
+
+private:
+    unordered_map<string, int> labels; // label -> block
+
+    void addEdge(int from, const string &target)
+    {
+        auto it = labels.find(TACUtils::labelName(target));
+        if (it == labels.end())
+            return;
+        blocks[from].succs.push_back(it->second);
+        blocks[it->second].preds.push_back(from);
+    }
+};
+
+// Vectorizes innermost counted loops over arrays for the native targets. A
+// loop qualifies when its body is one block that steps `i` by 1 under `i < n`
+// or `i <= n`, touches array elements only at [i], and otherwise computes
+// + - * of those elements and loop invariants, or sums `s = s +/- x`. A vector
+// loop doing `width` iterations at a time goes in front of it and the original
+// loop runs the last few. Vector values have the fixed names %v0 to %v5, which
+// the backends map onto xmm or ymm registers: invariants are broadcast and
+// sums accumulated lane by lane before the loop, and the lanes of a sum are
+// added up after it.
+class Vectorizer
+{
+public:
+    static const int registers = 6; // the backends keep two more for scratch
+
+    Vectorizer(Parser &parser, int width = 4) : parser(parser), width(width) {}
+
+    void run()
+    {
+        vector<TACRegion> regions = TACUtils::split(parser.tacList);
+        for (auto &region : regions)
+        {
+            // the edges stay those of the original loops, which is all vectorize() reads
+            ControlFlowGraph cfg(region.code);
+            vector<BasicBlock> blocks;
+            for (size_t h = 0; h < cfg.blocks.size(); h++)
+            {
+                vectorize(cfg, h, blocks); // new blocks go in front of the original loop
+                blocks.push_back(move(cfg.blocks[h]));
+            }
+            cfg.blocks = move(blocks);
+            region.code = cfg.flatten();
+        }
+        parser.tacList = TACUtils::join(regions);
+    }
+
+    int getVectorizedCount() const { return vectorizedCount; }
+
+private:
+    Parser &parser;
+    int width;
+    int vectorizedCount = 0;
+
+    struct Sum
+    {
+        string variable, op, accumulator;
+    };
+
+    bool vectorize(const ControlFlowGraph &cfg, int h, vector<BasicBlock> &out)
+    {
+        auto &blocks = cfg.blocks;
+        if (h == 0 || h + 1 >= (int)blocks.size() || blocks[h].label.empty())
+            return false;
+        const auto &header = blocks[h].code;
+        const auto &body = blocks[h + 1].code;
+        if (header.size() != 2 || header[1].result != "if" || blocks[h].preds.size() != 2)
+            return false;
+        if (!blocks[h + 1].label.empty() || blocks[h + 1].preds.size() != 1 || body.back().result != "goto" ||
+            TACUtils::labelName(body.back().arg1) != blocks[h].label)
+            return false;
+        const TAC &test = header[1];
+        string var = test.arg1, bound = test.arg2, op = parser.invertCondition(test.op);
+        if ((op != "<" && op != "<=") || !TACUtils::isVariable(var) || bound == var)
+            return false;
+        if (!TACUtils::isVariable(bound) && !(TACUtils::isLiteral(bound) && bound.size() < 10 && stoi(bound) >= width))
+            return false;
+
+        // the body ends with the step `t = i + 1; i = t`
+        int n = body.size() - 1;
+        if (n < 3)
+            return false;
+        const TAC &step = body[n - 2], &copy = body[n - 1];
+        if (step.op != "+" || step.arg1 != var || step.arg2 != "1" || !TACUtils::isTemp(step.result) ||
+            copy.result != var || copy.op != "=" || copy.arg1 != step.result || !copy.arg2.empty())
+            return false;
+        n -= 2;
+
+        // sums `t = s +/- x; s = t` where s appears nowhere else in the body
+        unordered_map<string, int> mentions;
+        for (int k = 0; k < n; k++)
+        {
+            for (const string *value : {&body[k].result, &body[k].arg1, &body[k].arg2})
+                mentions[*value]++;
+        }
+        map<int, Sum> sums; // at the instruction computing the new value
+        unordered_set<string> summed;
+        for (int k = 0; k + 1 < n; k++)
+        {
+            const TAC &tac = body[k], &next = body[k + 1];
+            string s = next.result;
+            if ((tac.op != "+" && tac.op != "-") || next.op != "=" || next.arg1 != tac.result || !next.arg2.empty())
+                continue;
+            if (!TACUtils::isVariable(s) || s == var || s == bound || mentions[s] != 2)
+                continue;
+            if (tac.arg1 == s || (tac.op == "+" && tac.arg2 == s))
+            {
+                sums[k] = Sum{s, tac.op, ""};
+                summed.insert(s);
+            }
+        }
+
+        // every other value is an element, arithmetic on vectors, or invariant
+        auto invariant = [&](const string &value)
+        {
+            return TACUtils::isLiteral(value) || (TACUtils::isVariable(value) && value != var && !summed.count(value));
+        };
+        unordered_set<string> vectors;
+        unordered_map<string, int> lastUse;
+        vector<string> splats;
+        auto use = [&](const string &value, int k, bool shift)
+        {
+            if (vectors.count(value))
+            {
+                lastUse[value] = k;
+                return true;
+            }
+            if (!invariant(value))
+                return false;
+            if (!shift && find(splats.begin(), splats.end(), value) == splats.end())
+                splats.push_back(value);
+            return true;
+        };
+        for (int k = 0; k < n; k++)
+        {
+            const TAC &tac = body[k];
+            if (sums.count(k))
+            {
+                const string &x = tac.arg1 == sums[k].variable ? tac.arg2 : tac.arg1;
+                if (!vectors.count(x))
+                    return false;
+                lastUse[x] = k;
+                k++;
+            }
+            else if (tac.op == "[]")
+            {
+                if (tac.arg2 != var || !TACUtils::isTemp(tac.result))
+                    return false;
+                vectors.insert(tac.result);
+            }
+            else if (tac.op == "[]=")
+            {
+                if (tac.arg1 != var || !use(tac.arg2, k, false))
+                    return false;
+            }
+            else if ((tac.op == "+" || tac.op == "-" || tac.op == "*") && TACUtils::isTemp(tac.result))
+            {
+                if (!vectors.count(tac.arg1) && !vectors.count(tac.arg2))
+                    return false;
+                for (const string *value : {&tac.arg1, &tac.arg2})
+                {
+                    bool shift = tac.op == "*" && vectors.count(tac.arg1) && value == &tac.arg2 && shiftFor(*value) > 0;
+                    if (!use(*value, k, shift))
+                        return false;
+                }
+                vectors.insert(tac.result);
+            }
+            else
+                return false;
+        }
+        int persistent = splats.size() + sums.size();
+        if (persistent > registers)
+            return false;
+
+        // invariants and sums keep their register for the whole loop; the
+        // other vectors get one from their definition to their last use
+        unordered_map<string, string> names;
+        vector<bool> busy(registers, false);
+        auto take = [&](const string &value)
+        {
+            for (int r = 0; r < registers; r++)
+            {
+                if (!busy[r])
+                {
+                    busy[r] = true;
+                    return names[value] = "%v" + to_string(r);
+                }
+            }
+            return string();
+        };
+        auto release = [&](const string &value, int k)
+        {
+            auto it = lastUse.find(value);
+            if (vectors.count(value) && (it == lastUse.end() || it->second == k))
+                busy[stoi(names[value].substr(2))] = false;
+        };
+        BasicBlock preheader;
+        for (const auto &value : splats)
+            preheader.code.emplace_back(take(" " + value), "vsplat", value);
+        for (auto &it : sums)
+        {
+            it.second.accumulator = take(" sum " + it.second.variable);
+            preheader.code.emplace_back(it.second.accumulator, "vsplat", "0");
+        }
+        auto name = [&](const string &value)
+        {
+            return vectors.count(value) ? names[value] : names[" " + value];
+        };
+
+        string vectorLabel = parser.generateLabel();
+        string exitLabel = parser.generateLabel();
+        BasicBlock guard;
+        guard.label = vectorLabel;
+        guard.code.emplace_back("label", "", vectorLabel + ":");
+        if (TACUtils::isLiteral(bound))
+            guard.code.emplace_back("if", test.op, var, to_string(stoi(bound) - (width - 1)), vector<string>{exitLabel});
+        else
+        {
+            string last = parser.generateTemp();
+            guard.code.emplace_back(last, "+", var, to_string(width - 1));
+            guard.code.emplace_back("if", test.op, last, bound, vector<string>{exitLabel});
+        }
+
+        BasicBlock loop;
+        for (int k = 0; k < n; k++)
+        {
+            const TAC &tac = body[k];
+            if (sums.count(k))
+            {
+                const Sum &sum = sums[k];
+                const string &x = tac.arg1 == sum.variable ? tac.arg2 : tac.arg1;
+                loop.code.emplace_back(sum.accumulator, "v+", sum.accumulator, names[x]);
+                release(x, k++);
+                continue;
+            }
+            if (tac.op == "[]=")
+            {
+                loop.code.emplace_back(tac.result, "vstore", var, name(tac.arg2));
+                release(tac.arg2, k);
+                continue;
+            }
+            string a = tac.op == "[]" ? tac.arg1 : name(tac.arg1);
+            string b = tac.op == "[]" ? var : name(tac.arg2);
+            string vop = tac.op == "[]" ? "vload" : "v" + tac.op;
+            if (tac.op == "*" && vectors.count(tac.arg1) && shiftFor(tac.arg2) > 0)
+            {
+                vop = "v<<";
+                b = to_string(shiftFor(tac.arg2));
+            }
+            release(tac.arg1, k);
+            release(tac.arg2, k);
+            string result = take(tac.result);
+            if (result.empty())
+                return false;
+            loop.code.emplace_back(result, vop, a, b);
+            release(tac.result, k); // never read
+        }
+        string next = parser.generateTemp();
+        loop.code.emplace_back(next, "+", var, to_string(width));
+        loop.code.emplace_back(var, "=", next);
+        loop.code.emplace_back("goto", " ", vectorLabel);
+
+        BasicBlock exit;
+        exit.label = exitLabel;
+        exit.code.emplace_back("label", "", exitLabel + ":");
+        for (const auto &it : sums)
+        {
+            string lanes = parser.generateTemp();
+            string total = parser.generateTemp();
+            exit.code.emplace_back(lanes, "vsum", it.second.accumulator);
+            exit.code.emplace_back(total, it.second.op, it.second.variable, lanes);
+            exit.code.emplace_back(it.second.variable, "=", total);
+        }
+        exit.code.emplace_back("%v", "vend");
+
+        out.insert(out.end(), {preheader, guard, loop, exit});
+        vectorizedCount++;
+        return true;
+    }
+
+    // k when multiplying by the literal 2^k, which a lane shift does
+    static int shiftFor(const string &value)
+    {
+        return InstructionSelector::powerOfTwo(value);
+    }
+};
+
+// Unrolls innermost loops with a single-block body and an induction variable
+// stepped by a constant. A compile-time trip count unrolls the loop completely;
+// otherwise the body is repeated `factor` times behind a guard that checks the
+// last of those iterations, and the original loop runs the remaining ones.
+class LoopUnroller
+{
+public:
+    LoopUnroller(Parser &parser, int budget = 32) : parser(parser), budget(budget) {}
+
+    void run()
+    {
+        vector<TACRegion> regions = TACUtils::split(parser.tacList);
+        for (auto &region : regions)
+        {
+            // one pass in layout order; the edges stay those of the original loops
+            ControlFlowGraph cfg(region.code);
+            vector<BasicBlock> blocks;
+            for (size_t h = 0; h < cfg.blocks.size(); h++)
+            {
+                if (unroll(cfg, h, blocks))
+                    h++; // a complete unroll replaced the header and dropped the body
+                else
+                    blocks.push_back(cfg.blocks[h]);
+            }
+            cfg.blocks = move(blocks);
+            region.code = cfg.flatten();
+        }
+        parser.tacList = TACUtils::join(regions);
+    }
+
+    int getUnrolledCount() const { return unrolledCount; }
+
+private:
+    Parser &parser;
+    int budget; // instructions an unrolled body may grow to
+    int unrolledCount = 0;
+
+    struct Loop
+    {
+        int header, body;
+        string var, bound, op, exitLabel;
+        int step;
+    };
+
+    // header: `L: if var op bound goto Lend`, then `body; goto L` as its only fall-through
+    bool match(ControlFlowGraph &cfg, int h, Loop &loop)
+    {
+        auto &blocks = cfg.blocks;
+        if (h + 1 >= (int)blocks.size() || blocks[h].label.empty())
+            return false;
+        const auto &header = blocks[h].code;
+        if (header.size() != 2 || header[1].result != "if")
+            return false;
+        const auto &body = blocks[h + 1].code;
+        if (!blocks[h + 1].label.empty() || blocks[h + 1].preds.size() != 1)
+            return false;
+        if (body.back().result != "goto" || TACUtils::labelName(body.back().arg1) != blocks[h].label)
+            return false;
+
+        loop.header = h;
+        loop.body = h + 1;
+        loop.exitLabel = header[1].extras[0];
+        loop.op = parser.invertCondition(header[1].op); // condition to stay in the loop
+        loop.var = header[1].arg1;
+        loop.bound = header[1].arg2;
+        if (!TACUtils::isVariable(loop.var) || (!TACUtils::isVariable(loop.bound) && !TACUtils::isLiteral(loop.bound)))
+            return false;
+
+        // the induction update `tk = var +/- c; var = tk` must be the only write to var,
+        // and the body must not write the bound
+        int writes = 0;
+        loop.step = 0;
+        for (size_t i = 0; i + 1 < body.size(); i++)
+        {
+            const TAC &tac = body[i];
+            if (TACUtils::isMarker(tac))
+                return false;
+            if ((tac.result == "input" || tac.result == "call") && (tac.op == loop.var || tac.op == loop.bound))
+                return false;
+            if (tac.result == loop.bound)
+                return false;
+            if (tac.result == loop.var)
+            {
+                writes++;
+                if (i == 0)
+                    return false;
+                const TAC &prev = body[i - 1];
+                if (tac.arg1 != prev.result || prev.arg1 != loop.var || !TACUtils::isLiteral(prev.arg2))
+                    return false;
+                if (prev.op == "+")
+                    loop.step = stoi(prev.arg2);
+                else if (prev.op == "-")
+                    loop.step = -stoi(prev.arg2);
+                else
+                    return false;
+            }
+        }
+        return writes == 1 && loop.step != 0;
+    }
+
+    int bodySize(const ControlFlowGraph &cfg, const Loop &loop)
+    {
+        return cfg.blocks[loop.body].code.size() - 1; // without the back edge
+    }
+
+    bool holds(int lhs, const string &op, int rhs)
+    {
+        if (op == "<")
+            return lhs < rhs;
+        if (op == "<=")
+            return lhs <= rhs;
+        if (op == ">")
+            return lhs > rhs;
+        if (op == ">=")
+            return lhs >= rhs;
+        if (op == "==")
+            return lhs == rhs;
+        return lhs != rhs;
+    }
+
+    // value of var on loop entry when the preceding block assigns it a literal
+    bool initialValue(const ControlFlowGraph &cfg, const Loop &loop, int &value)
+    {
+        if (loop.header == 0 || cfg.blocks[loop.header].preds.size() != 2)
+            return false;
+        const auto &code = cfg.blocks[loop.header - 1].code;
+        for (int i = code.size() - 1; i >= 0; i--)
+        {
+            const TAC &tac = code[i];
+            if (TACUtils::isCounter(tac))
+                continue;
+            if (tac.result == "goto" || tac.result == "if")
+                return false;
+            if (tac.result == loop.var || ((tac.result == "input" || tac.result == "call") && tac.op == loop.var))
+            {
+                if (tac.arg2.empty() && TACUtils::isLiteral(tac.arg1))
+                {
+                    value = stoi(tac.arg1);
+                    return true;
+                }
+                return false;
+            }
+        }
+        return false;
+    }
+
+    void appendBody(const ControlFlowGraph &cfg, const Loop &loop, vector<TAC> &code)
+    {
+        const auto &body = cfg.blocks[loop.body].code;
+        unordered_map<string, string> temps;
+        for (size_t i = 0; i + 1 < body.size(); i++)
+        {
+            TAC copy = body[i];
+            if (TACUtils::isTemp(copy.result))
+                temps[copy.result] = parser.generateTemp();
+            else if (copy.result == "call" && TACUtils::isTemp(copy.op))
+                temps[copy.op] = parser.generateTemp();
+            TACUtils::rename(copy, temps, {});
+            code.push_back(copy);
+        }
+    }
+
+    // appends the blocks replacing loop h to out; true when they also replace the loop itself
+    bool unroll(ControlFlowGraph &cfg, int h, vector<BasicBlock> &out)
+    {
+        Loop loop;
+        if (!match(cfg, h, loop))
+            return false;
+        int size = max(1, bodySize(cfg, loop));
+
+        int init;
+        if (TACUtils::isLiteral(loop.bound) && initialValue(cfg, loop, init))
+        {
+            int trips = 0;
+            int bound = stoi(loop.bound);
+            for (int v = init; holds(v, loop.op, bound) && trips * size <= 2 * budget; v += loop.step)
+                trips++;
+            if (trips * size <= 2 * budget)
+            {
+                // straight-line copies replace the header and body
+                vector<TAC> code;
+                for (int i = 0; i < trips; i++)
+                    appendBody(cfg, loop, code);
+                if (loop.body + 1 >= (int)cfg.blocks.size() || cfg.blocks[loop.body + 1].label != loop.exitLabel)
+                    code.emplace_back("goto", " ", loop.exitLabel);
+                out.emplace_back();
+                out.back().code = code;
+                unrolledCount++;
+                return true;
+            }
+        }
+
+        // guarding only the last of `factor` iterations needs a monotonic condition
+        bool increasing = loop.op == "<" || loop.op == "<=";
+        bool decreasing = loop.op == ">" || loop.op == ">=";
+        if (!((increasing && loop.step > 0) || (decreasing && loop.step < 0)))
+            return false;
+        int factor = min(8, budget / size);
+        if (factor < 2)
+            return false;
+
+        // the copies run while `var + distance op bound` holds, tested as
+        // `var op bound - distance` so the induction variable never wraps;
+        // the remainder runs in the original loop once the guard fails
+        long long distance = (long long)(factor - 1) * loop.step;
+        if (distance > INT_MAX || distance < -INT_MAX)
+            return false;
+        const string &header = cfg.blocks[h].label;
+        string labelGuard = parser.generateLabel();
+        string limit;
+        vector<BasicBlock> inserted(1);
+        BasicBlock &guard = inserted[0];
+        guard.label = labelGuard;
+        guard.code.emplace_back("label", "", labelGuard + ":");
+        string shift = distance > 0 ? "-" : "+";
+        if (TACUtils::isLiteral(loop.bound))
+        {
+            long long value = stoll(loop.bound) - distance;
+            if (value < INT_MIN || value > INT_MAX)
+                return false; // the copies could never run
+            if (value >= 0)
+                limit = to_string(value);
+            else
+            {
+                limit = parser.generateTemp();
+                guard.code.emplace_back(limit, "-", loop.bound, to_string(distance));
+            }
+        }
+        else
+        {
+            // a bound within `distance` of the int range sends every iteration to the original loop;
+            // temps have a single use, so the test computes the limit again
+            string wrapped = parser.generateTemp();
+            guard.code.emplace_back(wrapped, shift, loop.bound, to_string(llabs(distance)));
+            guard.code.emplace_back("if", distance > 0 ? ">" : "<", wrapped, loop.bound, vector<string>{header});
+            inserted.emplace_back();
+            limit = parser.generateTemp();
+            inserted.back().code.emplace_back(limit, shift, loop.bound, to_string(llabs(distance)));
+        }
+        inserted.back().code.emplace_back("if", parser.invertCondition(loop.op), loop.var, limit, vector<string>{header});
+
+        BasicBlock unrolled;
+        for (int i = 0; i < factor; i++)
+            appendBody(cfg, loop, unrolled.code);
+        unrolled.code.emplace_back("goto", " ", labelGuard);
+        inserted.push_back(unrolled);
+
+        out.insert(out.end(), inserted.begin(), inserted.end());
+        unrolledCount++;
+        return false;
+    }
+};
+
+// Rotates top-tested loops `L: hdr; if !c goto E; body; goto L` into a guarded
+// bottom-tested form `hdr; if !c goto E; Lb: body; hdr'; if c goto Lb`, so an
+// iteration takes a single conditional branch. `hdr` are the temps feeding the
+// condition and is duplicated with fresh temps at the bottom.
+class LoopRotation
+{
+public:
+    LoopRotation(Parser &parser) : parser(parser) {}
+
+    void run()
+    {
+        vector<TACRegion> regions = TACUtils::split(parser.tacList);
+        for (auto &region : regions)
+        {
+            ControlFlowGraph cfg(region.code);
+            for (size_t h = 0; h < cfg.blocks.size(); h++)
+                rotate(cfg, h);
+            region.code = cfg.flatten();
+        }
+        parser.tacList = TACUtils::join(regions);
+    }
+
+    int getRotatedCount() const { return rotatedCount; }
+
+private:
+    Parser &parser;
+    int rotatedCount = 0;
+
+    bool rotate(ControlFlowGraph &cfg, int h)
+    {
+        auto &blocks = cfg.blocks;
+        const string label = blocks[h].label;
+        const auto &header = blocks[h].code;
+        if (label.empty() || header.back().result != "if" || h + 1 >= (int)blocks.size())
+            return false;
+        for (size_t i = 1; i + 1 < header.size(); i++)
+        {
+            if (!TACUtils::isTemp(header[i].result))
+                return false;
+        }
+
+        // the back edge is the only jump to L from inside the loop
+        int latch = -1;
+        for (int pred : blocks[h].preds)
+        {
+            if (pred > h)
+            {
+                if (latch != -1)
+                    return false;
+                latch = pred;
+            }
+        }
+        if (latch == -1 || blocks[latch].code.back().result != "goto")
+            return false;
+        for (int b = h + 1; b <= latch; b++)
+        {
+            for (int pred : blocks[b].preds)
+            {
+                if (pred < h || pred > latch)
+                    return false; // entered from outside the loop
+            }
+        }
+
+        const TAC &test = header.back();
+        string exitLabel = test.extras[0];
+        int exit = -1;
+        for (int succ : blocks[h].succs)
+        {
+            if (blocks[succ].label == TACUtils::labelName(exitLabel))
+                exit = succ;
+        }
+
+        // body entry gets a label for the bottom test
+        string bodyLabel = blocks[h + 1].label;
+        if (bodyLabel.empty())
+        {
+            bodyLabel = parser.generateLabel();
+            blocks[h + 1].label = bodyLabel;
+            blocks[h + 1].code.insert(blocks[h + 1].code.begin(), TAC("label", "", bodyLabel + ":"));
+        }
+
+        vector<TAC> bottom;
+        unordered_map<string, string> temps;
+        for (size_t i = 1; i + 1 < header.size(); i++)
+        {
+            TAC copy = header[i];
+            temps[copy.result] = parser.generateTemp();
+            TACUtils::rename(copy, temps, {});
+            bottom.push_back(copy);
+        }
+        TAC backEdge = test;
+        TACUtils::rename(backEdge, temps, {});
+        backEdge.op = parser.invertCondition(test.op);
+        TACUtils::invertCounts(backEdge);
+        backEdge.extras[0] = bodyLabel;
+        bottom.push_back(backEdge);
+        if (latch + 1 >= (int)blocks.size() || blocks[latch + 1].label != TACUtils::labelName(exitLabel))
+            bottom.emplace_back("goto", " ", exitLabel);
+        else
+            exit = latch + 1;
+
+        blocks[latch].code.pop_back();
+        blocks[latch].code.insert(blocks[latch].code.end(), bottom.begin(), bottom.end());
+        // only the latch's edges change: the back edge now goes to the body and the loop is left from the bottom
+        auto &headerPreds = blocks[h].preds;
+        headerPreds.erase(find(headerPreds.begin(), headerPreds.end(), latch));
+        blocks[latch].succs = {h + 1};
+        blocks[h + 1].preds.push_back(latch);
+        if (exit != -1)
+        {
+            blocks[latch].succs.push_back(exit);
+            blocks[exit].preds.push_back(latch);
+        }
+
+        // L stays only while something outside the loop still jumps to it
+        bool referenced = false;
+        for (int pred : headerPreds)
+        {
+            const TAC &last = blocks[pred].code.back();
+            if (pred < h && ((last.result == "goto" && TACUtils::labelName(last.arg1) == label) || (last.result == "if" && TACUtils::labelName(last.extras[0]) == label)))
+                referenced = true;
+        }
+        if (!referenced)
+        {
+            blocks[h].code.erase(blocks[h].code.begin());
+            blocks[h].label = "";
+        }
+        rotatedCount++;
+        return true;
+    }
+};
+
+// Cleans up the jumps left behind by lowering and the loop passes: jumps are
+// threaded through blocks that only jump on, jumps to the next block and
+// unreferenced labels are dropped, a block reached only by a goto is moved up
+// behind its jump, and unreachable blocks are deleted.
+class CFGSimplifier
+{
+public:
+    CFGSimplifier(Parser &parser) : parser(parser) {}
+
+    void run()
+    {
+        vector<TACRegion> regions = TACUtils::split(parser.tacList);
+        for (auto &region : regions)
+        {
+            bool changed = true;
+            while (changed)
+            {
+                // rebuilding merges fall-through blocks whose label went away
+                ControlFlowGraph cfg(region.code);
+                changed = threadJumps(cfg) | removeJumpsToNext(cfg) | mergeChains(cfg) | removeUnreachable(cfg) | removeUnusedLabels(cfg);
+                region.code = cfg.flatten();
+            }
+        }
+        parser.tacList = TACUtils::join(regions);
+    }
+
+    int getRemovedJumps() const { return removedJumps; }
+
+private:
+    Parser &parser;
+    int removedJumps = 0;
+
+    static bool hasMarker(const BasicBlock &block)
+    {
+        return any_of(block.code.begin(), block.code.end(), TACUtils::isMarker);
+    }
+
+    static string *jumpTarget(BasicBlock &block)
+    {
+        if (block.code.empty())
+            return nullptr;
+        TAC &last = block.code.back();
+        if (last.result == "goto")
+            return &last.arg1;
+        if (last.result == "if")
+            return &last.extras[0];
+        return nullptr;
+    }
+
+    // final destination of a jump to `label`, skipping blocks that only jump on
+    string resolve(const ControlFlowGraph &cfg, string label)
+    {
+        for (size_t hops = 0; hops < cfg.blocks.size(); hops++)
+        {
+            int b = cfg.findBlock(label);
+            if (b == -1)
+                break;
+            const auto &code = cfg.blocks[b].code;
+            if (code.size() == 2 && code[1].result == "goto")
+                label = TACUtils::labelName(code[1].arg1);
+            else if (code.size() == 1 && b + 1 < (int)cfg.blocks.size() && !cfg.blocks[b + 1].label.empty())
+                label = cfg.blocks[b + 1].label; // empty block falls through
+            else
+                break;
+        }
+        return label;
+    }
+
+    bool threadJumps(ControlFlowGraph &cfg)
+    {
+        bool changed = false;
+        for (auto &block : cfg.blocks)
+        {
+            string *target = jumpTarget(block);
+            if (!target)
+                continue;
+            string resolved = resolve(cfg, TACUtils::labelName(*target));
+            if (resolved != TACUtils::labelName(*target))
+            {
+                *target = resolved;
+                changed = true;
+            }
+        }
+        if (changed)
+            cfg.computeEdges();
+        return changed;
+    }
+
+    bool removeJumpsToNext(ControlFlowGraph &cfg)
+    {
+        bool changed = false;
+        for (size_t b = 0; b + 1 < cfg.blocks.size(); b++)
+        {
+            string *target = jumpTarget(cfg.blocks[b]);
+            if (!target || TACUtils::labelName(*target) != cfg.blocks[b + 1].label)
+                continue;
+            auto &code = cfg.blocks[b].code;
+            TAC jump = code.back();
+            code.pop_back();
+            if (jump.result == "if")
+                TACUtils::dropDeadTemps(code, {jump.arg1, jump.arg2});
+            removedJumps++;
+            changed = true;
+        }
+        if (changed)
+            cfg.computeEdges();
+        return changed;
+    }
+
+    // `goto B` where B is reached from nowhere else and ends in a goto: move B up
+    bool mergeChains(ControlFlowGraph &cfg)
+    {
+        auto &blocks = cfg.blocks;
+        for (size_t a = 0; a < blocks.size(); a++)
+        {
+            if (blocks[a].code.empty() || blocks[a].code.back().result != "goto")
+                continue;
+            int b = cfg.findBlock(TACUtils::labelName(blocks[a].code.back().arg1));
+            if (b <= 0 || b == (int)a || blocks[b].preds.size() != 1 || hasMarker(blocks[b]))
+                continue;
+            if (blocks[b].code.back().result != "goto")
+                continue;
+
+            BasicBlock moved = blocks[b];
+            blocks[a].code.pop_back();
+            blocks[a].code.insert(blocks[a].code.end(), moved.code.begin() + 1, moved.code.end());
+            blocks.erase(blocks.begin() + b);
+            cfg.computeEdges();
+            removedJumps++;
+            return true;
+        }
+        return false;
+    }
+
+    bool removeUnreachable(ControlFlowGraph &cfg)
+    {
+        bool changed = false;
+        for (size_t b = cfg.blocks.size(); b-- > 1;)
+        {
+            BasicBlock &block = cfg.blocks[b];
+            if (!block.preds.empty() || block.code.empty())
+                continue;
+            if (hasMarker(block))
+            {
+                // the end-of-function marker has to stay
+                vector<TAC> markers;
+                copy_if(block.code.begin(), block.code.end(), back_inserter(markers), TACUtils::isMarker);
+                if (markers.size() == block.code.size())
+                    continue;
+                block.code = markers;
+                block.label = "";
+            }
+            else
+            {
+                cfg.blocks.erase(cfg.blocks.begin() + b);
+            }
+            changed = true;
+        }
+        if (changed)
+            cfg.computeEdges();
+        return changed;
+    }
+
+    bool removeUnusedLabels(ControlFlowGraph &cfg)
+    {
+        unordered_map<string, bool> referenced;
+        for (auto &block : cfg.blocks)
+        {
+            string *target = jumpTarget(block);
+            if (target)
+                referenced[TACUtils::labelName(*target)] = true;
+        }
+        bool changed = false;
+        for (auto &block : cfg.blocks)
+        {
+            if (!block.label.empty() && !referenced[block.label])
+            {
+                block.code.erase(block.code.begin());
+                block.label = "";
+                changed = true;
+            }
+        }
+        return changed;
+    }
+};
+
+// Orders each region's blocks by a profile. A chain follows the more often
+// taken way out of every block so that it falls through, and blocks no
+// profiled path reaches move to the end in their old order. A branch whose
+// hot way is the jump is inverted, and a goto is added wherever a block's
+// fall-through successor no longer comes next. The first and last block stay
+// in place because they hold the function markers.
+class BlockLayout
+{
+public:
+    BlockLayout(Parser &parser) : parser(parser) {}
+
+    void run()
+    {
+        vector<TACRegion> regions = TACUtils::split(parser.tacList);
+        for (auto &region : regions)
+            region.code = layout(region.code);
+        parser.tacList = TACUtils::join(regions);
+    }
+
+    int getInvertedBranches() const { return invertedBranches; }
+    int getColdBlocks() const { return coldBlocks; }
+
+private:
+    Parser &parser;
+    int invertedBranches = 0;
+    int coldBlocks = 0;
+
+    static int jumpTarget(const ControlFlowGraph &cfg, int b)
+    {
+        const TAC &last = cfg.blocks[b].code.back();
+        if (last.result == "goto")
+            return cfg.findBlock(TACUtils::labelName(last.arg1));
+        if (last.result == "if")
+            return cfg.findBlock(TACUtils::labelName(last.extras[0]));
+        return -1;
+    }
+    static int fallThrough(const ControlFlowGraph &cfg, int b)
+    {
+        const string &last = cfg.blocks[b].code.back().result;
+        if (last == "goto" || last == "ret" || b + 1 >= (int)cfg.blocks.size())
+            return -1;
+        return b + 1;
+    }
+
+    vector<TAC> layout(const vector<TAC> &code)
+    {
+        ControlFlowGraph cfg(code);
+        auto &blocks = cfg.blocks;
+        int n = blocks.size();
+        if (n < 4)
+            return code;
+
+        // hot: reachable from the entry without an edge the profile never saw taken
+        vector<bool> hot(n, false);
+        vector<int> work = {0};
+        hot[0] = true;
+        while (!work.empty())
+        {
+            int b = work.back();
+            work.pop_back();
+            const TAC &last = blocks[b].code.back();
+            bool profiled = last.result == "if" && last.hits >= 0;
+            int jump = jumpTarget(cfg, b), fall = fallThrough(cfg, b);
+            if (jump >= 0 && !hot[jump] && !(profiled && last.taken == 0))
+                hot[jump] = true, work.push_back(jump);
+            if (fall >= 0 && !hot[fall] && !(profiled && last.hits - last.taken == 0))
+                hot[fall] = true, work.push_back(fall);
+        }
+
+        vector<int> order = {0};
+        vector<bool> placed(n, false);
+        placed[0] = true;
+        int last = n - 1;
+        for (int b = 0;;)
+        {
+            const TAC &exit = blocks[b].code.back();
+            int next = fallThrough(cfg, b);
+            if (exit.result == "goto" || (exit.result == "if" && exit.hits >= 0 && exit.taken > exit.hits - exit.taken))
+                next = jumpTarget(cfg, b);
+            if (next < 0 || placed[next] || !hot[next] || next == last)
+            {
+                next = -1;
+                for (int c = 1; c < last && next < 0; c++)
+                {
+                    if (!placed[c] && hot[c])
+                        next = c;
+                }
+                if (next < 0)
+                    break;
+            }
+            order.push_back(next);
+            placed[next] = true;
+            b = next;
+        }
+        for (int b = 1; b < last; b++)
+        {
+            if (!placed[b])
+            {
+                order.push_back(b);
+                coldBlocks++;
+            }
+        }
+        order.push_back(last);
+
+        vector<int> position(n);
+        for (int i = 0; i < n; i++)
+            position[order[i]] = i;
+        auto follows = [&](int b, int c) { return position[b] + 1 < n && order[position[b] + 1] == c; };
+        // blocks that are no longer fallen into need a label to jump to
+        for (int b = 0; b < n; b++)
+        {
+            int fall = fallThrough(cfg, b);
+            if (fall >= 0 && !follows(b, fall) && blocks[fall].label.empty())
+            {
+                blocks[fall].label = parser.generateLabel();
+                blocks[fall].code.insert(blocks[fall].code.begin(), TAC("label", "", blocks[fall].label + ":"));
+            }
+        }
+
+        vector<TAC> laidOut;
+        for (int b : order)
+        {
+            vector<TAC> block = blocks[b].code;
+            int fall = fallThrough(cfg, b), jump = jumpTarget(cfg, b);
+            TAC &exit = block.back();
+            if (exit.result == "goto" && follows(b, jump))
+                block.pop_back();
+            else if (fall >= 0 && !follows(b, fall))
+            {
+                if (exit.result == "if" && follows(b, jump))
+                {
+                    exit.op = parser.invertCondition(exit.op);
+                    exit.extras[0] = blocks[fall].label;
+                    TACUtils::invertCounts(exit);
+                    invertedBranches++;
+                }
+                else
+                    block.emplace_back("goto", " ", blocks[fall].label);
+            }
+            laidOut.insert(laidOut.end(), block.begin(), block.end());
+        }
+        return laidOut;
+    }
+};
+
+enum BytecodeOp
+{
+    BC_MOV,   // a = b
+    BC_MOVI,  // a = imm b
+    BC_ADD,   // a = b + c
+    BC_ADDI,  // a = b + imm c
+    BC_SUB,   // a = b - c
+    BC_SUBI,  // a = b - imm c
+    BC_RSUBI, // a = imm b - c
+    BC_MUL,   // a = b * c
+    BC_MULI,  // a = b * imm c
+    BC_DIV,   // a = b / c
+    BC_DIVI,  // a = b / imm c
+    BC_RDIVI, // a = imm b / c
+    BC_JMP,   // goto a
+    BC_JLT,   // if b < c goto a
+    BC_JLE,
+    BC_JGT,
+    BC_JGE,
+    BC_JEQ,
+    BC_JNE,
+    BC_JLTI, // if b < imm c goto a
+    BC_JLEI,
+    BC_JGTI,
+    BC_JGEI,
+    BC_JEQI,
+    BC_JNEI,
+    BC_ADDI_JLT, // b = b + imm c; if b < d goto a
+    BC_ADDI_JLE, // b = b + imm c; if b <= d goto a
+    BC_PRINT,    // print a
+    BC_INPUT,    // input a
+    BC_CALL,     // call function a with c arguments starting at callArgs[b], result to d unless -1
+    BC_RET,      // return a, or 0 when a is -1
+    BC_ARRAY,    // clear the b registers from a
+    BC_LOAD,     // a = element r[c] of the d registers from b
+    BC_STORE,    // element r[b] of the d registers from a = c
+    BC_PROFILE,  // profile counter a += 1
+    BC_HALT,
+    BC_COUNT
+};
+
+struct BytecodeInstr
+{
+    const void *handler; // dispatch target, filled in by the VM
+    int op;
+    int a, b, c, d;
+};
+
+struct BytecodeFunction
+{
+    string name;
+    vector<BytecodeInstr> code;
+    int numRegisters = 0;
+    int numParams = 0;
+    vector<pair<bool, int>> callArgs; // (is register, register or literal)
+};
+
+struct BytecodeProgram
+{
+    vector<BytecodeFunction> functions; // functions[0] is main
+    vector<long long> counters;         // profile counters, sized by the caller
+};
+
+// Lowers the final TAC to register bytecode: every variable and temp of a
+// function gets a register, parameters first, and an array gets one register
+// per element. A temp written and copied to a variable right away is folded
+// into the producing instruction, and an induction step followed by its loop
+// test becomes one ADDI_Jcc.
+class BytecodeCompiler
+{
+public:
+    BytecodeProgram compile(const vector<TAC> &tacList)
+    {
+        vector<TACRegion> regions = TACUtils::split(tacList);
+        for (size_t i = 0; i < regions.size(); i++)
+            functionIndex[regions[i].scope] = i;
+        program.functions.resize(regions.size());
+        for (size_t i = 0; i < regions.size(); i++)
+            compileFunction(regions[i], program.functions[i]);
+        return program;
+    }
+
+    int getSuperinstructions() const { return superinstructions; }
+
+private:
+    BytecodeProgram program;
+    unordered_map<string, size_t> functionIndex;
+    unordered_map<string, int> registers;
+    unordered_map<string, int> uses;
+    unordered_map<string, int> arraySizes;
+    int superinstructions = 0;
+
+    int reg(BytecodeFunction &function, const string &name)
+    {
+        auto it = registers.find(name);
+        if (it != registers.end())
+            return it->second;
+        registers[name] = function.numRegisters;
+        return function.numRegisters++;
+    }
+
+    // register holding a value, loading a literal into a hidden one
+    int valueReg(BytecodeFunction &function, const string &value, const string &hidden)
+    {
+        if (!TACUtils::isLiteral(value))
+            return reg(function, value);
+        function.code.push_back(make(BC_MOVI, reg(function, hidden), stoi(value)));
+        return reg(function, hidden);
+    }
+
+    // first of the registers holding an array's elements
+    int arrayBase(BytecodeFunction &function, const string &name)
+    {
+        auto it = registers.find(name);
+        if (it != registers.end())
+            return it->second;
+        registers[name] = function.numRegisters;
+        function.numRegisters += arraySizes.at(name);
+        return registers[name];
+    }
+
+    BytecodeInstr make(int op, int a = 0, int b = 0, int c = 0, int d = 0)
+    {
+        return BytecodeInstr{nullptr, op, a, b, c, d};
+    }
+
+    static string mirror(const string &op)
+    {
+        return op == ">" ? "<" : op == "<" ? ">" : op == ">=" ? "<=" : op == "<=" ? ">=" : op;
+    }
+
+    static int branchOp(const string &op, bool immediate)
+    {
+        int base = op == "<" ? BC_JLT : op == "<=" ? BC_JLE : op == ">" ? BC_JGT : op == ">=" ? BC_JGE : op == "==" ? BC_JEQ : BC_JNE;
+        return immediate ? base + (BC_JLTI - BC_JLT) : base;
+    }
+
+    void countUses(const TAC &tac)
+    {
+        if (tac.result == "if")
+        {
+            uses[tac.arg1]++;
+            uses[tac.arg2]++;
+        }
+        else if (tac.result == "print" || tac.result == "input")
+            uses[tac.op]++;
+        else if (tac.result == "call")
+        {
+            for (const auto &arg : tac.extras)
+                uses[arg]++;
+        }
+        else if (!TACUtils::isMarker(tac) && tac.result != "label" && tac.result != "goto")
+        {
+            uses[tac.arg1]++;
+            uses[tac.arg2]++;
+        }
+    }
+
+    void compileArithmetic(BytecodeFunction &function, int dst, const TAC &tac)
+    {
+        const string &x = tac.arg1, &y = tac.arg2;
+        bool xImm = TACUtils::isLiteral(x), yImm = TACUtils::isLiteral(y);
+        if (xImm && yImm)
+        {
+            int a = stoi(x), b = stoi(y);
+            int value = tac.op == "+" ? a + b : tac.op == "-" ? a - b : tac.op == "*" ? a * b : (b == 0 ? 0 : a / b);
+            if (tac.op == "/" && b == 0)
+                function.code.push_back(make(BC_RDIVI, dst, a, reg(function, y)));
+            else
+                function.code.push_back(make(BC_MOVI, dst, value));
+            return;
+        }
+        int rr, ri, ir;
+        if (tac.op == "+")
+            rr = BC_ADD, ri = BC_ADDI, ir = BC_ADDI;
+        else if (tac.op == "-")
+            rr = BC_SUB, ri = BC_SUBI, ir = BC_RSUBI;
+        else if (tac.op == "*")
+            rr = BC_MUL, ri = BC_MULI, ir = BC_MULI;
+        else if (tac.op == "/")
+            rr = BC_DIV, ri = BC_DIVI, ir = BC_RDIVI;
+        else
+        {
+            cout << "Error: bytecode has no operator " << tac.op << endl;
+            exit(1);
+        }
+        if (yImm)
+            function.code.push_back(make(ri, dst, reg(function, x), stoi(y)));
+        else if (xImm && ir != BC_RSUBI && ir != BC_RDIVI)
+            function.code.push_back(make(ir, dst, reg(function, y), stoi(x))); // commutative
+        else if (xImm)
+            function.code.push_back(make(ir, dst, stoi(x), reg(function, y)));
+        else
+            function.code.push_back(make(rr, dst, reg(function, x), reg(function, y)));
+    }
+
+    void compileFunction(const TACRegion &region, BytecodeFunction &function)
+    {
+        function.name = region.scope;
+        registers.clear();
+        uses.clear();
+        arraySizes.clear();
+        unordered_map<string, int> labels;
+        vector<pair<int, string>> fixups; // instruction index, label
+
+        const vector<TAC> &code = region.code;
+        for (const auto &tac : code)
+        {
+            countUses(tac);
+            if (tac.op == "array")
+                arraySizes[tac.result] = stoi(tac.arg1);
+        }
+        if (!code.empty() && code.front().result == "function")
+        {
+            for (const auto &param : code.front().extras)
+                reg(function, param);
+            function.numParams = code.front().extras.size();
+        }
+
+        for (size_t i = 0; i < code.size(); i++)
+        {
+            const TAC &tac = code[i];
+            const TAC *next = i + 1 < code.size() ? &code[i + 1] : nullptr;
+            if (tac.result == "function")
+                continue;
+            if (tac.result == "return")
+            {
+                function.code.push_back(make(BC_RET, -1));
+            }
+            else if (tac.result == "ret")
+            {
+                if (TACUtils::isLiteral(tac.arg1))
+                {
+                    // the space keeps the hidden register apart from source names
+                    function.code.push_back(make(BC_MOVI, reg(function, " ret"), stoi(tac.arg1)));
+                    function.code.push_back(make(BC_RET, reg(function, " ret")));
+                }
+                else
+                    function.code.push_back(make(BC_RET, reg(function, tac.arg1)));
+            }
+            else if (TACUtils::isCounter(tac))
+            {
+                function.code.push_back(make(BC_PROFILE, stoi(tac.arg1)));
+            }
+            else if (tac.result == "label")
+            {
+                labels[TACUtils::labelName(tac.arg1)] = function.code.size();
+            }
+            else if (tac.result == "goto")
+            {
+                fixups.emplace_back(function.code.size(), TACUtils::labelName(tac.arg1));
+                function.code.push_back(make(BC_JMP));
+            }
+            else if (tac.result == "if")
+            {
+                string lhs = tac.arg1, rhs = tac.arg2, op = tac.op;
+                if (TACUtils::isLiteral(lhs) && TACUtils::isLiteral(rhs))
+                {
+                    int a = stoi(lhs), b = stoi(rhs);
+                    bool taken = op == ">" ? a > b : op == "<" ? a < b : op == ">=" ? a >= b : op == "<=" ? a <= b : op == "==" ? a == b : a != b;
+                    if (taken)
+                    {
+                        fixups.emplace_back(function.code.size(), TACUtils::labelName(tac.extras[0]));
+                        function.code.push_back(make(BC_JMP));
+                    }
+                    continue;
+                }
+                if (TACUtils::isLiteral(lhs))
+                {
+                    swap(lhs, rhs);
+                    op = mirror(op);
+                }
+                fixups.emplace_back(function.code.size(), TACUtils::labelName(tac.extras[0]));
+                bool immediate = TACUtils::isLiteral(rhs);
+                function.code.push_back(make(branchOp(op, immediate), 0, reg(function, lhs), immediate ? stoi(rhs) : reg(function, rhs)));
+            }
+            else if (tac.result == "print")
+            {
+                function.code.push_back(make(BC_PRINT, reg(function, tac.op)));
+            }
+            else if (tac.result == "input")
+            {
+                function.code.push_back(make(BC_INPUT, reg(function, tac.op)));
+            }
+            else if (tac.result == "call")
+            {
+                auto it = functionIndex.find(tac.arg1);
+                if (it == functionIndex.end())
+                {
+                    cout << "Error: function " << tac.arg1 << " has no body" << endl;
+                    exit(1);
+                }
+                int start = function.callArgs.size();
+                for (const auto &arg : tac.extras)
+                {
+                    if (TACUtils::isLiteral(arg))
+                        function.callArgs.emplace_back(false, stoi(arg));
+                    else
+                        function.callArgs.emplace_back(true, reg(function, arg));
+                }
+                int result = tac.op.empty() ? -1 : reg(function, tac.op);
+                function.code.push_back(make(BC_CALL, it->second, start, tac.extras.size(), result));
+            }
+            else if (tac.op == "array")
+            {
+                function.code.push_back(make(BC_ARRAY, arrayBase(function, tac.result), arraySizes[tac.result]));
+            }
+            else if (tac.op == "[]")
+            {
+                // literal indices were checked by the parser and address the register directly
+                int base = arrayBase(function, tac.arg1);
+                if (TACUtils::isLiteral(tac.arg2))
+                    function.code.push_back(make(BC_MOV, reg(function, tac.result), base + stoi(tac.arg2)));
+                else
+                    function.code.push_back(make(BC_LOAD, reg(function, tac.result), base, reg(function, tac.arg2), arraySizes[tac.arg1]));
             }
-            // cheking operators with two char
-            string tempCurr = "";
-            tempCurr += current;
-            tempCurr += src[pos + 1];
-
-            if (tempCurr == ">=")
+            else if (tac.op == "[]=")
             {
-                tokens.push_back(Token{T_GTE, ">=", this->lineNo});
-                pos += 2;
-                continue;
+                int base = arrayBase(function, tac.result);
+                if (TACUtils::isLiteral(tac.arg1) && TACUtils::isLiteral(tac.arg2))
+                    function.code.push_back(make(BC_MOVI, base + stoi(tac.arg1), stoi(tac.arg2)));
+                else if (TACUtils::isLiteral(tac.arg1))
+                    function.code.push_back(make(BC_MOV, base + stoi(tac.arg1), reg(function, tac.arg2)));
+                else
+                {
+                    int value = valueReg(function, tac.arg2, " element");
+                    function.code.push_back(make(BC_STORE, base, reg(function, tac.arg1), value, arraySizes[tac.result]));
+                }
             }
-            else if (tempCurr == "<=")
+            else if (tac.arg2.empty())
             {
-                tokens.push_back(Token{T_STE, "<=", this->lineNo});
-                pos += 2;
-                continue;
+                if (TACUtils::isLiteral(tac.arg1))
+                    function.code.push_back(make(BC_MOVI, reg(function, tac.result), stoi(tac.arg1)));
+                else
+                    function.code.push_back(make(BC_MOV, reg(function, tac.result), reg(function, tac.arg1)));
             }
-            else if (tempCurr == "==")
+            else
             {
-                tokens.push_back(Token{T_EQUALITY, "==", this->lineNo});
-                pos += 2;
-                continue;
+                // t = x op y; v = t  ->  v = x op y
+                if (TACUtils::isTemp(tac.result) && next && next->arg2.empty() && next->op == "=" && next->arg1 == tac.result && uses[tac.result] == 1)
+                {
+                    compileArithmetic(function, reg(function, next->result), tac);
+                    superinstructions++;
+                    i++;
+                    // v = v + c followed by `if v < n goto L` or `<=`
+                    const TAC *test = i + 1 < code.size() ? &code[i + 1] : nullptr;
+                    BytecodeInstr &last = function.code.back();
+                    if (last.op == BC_ADDI && last.a == last.b && test && test->result == "if" && test->arg1 == next->result && (test->op == "<" || test->op == "<=") && !TACUtils::isLiteral(test->arg2))
+                    {
+                        int bound = reg(function, test->arg2);
+                        last = make(test->op == "<" ? BC_ADDI_JLT : BC_ADDI_JLE, 0, last.a, last.c, bound);
+                        fixups.emplace_back(function.code.size() - 1, TACUtils::labelName(test->extras[0]));
+                        superinstructions++;
+                        i++;
+                    }
+                    continue;
+                }
+                compileArithmetic(function, reg(function, tac.result), tac);
             }
+        }
+        if (function.code.empty() || function.code.back().op != BC_RET)
+            function.code.push_back(region.scope == "main" ? make(BC_HALT) : make(BC_RET, -1));
 
-            switch (current)
+        for (const auto &fixup : fixups)
+        {
+            auto it = labels.find(fixup.second);
+            if (it == labels.end())
             {
-            case '=':
-                tokens.push_back(Token{T_ASSIGN, "=", this->lineNo});
-                break;
-            case '+':
-                tokens.push_back(Token{T_PLUS, "+", this->lineNo});
-                break;
-            case '-':
-                tokens.push_back(Token{T_MINUS, "-", this->lineNo});
-                break;
-            case '*':
-                tokens.push_back(Token{T_MUL, "*", this->lineNo});
-                break;
-            case '/':
-                tokens.push_back(Token{T_DIV, "/", this->lineNo});
-                break;
-            case '(':
-                tokens.push_back(Token{T_LPAREN, "(", this->lineNo});
-                break;
-            case ')':
-                tokens.push_back(Token{T_RPAREN, ")", this->lineNo});
-                break;
-            case '{':
-                tokens.push_back(Token{T_LBRACE, "{", this->lineNo});
-                break;
-            case '}':
-                tokens.push_back(Token{T_RBRACE, "}", this->lineNo});
-                break;
-            case ';':
-                tokens.push_back(Token{T_SEMICOLON, ";", this->lineNo});
-                break;
-            case '>':
-                tokens.push_back(Token{T_GT, ">", this->lineNo});
-                break;
-            case '<':
-                tokens.push_back(Token{T_ST, "<", this->lineNo});
-                break;
-            case ',':
-                tokens.push_back(Token{T_COMMA, "<", this->lineNo});
-                break;
-
-            default:
-                cout << "Unexpected character: " << current << endl;
+                cout << "Error: undefined label " << fixup.second << endl;
                 exit(1);
             }
-            pos++;
+            function.code[fixup.first].a = it->second;
         }
-        tokens.push_back(Token{T_EOF, "", this->lineNo});
-        return tokens;
     }
+};
 
-    string consumeNumber()
+// Runs bytecode with direct threading: each instruction carries the address of
+// its handler, so dispatch is one indirect jump (GCC/Clang computed goto, with
+// a switch loop elsewhere). Values are 32-bit like the MASM target.
+class VirtualMachine
+{
+public:
+    VirtualMachine(BytecodeProgram &program) : program(program) {}
+
+    void run()
     {
-        size_t start = pos;
-        while (pos < src.size() && isdigit(src[pos]))
-            pos++;
-        return src.substr(start, pos - start);
+        execute();
+        flush();
     }
 
-    string consumeWord()
+private:
+    BytecodeProgram &program;
+    string output;
+
+    struct Frame
     {
-        size_t start = pos;
-        while (pos < src.size() && isalnum(src[pos]))
+        const BytecodeFunction *function;
+        const BytecodeInstr *returnTo;
+        size_t base;
+        int result; // caller register receiving the returned value, -1 when unused
+    };
+
+    void flush()
+    {
+        fwrite(output.data(), 1, output.size(), stdout);
+        fflush(stdout);
+        output.clear();
+    }
+
+    void print(int32_t value)
+    {
+        output += to_string(value);
+        output += '\n';
+        if (output.size() > (1 << 16))
+            flush();
+    }
+
+    int32_t input()
+    {
+        flush(); // prompts written so far must be visible
+        long long value = 0;
+        if (!(cin >> value))
         {
-            char x = src[pos];
-            pos++;
+            cout << "Error: expected an integer on input" << endl;
+            exit(1);
         }
-        return src.substr(start, pos - start);
+        return (int32_t)value;
+    }
+
+    void divideByZero()
+    {
+        flush();
+        cout << "Error: division by zero" << endl;
+        exit(1);
+    }
+
+    // INT_MIN / -1 wraps to INT_MIN like the other operators instead of trapping
+    static int32_t divide(int32_t a, int32_t b)
+    {
+        if (b == -1)
+            return (int32_t)(0u - (uint32_t)a);
+        return a / b;
+    }
+
+    void outOfBounds(int32_t index, int size)
+    {
+        flush();
+        cout << "Error: index " << index << " is out of bounds for an array of " << size << endl;
+        exit(1);
+    }
+
+    void execute()
+    {
+#if defined(__GNUC__)
+        static const void *handlers[BC_COUNT] = {
+            &&op_BC_MOV, &&op_BC_MOVI, &&op_BC_ADD, &&op_BC_ADDI, &&op_BC_SUB, &&op_BC_SUBI, &&op_BC_RSUBI, &&op_BC_MUL, &&op_BC_MULI,
+            &&op_BC_DIV, &&op_BC_DIVI, &&op_BC_RDIVI, &&op_BC_JMP, &&op_BC_JLT, &&op_BC_JLE, &&op_BC_JGT, &&op_BC_JGE, &&op_BC_JEQ,
+            &&op_BC_JNE, &&op_BC_JLTI, &&op_BC_JLEI, &&op_BC_JGTI, &&op_BC_JGEI, &&op_BC_JEQI, &&op_BC_JNEI, &&op_BC_ADDI_JLT,
+            &&op_BC_ADDI_JLE, &&op_BC_PRINT, &&op_BC_INPUT, &&op_BC_CALL, &&op_BC_RET,
+            &&op_BC_ARRAY, &&op_BC_LOAD, &&op_BC_STORE, &&op_BC_PROFILE, &&op_BC_HALT};
+        for (auto &function : program.functions)
+        {
+            for (auto &ins : function.code)
+                ins.handler = handlers[ins.op];
+        }
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() goto *pc->handler
+#else
+#define VM_CASE(name) case name:
+#define VM_NEXT() goto dispatch
+#endif
+        vector<int32_t> stack(max<size_t>(1 << 16, 2 * program.functions[0].numRegisters));
+        vector<Frame> frames;
+        const BytecodeFunction *function = &program.functions[0];
+        size_t base = 0;
+        int32_t *r = stack.data();
+        const BytecodeInstr *code = function->code.data();
+        const BytecodeInstr *pc = code;
+
+#if defined(__GNUC__)
+        VM_NEXT();
+#else
+    dispatch:
+        switch (pc->op)
+        {
+#endif
+        VM_CASE(BC_MOV)
+        {
+            r[pc->a] = r[pc->b];
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_MOVI)
+        {
+            r[pc->a] = pc->b;
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_ADD)
+        {
+            r[pc->a] = (int32_t)((uint32_t)r[pc->b] + (uint32_t)r[pc->c]);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_ADDI)
+        {
+            r[pc->a] = (int32_t)((uint32_t)r[pc->b] + (uint32_t)pc->c);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_SUB)
+        {
+            r[pc->a] = (int32_t)((uint32_t)r[pc->b] - (uint32_t)r[pc->c]);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_SUBI)
+        {
+            r[pc->a] = (int32_t)((uint32_t)r[pc->b] - (uint32_t)pc->c);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_RSUBI)
+        {
+            r[pc->a] = (int32_t)((uint32_t)pc->b - (uint32_t)r[pc->c]);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_MUL)
+        {
+            r[pc->a] = (int32_t)((uint32_t)r[pc->b] * (uint32_t)r[pc->c]);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_MULI)
+        {
+            r[pc->a] = (int32_t)((uint32_t)r[pc->b] * (uint32_t)pc->c);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_DIV)
+        {
+            if (r[pc->c] == 0)
+                divideByZero();
+            r[pc->a] = divide(r[pc->b], r[pc->c]);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_DIVI)
+        {
+            if (pc->c == 0)
+                divideByZero();
+            r[pc->a] = divide(r[pc->b], pc->c);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_RDIVI)
+        {
+            if (r[pc->c] == 0)
+                divideByZero();
+            r[pc->a] = divide(pc->b, r[pc->c]);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_JMP)
+        {
+            pc = code + pc->a;
+            VM_NEXT();
+        }
+#define VM_BRANCH(name, cmp, rhs)                     \
+    VM_CASE(name)                                     \
+    {                                                 \
+        pc = r[pc->b] cmp(rhs) ? code + pc->a : pc + 1; \
+        VM_NEXT();                                    \
+    }
+        VM_BRANCH(BC_JLT, <, r[pc->c])
+        VM_BRANCH(BC_JLE, <=, r[pc->c])
+        VM_BRANCH(BC_JGT, >, r[pc->c])
+        VM_BRANCH(BC_JGE, >=, r[pc->c])
+        VM_BRANCH(BC_JEQ, ==, r[pc->c])
+        VM_BRANCH(BC_JNE, !=, r[pc->c])
+        VM_BRANCH(BC_JLTI, <, pc->c)
+        VM_BRANCH(BC_JLEI, <=, pc->c)
+        VM_BRANCH(BC_JGTI, >, pc->c)
+        VM_BRANCH(BC_JGEI, >=, pc->c)
+        VM_BRANCH(BC_JEQI, ==, pc->c)
+        VM_BRANCH(BC_JNEI, !=, pc->c)
+#undef VM_BRANCH
+        VM_CASE(BC_ADDI_JLT)
+        {
+            r[pc->b] = (int32_t)((uint32_t)r[pc->b] + (uint32_t)pc->c);
+            pc = r[pc->b] < r[pc->d] ? code + pc->a : pc + 1;
+            VM_NEXT();
+        }
+        VM_CASE(BC_ADDI_JLE)
+        {
+            r[pc->b] = (int32_t)((uint32_t)r[pc->b] + (uint32_t)pc->c);
+            pc = r[pc->b] <= r[pc->d] ? code + pc->a : pc + 1;
+            VM_NEXT();
+        }
+        VM_CASE(BC_PRINT)
+        {
+            print(r[pc->a]);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_INPUT)
+        {
+            r[pc->a] = input();
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_CALL)
+        {
+            const BytecodeFunction *callee = &program.functions[pc->a];
+            size_t calleeBase = base + function->numRegisters;
+            if (frames.size() > 100000)
+            {
+                flush();
+                cout << "Error: call stack overflow in " << callee->name << endl;
+                exit(1);
+            }
+            if (calleeBase + callee->numRegisters > stack.size())
+            {
+                stack.resize(max(stack.size() * 2, calleeBase + callee->numRegisters));
+                r = stack.data() + base;
+            }
+            int32_t *args = r + function->numRegisters;
+            for (int i = 0; i < pc->c; i++)
+            {
+                const auto &arg = function->callArgs[pc->b + i];
+                args[i] = arg.first ? r[arg.second] : arg.second;
+            }
+            fill(args + pc->c, args + callee->numRegisters, 0);
+            frames.push_back(Frame{function, pc + 1, base, pc->d});
+            function = callee;
+            base = calleeBase;
+            r = stack.data() + base;
+            code = function->code.data();
+            pc = code;
+            VM_NEXT();
+        }
+        VM_CASE(BC_RET)
+        {
+            if (frames.empty())
+                return;
+            int32_t value = pc->a < 0 ? 0 : r[pc->a];
+            Frame frame = frames.back();
+            frames.pop_back();
+            function = frame.function;
+            base = frame.base;
+            r = stack.data() + base;
+            if (frame.result >= 0)
+                r[frame.result] = value;
+            code = function->code.data();
+            pc = frame.returnTo;
+            VM_NEXT();
+        }
+        VM_CASE(BC_ARRAY)
+        {
+            fill(r + pc->a, r + pc->a + pc->b, 0);
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_LOAD)
+        {
+            int32_t index = r[pc->c];
+            if ((uint32_t)index >= (uint32_t)pc->d)
+                outOfBounds(index, pc->d);
+            r[pc->a] = r[pc->b + index];
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_STORE)
+        {
+            int32_t index = r[pc->b];
+            if ((uint32_t)index >= (uint32_t)pc->d)
+                outOfBounds(index, pc->d);
+            r[pc->a + index] = r[pc->c];
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_PROFILE)
+        {
+            program.counters[pc->a]++;
+            pc++;
+            VM_NEXT();
+        }
+        VM_CASE(BC_HALT)
+        {
+            return;
+        }
+#if !defined(__GNUC__)
+        }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+    }
+};
+
+// Minimal x86-64 encoder for the instructions the JIT needs. Values are 32-bit
+// (like the MASM target), locals are addressed as [rbp + disp32].
+class X64Encoder
+{
+public:
+    enum Reg
+    {
+        EAX = 0,
+        ECX = 1,
+        EDX = 2,
+        ESI = 6,
+        EDI = 7
+    };
+    // SSE2 packed integer opcodes, all behind the 66 0F prefix
+    enum Packed
+    {
+        MOVDQA = 0x6F,
+        PUNPCKLDQ = 0x62,
+        PXOR = 0xEF,
+        PSUBD = 0xFA,
+        PADDD = 0xFE,
+        PMULUDQ = 0xF4
+    };
+    enum Condition
+    {
+        CC_B = 0x82,
+        CC_E = 0x84,
+        CC_NE = 0x85,
+        CC_L = 0x8C,
+        CC_GE = 0x8D,
+        CC_LE = 0x8E,
+        CC_G = 0x8F
+    };
+
+    vector<uint8_t> code;
+
+    size_t size() const { return code.size(); }
+    void byte(uint8_t b) { code.push_back(b); }
+    void imm32(int32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            byte((uint32_t)value >> (8 * i));
+    }
+    void imm64(uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+            byte(value >> (8 * i));
+    }
+    // opcode with a [rbp + disp32] memory operand
+    void rbpOperand(uint8_t opcode, int reg, int32_t disp)
+    {
+        byte(opcode);
+        byte(0x80 | (reg << 3) | 5);
+        imm32(disp);
+    }
+
+    void pushRbp() { byte(0x55); }
+    void movRbpRsp()
+    {
+        byte(0x48), byte(0x89), byte(0xE5);
+    }
+    void subRsp(int32_t value)
+    {
+        byte(0x48), byte(0x81), byte(0xEC), imm32(value);
+    }
+    void leave() { byte(0xC9); }
+    void ret() { byte(0xC3); }
+
+    void load(Reg reg, int32_t disp) { rbpOperand(0x8B, reg, disp); }
+    void store(int32_t disp, Reg reg) { rbpOperand(0x89, reg, disp); }
+    void storeImm(int32_t disp, int32_t value)
+    {
+        rbpOperand(0xC7, 0, disp);
+        imm32(value);
+    }
+    // opcode with a [rbp + index*4 + disp32] memory operand
+    void indexedOperand(uint8_t opcode, int reg, Reg index, int32_t disp)
+    {
+        byte(opcode);
+        byte(0x84 | (reg << 3));
+        byte(0x80 | (index << 3) | 5);
+        imm32(disp);
+    }
+    void loadIndexed(Reg reg, Reg index, int32_t disp) { indexedOperand(0x8B, reg, index, disp); }
+    void storeIndexed(int32_t disp, Reg index, Reg reg) { indexedOperand(0x89, reg, index, disp); }
+    void repStosd()
+    {
+        byte(0xF3), byte(0xAB);
+    }
+    // prefix 0F opcode with two registers; xmm0-7 need no REX
+    void sse(uint8_t prefix, uint8_t opcode, int reg, int rm)
+    {
+        byte(prefix), byte(0x0F), byte(opcode), byte(0xC0 | (reg << 3) | rm);
+    }
+    void packed(Packed op, int dst, int src) { sse(0x66, op, dst, src); }
+    void movdToXmm(int xmm, Reg reg) { sse(0x66, 0x6E, xmm, reg); }
+    void movdFromXmm(Reg reg, int xmm) { sse(0x66, 0x7E, xmm, reg); }
+    void pshufd(int dst, int src, uint8_t order)
+    {
+        sse(0x66, 0x70, dst, src);
+        byte(order);
+    }
+    void pslld(int xmm, uint8_t count)
+    {
+        sse(0x66, 0x72, 6, xmm);
+        byte(count);
+    }
+    // movdqu between an xmm register and [rbp + index*4 + disp32]
+    void loadPacked(int xmm, Reg index, int32_t disp)
+    {
+        byte(0xF3), byte(0x0F);
+        indexedOperand(0x6F, xmm, index, disp);
+    }
+    void storePacked(int32_t disp, Reg index, int xmm)
+    {
+        byte(0xF3), byte(0x0F);
+        indexedOperand(0x7F, xmm, index, disp);
+    }
+    void movImm(Reg reg, int32_t value)
+    {
+        byte(0xB8 + reg);
+        imm32(value);
+    }
+    void movReg(Reg dst, Reg src)
+    {
+        byte(0x89), byte(0xC0 | (src << 3) | dst);
+    }
+    void addMem(Reg reg, int32_t disp) { rbpOperand(0x03, reg, disp); }
+    void subMem(Reg reg, int32_t disp) { rbpOperand(0x2B, reg, disp); }
+    void cmpMem(Reg reg, int32_t disp) { rbpOperand(0x3B, reg, disp); }
+    void imulMem(Reg reg, int32_t disp)
+    {
+        byte(0x0F);
+        rbpOperand(0xAF, reg, disp);
+    }
+    // group 1 ALU with an immediate: /0 add, /5 sub, /7 cmp
+    void aluImm(int ext, Reg reg, int32_t value)
+    {
+        byte(0x81), byte(0xC0 | (ext << 3) | reg), imm32(value);
+    }
+    void imulImm(Reg reg, int32_t value)
+    {
+        byte(0x69), byte(0xC0 | (reg << 3) | reg), imm32(value);
+    }
+    void cdq() { byte(0x99); }
+    void neg(Reg reg)
+    {
+        byte(0xF7), byte(0xC0 | (3 << 3) | reg);
+    }
+    void idiv(Reg reg)
+    {
+        byte(0xF7), byte(0xC0 | (7 << 3) | reg);
+    }
+    void test(Reg reg)
+    {
+        byte(0x85), byte(0xC0 | (reg << 3) | reg);
+    }
+    void leaRdi(int32_t disp)
+    {
+        byte(0x48);
+        rbpOperand(0x8D, EDI, disp);
+    }
+    // mov eax, [rdi + disp32]
+    void loadArg(Reg reg, int32_t disp)
+    {
+        byte(0x8B), byte(0x80 | (reg << 3) | 7), imm32(disp);
+    }
+    // inc QWORD PTR [target] through rax
+    void incAbsolute(const void *target)
+    {
+        byte(0x48), byte(0xB8), imm64((uint64_t)target); // mov rax, imm64
+        byte(0x48), byte(0xFF), byte(0x00);              // inc QWORD PTR [rax]
+    }
+    void callAbsolute(const void *target)
+    {
+        byte(0x48), byte(0xB8), imm64((uint64_t)target); // mov rax, imm64
+        byte(0xFF), byte(0xD0);                          // call rax
+    }
+    // rel32 jumps and calls return the offset of their displacement for patching
+    size_t jmp()
+    {
+        byte(0xE9);
+        imm32(0);
+        return size() - 4;
     }
-};
-
-class Parser
-{
-
-public:
-    Parser(const vector<Token> &tokens, SymbolTable &symbolTable) : symbolTable(symbolTable)
+    size_t jcc(Condition cc)
     {
-        this->tokens = tokens;
-        this->pos = 0;
-        // this->symbolTable = symbolTable;
-        tokenMap[T_INT] = "int";
-        tokenMap[T_ID] = "identifier";
-        tokenMap[T_NUM] = "number";
-        tokenMap[T_IF] = "if";
-        tokenMap[T_ELSE] = "else";
-        tokenMap[T_RETURN] = "return";
-        tokenMap[T_ASSIGN] = "=";    // Assignment operator
-        tokenMap[T_PLUS] = "+";      // Addition operator
-        tokenMap[T_MINUS] = "-";     // Subtraction operator
-        tokenMap[T_MUL] = "*";       // Multiplication operator
-        tokenMap[T_DIV] = "/";       // Division operator
-        tokenMap[T_LPAREN] = "(";    // Left parenthesis
-        tokenMap[T_RPAREN] = ")";    // Right parenthesis
-        tokenMap[T_LBRACE] = "{";    // Left brace
-        tokenMap[T_RBRACE] = "}";    // Right brace
-        tokenMap[T_SEMICOLON] = ";"; // Semicolon
-        tokenMap[T_GT] = ">";        // Greater-than operator
-        tokenMap[T_ST] = "<";
-        tokenMap[T_GTE] = ">=";
-        tokenMap[T_EQUALITY] = "==";
-        tokenMap[T_STE] = "<=";
-        tokenMap[T_EOF] = "end of file";
-        tokenMap[T_FOR] = "for";
-        tokenMap[T_WHILE] = "while";
-        tokenMap[T_PRINT] = "print";
-        tokenMap[T_INPUT] = "input";
-        tokenMap[T_DEF] = "def";
-        tokenMap[T_CALL] = "call";
+        byte(0x0F), byte(cc);
+        imm32(0);
+        return size() - 4;
     }
-
-    shared_ptr<ASTNode> parseProgram()
+    size_t call()
     {
-        shared_ptr<ASTNode> node;
-        // while (tokens[pos].type != T_EOF)
-        // {
-        //     node = parseStatement();
-        // }
-        node = parseBlock();
-        cout << "Parsing completed successfully! No Syntax Error" << endl;
-        return node;
+        byte(0xE8);
+        imm32(0);
+        return size() - 4;
     }
+    void patch(size_t at, size_t target)
+    {
+        int32_t rel = (int32_t)(target - (at + 4));
+        for (int i = 0; i < 4; i++)
+            code[at + i] = (uint32_t)rel >> (8 * i);
+    }
+};
 
-    std::vector<TAC> tacList;
-    int tempCounter = 0;
-    int labelCounter = 0;
-
-    std::string generateTemp()
+// Host side of print/input for JIT-compiled code.
+struct JitRuntime
+{
+    static string &output()
     {
-        return "t" + std::to_string(tempCounter++);
+        static string buffer;
+        return buffer;
     }
-    std::string generateLabel()
+    static void flush()
     {
-        return "L" + std::to_string(labelCounter++);
+        fwrite(output().data(), 1, output().size(), stdout);
+        fflush(stdout);
+        output().clear();
     }
-    TAC generateConditionTAC(const std::shared_ptr<ASTNode> &node)
+    static void print(int32_t value)
     {
-        // Ensure the node has at least 3 children: left operand, operator, and right operand
-        if (node->children.size() < 2)
-        {
-            throw std::runtime_error("Invalid condition node structure");
-        }
-
-        // Generate TAC for the condition
-        string temp = generateTemp();
-
-        std::string lhs = node->children[0]->value; // Left-hand side operand
-        std::string op = node->value;               // Operator stored in the node itself
-        std::string rhs = node->children[1]->value; // Right-hand side operand
-
-        return TAC(temp, op, lhs, rhs);
+        output() += to_string(value);
+        output() += '\n';
+        if (output().size() > (1 << 16))
+            flush();
     }
-    std::string generateTAC(const std::shared_ptr<ASTNode> &node)
+    static int32_t input()
     {
-        if (!node)
-            return "";
-
-        if (node->value == "print")
-        {
-            std::string exprResult = generateTAC(node->children[0]);
-            tacList.emplace_back("print", exprResult, "(", ")"); // op is expRes
-            return "";
-        }
-        else if (node->value == "input")
+        flush();
+        long long value = 0;
+        if (!(cin >> value))
         {
-            std::string exprResult = generateTAC(node->children[0]);
-            tacList.emplace_back("input", exprResult, "(", ")"); // op is expRes
-            return "";
+            cout << "Error: expected an integer on input" << endl;
+            exit(1);
         }
-        else if (node->value == "function")
-        {
+        return (int32_t)value;
+    }
+    static void divideByZero()
+    {
+        flush();
+        cout << "Error: division by zero" << endl;
+        exit(1);
+    }
+    static void outOfBounds(int32_t index, int32_t size)
+    {
+        flush();
+        cout << "Error: index " << index << " is out of bounds for an array of " << size << endl;
+        exit(1);
+    }
+};
 
-            auto funcName = node->children[0];                  // first child is name
-            int numberOfParam = stoi(node->children[2]->value); // third child is no of param
-            vector<string> params;
-            for (int i = 0; i < numberOfParam; i++)
-            {
-                params.push_back(node->children[3 + i]->value);
-            }
-            tacList.emplace_back("function", "", funcName->value, to_string(numberOfParam), params);
+// Lowers every region to x86-64. Each function is `int32_t f(int32_t *args)`:
+// the prologue copies the arguments into parameter slots, every variable and
+// temp has a 4-byte slot below rbp, an array has one slot per element, and
+// calls pass a pointer to an argument area at the bottom of the caller's frame.
+class X64Lowering
+{
+public:
+    X64Encoder encoder;
+    unordered_map<string, size_t> entries; // function name -> code offset
+    long long *counters = nullptr;         // profile counters the JIT increments in place
 
-            generateTAC(node->children[1]); // second child is code
-            tacList.emplace_back("return", "", funcName->value);
+    virtual ~X64Lowering() = default;
 
-            return "";
+    void lower(const vector<TAC> &tacList)
+    {
+        PhaseTimer timer("codegen");
+        vector<TACRegion> regions = TACUtils::split(tacList);
+        for (const auto &region : regions)
+        {
+            PhaseTimer timer("function codegen", region.scope);
+            lowerFunction(region);
         }
-        else if (node->value == "call")
+        for (const auto &call : calls)
         {
-
-            auto funcName = node->children[0];                  // first child is name
-            int numberOfParam = stoi(node->children[1]->value); // second child is no of param
-            vector<string> params;
-            for (int i = 0; i < numberOfParam; i++)
+            auto it = entries.find(call.second);
+            if (it == entries.end())
             {
-                params.push_back(node->children[2 + i]->value);
+                cout << "Error: function " << call.second << " has no body" << endl;
+                exit(1);
             }
-            tacList.emplace_back("call", "", funcName->value, to_string(numberOfParam), params);
-            return "";
+            encoder.patch(call.first, it->second);
         }
-        else if (node->value == "for")
-        {
-            std::string labelLoop = generateLabel();
-            std::string labelBody = generateLabel();
-            std::string labelEnd = generateLabel();
-
-            // first child initializaion
-            auto initialization = generateTAC(node->children[0]);
-            // tacList.emplace_back(initialization);
-
-            // Condition is the second child
-            tacList.emplace_back("label", "", labelLoop + ":");
-
-            auto condition = generateConditionTAC(node->children[1]);
-            tacList.emplace_back(condition);
-
-            // inc dec is the third child
-
-            tacList.emplace_back("if", condition.op, " goto ", labelBody);
-
-            tacList.emplace_back("goto", " ", labelEnd); // Jump over the 'if' block
-
-            tacList.emplace_back("label", "", labelBody + ":");
-            generateTAC(node->children[3]);
-            generateTAC(node->children[2]);
-            tacList.emplace_back("goto", " ", labelLoop); // Jump over the 'if' block
+    }
 
-            // Generate TAC for the 'if' block (second child)
-            tacList.emplace_back("label", "", labelEnd + ":");
+protected:
+    vector<pair<size_t, string>> calls; // rel32 offset, callee
 
-            // End label
-            // tacList.emplace_back("label", "", labelEnd + ":");
-            return "";
-        }
-        else if (node->value == "while")
-        {
-            std::string labelLoop = generateLabel();
-            std::string labelBody = generateLabel();
-            std::string labelEnd = generateLabel();
+    // helpers are called through an absolute address; the object writer relocates them instead
+    virtual void callHelper(const string &name)
+    {
+        if (name == "print")
+            encoder.callAbsolute((const void *)&JitRuntime::print);
+        else if (name == "input")
+            encoder.callAbsolute((const void *)&JitRuntime::input);
+        else if (name == "outOfBounds")
+            encoder.callAbsolute((const void *)&JitRuntime::outOfBounds);
+        else
+            encoder.callAbsolute((const void *)&JitRuntime::divideByZero);
+    }
 
-            // Condition is the first child
-            tacList.emplace_back("label", "", labelLoop + ":");
+private:
+    unordered_map<string, int32_t> slots;
+    unordered_map<string, int32_t> arrays; // name -> slot of element 0
+    unordered_map<string, int32_t> sizes;  // name -> element count
+    int32_t words = 0;
 
-            auto condition = generateConditionTAC(node->children[0]);
-            tacList.emplace_back(condition);
+    int32_t slot(const string &name)
+    {
+        auto it = slots.find(name);
+        if (it != slots.end())
+            return it->second;
+        int32_t disp = -4 * ++words;
+        slots[name] = disp;
+        return disp;
+    }
 
-            tacList.emplace_back("if", condition.op, " goto ", labelBody);
+    // element address: a literal index folds into the displacement, otherwise it is
+    // checked against the size like the VM does and left in ecx
+    int32_t element(const string &array, const string &index)
+    {
+        if (TACUtils::isLiteral(index))
+            return arrays.at(array) + 4 * stoi(index);
+        encoder.load(X64Encoder::ECX, slot(index));
+        int32_t size = sizes.at(array);
+        encoder.aluImm(7, X64Encoder::ECX, size);
+        size_t inBounds = encoder.jcc(X64Encoder::CC_B); // unsigned, so negative indices fail too
+        encoder.movReg(X64Encoder::EDI, X64Encoder::ECX);
+        encoder.movImm(X64Encoder::ESI, size);
+        callHelper("outOfBounds");
+        encoder.patch(inBounds, encoder.size());
+        return arrays.at(array);
+    }
 
-            tacList.emplace_back("goto", " ", labelEnd); // Jump over the 'if' block
+    void loadOperand(X64Encoder::Reg reg, const string &value)
+    {
+        if (TACUtils::isLiteral(value))
+            encoder.movImm(reg, stoi(value));
+        else
+            encoder.load(reg, slot(value));
+    }
 
-            tacList.emplace_back("label", "", labelBody + ":");
-            generateTAC(node->children[1]);
-            tacList.emplace_back("goto", " ", labelLoop); // Jump over the 'if' block
+    static int xmm(const string &vector) { return stoi(vector.substr(2)); }
 
-            // Generate TAC for the 'if' block (second child)
-            tacList.emplace_back("label", "", labelEnd + ":");
-            return "";
-        }
-        else if (node->value == "if")
+    // the vectorizer's operations in SSE2, instruction for instruction as VectorAsm writes them
+    void lowerVector(const TAC &tac)
+    {
+        if (tac.op == "vsplat")
         {
-            // Condition is the first child
-            auto condition = generateConditionTAC(node->children[0]);
-
-            std::string labelIfTrue = generateLabel();
-            std::string labelEnd = generateLabel();
-
-            // Generate TAC for the condition
-            tacList.emplace_back(condition);
-            tacList.emplace_back("if", condition.op, " goto ", labelIfTrue);
-
-            // Check for the 'else' block (third child if present)
-            if (node->children.size() > 2)
-            {
-                auto elseBlock = node->children[2];
-
-                // Generate TAC for the 'else' block
-                generateTAC(elseBlock);
-
-                tacList.emplace_back("goto", " ", labelEnd); // Jump over the 'if' block
-
-                // Label for the 'if' block
-                tacList.emplace_back("label", "", labelIfTrue + ":");
-                generateTAC(node->children[1]);
-            }
+            int x = xmm(tac.result);
+            if (tac.arg1 == "0")
+                encoder.packed(X64Encoder::PXOR, x, x);
             else
             {
-                // Generate TAC for the 'if' block (second child)
-                tacList.emplace_back("label", "", labelIfTrue + ":");
-
-                generateTAC(node->children[1]);
-            }
-
-            // End label
-            tacList.emplace_back("label", "", labelEnd + ":");
-            return "";
-        }
-
-        else if (node->value == "block")
-        {
-            for (const auto &child : node->children)
-            {
-                generateTAC(child);
-            }
-            return "";
-        }
-        else if (node->value == "declaration")
-        {
-            std::string varName = node->children[1]->value;
-            if (node->children.size() > 2)
-            {
-                std::string exprResult = generateTAC(node->children[2]);
-                tacList.emplace_back(varName, "=", exprResult);
+                loadOperand(X64Encoder::EAX, tac.arg1);
+                encoder.movdToXmm(x, X64Encoder::EAX);
+                encoder.pshufd(x, x, 0);
             }
-            return "";
         }
-        else if (node->value == "assignment")
-        {
-            std::string varName = node->children[0]->value;
-            std::string exprResult = generateTAC(node->children[1]);
-            tacList.emplace_back(varName, "=", exprResult);
-            return "";
-        }
-        else if (node->value == "+" || node->value == "-" || node->value == "*" || node->value == "/")
-        {
-            std::string left = generateTAC(node->children[0]);
-            std::string right = generateTAC(node->children[1]);
-            std::string temp = generateTemp();
-            tacList.emplace_back(temp, node->value, left, right);
-            return temp;
-        }
-        else if (isLiteral(node->value) || isIdentifier(node->value))
+        else if (tac.op == "vload")
         {
-            return node->value;
+            encoder.load(X64Encoder::ECX, slot(tac.arg2));
+            encoder.loadPacked(xmm(tac.result), X64Encoder::ECX, arrays.at(tac.arg1));
         }
-        else
+        else if (tac.op == "vstore")
         {
-            throw std::runtime_error("Unknown AST node type: " + node->value);
+            encoder.load(X64Encoder::ECX, slot(tac.arg1));
+            encoder.storePacked(arrays.at(tac.result), X64Encoder::ECX, xmm(tac.arg2));
         }
-    }
-    bool isLiteral(const std::string &value)
-    {
-        // Check for integer literal
-        if (!value.empty() && std::isdigit(value[0]))
+        else if (tac.op == "vsum")
         {
-            for (char c : value)
-            {
-                if (!std::isdigit(c))
-                {
-                    return false;
-                }
-            }
-            return true;
+            int x = xmm(tac.arg1);
+            encoder.pshufd(6, x, 78);
+            encoder.packed(X64Encoder::PADDD, 6, x);
+            encoder.pshufd(7, 6, 177);
+            encoder.packed(X64Encoder::PADDD, 6, 7);
+            encoder.movdFromXmm(X64Encoder::EAX, 6);
+            encoder.store(slot(tac.result), X64Encoder::EAX);
         }
-
-        // Check for string literal (enclosed in quotes)
-        if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        else if (tac.op == "v<<")
         {
-            return true;
+            int d = xmm(tac.result), a = xmm(tac.arg1);
+            if (d != a)
+                encoder.packed(X64Encoder::MOVDQA, d, a);
+            encoder.pslld(d, stoi(tac.arg2));
         }
-
-        return false;
-    }
-
-    // Check if a string is a valid identifier (e.g., variable name)
-    bool isIdentifier(const std::string &value)
-    {
-        if (value.empty() || !std::isalpha(value[0]) && value[0] != '_')
+        else if (tac.op == "v*")
         {
-            return false; // Identifiers must start with a letter or underscore
+            int d = xmm(tac.result), a = xmm(tac.arg1), b = xmm(tac.arg2);
+            encoder.pshufd(6, a, 245);
+            encoder.pshufd(7, b, 245);
+            encoder.packed(X64Encoder::PMULUDQ, 6, 7);
+            encoder.pshufd(6, 6, 8);
+            encoder.packed(X64Encoder::MOVDQA, 7, a);
+            encoder.packed(X64Encoder::PMULUDQ, 7, b);
+            encoder.pshufd(7, 7, 8);
+            encoder.packed(X64Encoder::PUNPCKLDQ, 7, 6);
+            encoder.packed(X64Encoder::MOVDQA, d, 7);
         }
-
-        for (char c : value)
+        else if (tac.op == "v+" || tac.op == "v-")
         {
-            if (!std::isalnum(c) && c != '_')
+            int d = xmm(tac.result), a = xmm(tac.arg1), b = xmm(tac.arg2);
+            X64Encoder::Packed op = tac.op == "v+" ? X64Encoder::PADDD : X64Encoder::PSUBD;
+            if (d == a)
+                encoder.packed(op, d, b);
+            else if (d == b && tac.op == "v+")
+                encoder.packed(op, d, a);
+            else if (d == b)
             {
-                return false; // Identifiers can only contain letters, digits, or underscores
+                encoder.packed(X64Encoder::MOVDQA, 6, a);
+                encoder.packed(op, 6, b);
+                encoder.packed(X64Encoder::MOVDQA, d, 6);
             }
-        }
-
-        return true;
-    }
-    // Helper function to print TAC instructions
-    void printTAC(const vector<string> &instructions)
-    {
-        for (const string &instr : instructions)
-        {
-            cout << instr << endl;
-        }
-    }
-
-private:
-    vector<Token> tokens;
-    size_t pos;
-
-    SymbolTable &symbolTable;
+            else
+            {
+                encoder.packed(X64Encoder::MOVDQA, d, a);
+                encoder.packed(op, d, b);
+            }
+        }
+    }
 
-    unordered_map<int, string> tokenMap;
-    // Map each enum value to its corresponding string representation
+    static X64Encoder::Condition condition(const string &op)
+    {
+        if (op == "<")
+            return X64Encoder::CC_L;
+        if (op == "<=")
+            return X64Encoder::CC_LE;
+        if (op == ">")
+            return X64Encoder::CC_G;
+        if (op == ">=")
+            return X64Encoder::CC_GE;
+        if (op == "==")
+            return X64Encoder::CC_E;
+        return X64Encoder::CC_NE;
+    }
 
-    shared_ptr<ASTNode> parseStatement(string scope = "main")
+    void lowerArithmetic(const TAC &tac)
     {
-        if (tokens[pos].type == T_INT)
+        loadOperand(X64Encoder::EAX, tac.arg1);
+        bool immediate = TACUtils::isLiteral(tac.arg2);
+        if (tac.op == "/")
         {
-            return parseDeclaration(scope);
+            loadOperand(X64Encoder::ECX, tac.arg2);
+            encoder.test(X64Encoder::ECX);
+            size_t nonZero = encoder.jcc(X64Encoder::CC_NE);
+            callHelper("divideByZero");
+            encoder.patch(nonZero, encoder.size());
+            // INT_MIN / -1 traps in idiv: negate both so it divides by 1 and wraps
+            encoder.aluImm(7, X64Encoder::ECX, -1);
+            size_t notMinusOne = encoder.jcc(X64Encoder::CC_NE);
+            encoder.neg(X64Encoder::EAX);
+            encoder.neg(X64Encoder::ECX);
+            encoder.patch(notMinusOne, encoder.size());
+            encoder.cdq();
+            encoder.idiv(X64Encoder::ECX);
         }
-        else if (tokens[pos].type == T_ID)
+        else if (immediate)
         {
-            return parseAssignment(scope);
+            int32_t value = stoi(tac.arg2);
+            if (tac.op == "+")
+                encoder.aluImm(0, X64Encoder::EAX, value);
+            else if (tac.op == "-")
+                encoder.aluImm(5, X64Encoder::EAX, value);
+            else
+                encoder.imulImm(X64Encoder::EAX, value);
         }
-        else if (tokens[pos].type == T_IF)
+        else
         {
-            return parseIfStatement(scope);
+            int32_t disp = slot(tac.arg2);
+            if (tac.op == "+")
+                encoder.addMem(X64Encoder::EAX, disp);
+            else if (tac.op == "-")
+                encoder.subMem(X64Encoder::EAX, disp);
+            else
+                encoder.imulMem(X64Encoder::EAX, disp);
         }
-        else if (tokens[pos].type == T_PRINT)
+        encoder.store(slot(tac.result), X64Encoder::EAX);
+    }
+
+    void lowerFunction(const TACRegion &region)
+    {
+        slots.clear();
+        arrays.clear();
+        sizes.clear();
+        words = 0;
+        const vector<TAC> &code = region.code;
+        size_t maxArgs = 0;
+        if (!code.empty() && code.front().result == "function")
         {
-            return parsePrintStatement(scope);
+            for (const auto &param : code.front().extras)
+                slot(param);
         }
-        else if (tokens[pos].type == T_INPUT)
+        // assign every slot up front so the frame size is known for the prologue
+        for (const auto &tac : code)
         {
-            return parseInputStatement(scope);
+            if (tac.result == "call")
+            {
+                maxArgs = max(maxArgs, tac.extras.size());
+                for (const auto &arg : tac.extras)
+                {
+                    if (!TACUtils::isLiteral(arg))
+                        slot(arg);
+                }
+                if (!tac.op.empty())
+                    slot(tac.op);
+            }
+            else if (tac.result == "print" || tac.result == "input")
+                slot(tac.op);
+            else if (tac.result == "ret")
+            {
+                if (!TACUtils::isLiteral(tac.arg1))
+                    slot(tac.arg1);
+            }
+            else if (tac.op == "array")
+            {
+                words += stoi(tac.arg1);
+                arrays[tac.result] = -4 * words;
+                sizes[tac.result] = stoi(tac.arg1);
+            }
+            else if (tac.result == "if" || tac.op == "[]=")
+            {
+                for (const string *value : {&tac.arg1, &tac.arg2})
+                {
+                    if (!TACUtils::isLiteral(*value))
+                        slot(*value);
+                }
+            }
+            else if (tac.op == "[]")
+            {
+                slot(tac.result);
+                if (!TACUtils::isLiteral(tac.arg2))
+                    slot(tac.arg2);
+            }
+            else if (VectorAsm::handles(tac.op))
+            {
+                // vectors live in xmm registers; only the scalars they touch need slots
+                for (const string *value : {&tac.result, &tac.arg1, &tac.arg2})
+                {
+                    if (!value->empty() && !TACUtils::isLiteral(*value) && !TACUtils::isVector(*value) &&
+                        !arrays.count(*value))
+                        slot(*value);
+                }
+            }
+            else if (!TACUtils::isMarker(tac) && tac.result != "label" && tac.result != "goto" && !TACUtils::isCounter(tac))
+            {
+                for (const string *value : {&tac.result, &tac.arg1, &tac.arg2})
+                {
+                    if (!value->empty() && !TACUtils::isLiteral(*value))
+                        slot(*value);
+                }
+            }
         }
-        else if (tokens[pos].type == T_FOR)
+        int32_t argArea = -4 * (words + (int32_t)maxArgs);
+        int32_t frame = (-argArea + 15) & ~15;
+
+        entries[region.scope] = encoder.size();
+        encoder.pushRbp();
+        encoder.movRbpRsp();
+        encoder.subRsp(frame);
+        for (const auto &it : slots)
+            encoder.storeImm(it.second, 0);
+        if (!code.empty() && code.front().result == "function")
         {
-            return parseForLoop(scope);
+            const auto &params = code.front().extras;
+            for (size_t i = 0; i < params.size(); i++)
+            {
+                encoder.loadArg(X64Encoder::EAX, 4 * i);
+                encoder.store(slot(params[i]), X64Encoder::EAX);
+            }
         }
-        else if (tokens[pos].type == T_WHILE)
+
+        unordered_map<string, size_t> labels;
+        vector<pair<size_t, string>> jumps;
+        for (const auto &tac : code)
         {
-            return parseWhileLoop(scope);
+            if (tac.result == "function")
+                continue;
+            if (tac.result == "return")
+            {
+                encoder.movImm(X64Encoder::EAX, 0); // falling off the end returns 0
+                encoder.leave();
+                encoder.ret();
+            }
+            else if (tac.result == "ret")
+            {
+                loadOperand(X64Encoder::EAX, tac.arg1);
+                encoder.leave();
+                encoder.ret();
+            }
+            else if (tac.result == "label")
+                labels[TACUtils::labelName(tac.arg1)] = encoder.size();
+            else if (tac.result == "goto")
+                jumps.emplace_back(encoder.jmp(), TACUtils::labelName(tac.arg1));
+            else if (tac.result == "if")
+            {
+                loadOperand(X64Encoder::EAX, tac.arg1);
+                if (TACUtils::isLiteral(tac.arg2))
+                    encoder.aluImm(7, X64Encoder::EAX, stoi(tac.arg2));
+                else
+                    encoder.cmpMem(X64Encoder::EAX, slot(tac.arg2));
+                jumps.emplace_back(encoder.jcc(condition(tac.op)), TACUtils::labelName(tac.extras[0]));
+            }
+            else if (TACUtils::isCounter(tac))
+                encoder.incAbsolute(counters + stoi(tac.arg1));
+            else if (tac.result == "print")
+            {
+                encoder.load(X64Encoder::EDI, slot(tac.op));
+                callHelper("print");
+            }
+            else if (tac.result == "input")
+            {
+                callHelper("input");
+                encoder.store(slot(tac.op), X64Encoder::EAX);
+            }
+            else if (tac.result == "call")
+            {
+                for (size_t i = 0; i < tac.extras.size(); i++)
+                {
+                    loadOperand(X64Encoder::EAX, tac.extras[i]);
+                    encoder.store(argArea + 4 * i, X64Encoder::EAX);
+                }
+                encoder.leaRdi(argArea);
+                calls.emplace_back(encoder.call(), tac.arg1);
+                if (!tac.op.empty())
+                    encoder.store(slot(tac.op), X64Encoder::EAX);
+            }
+            else if (VectorAsm::handles(tac.op))
+                lowerVector(tac);
+            else if (tac.op == "array")
+            {
+                encoder.leaRdi(arrays.at(tac.result));
+                encoder.movImm(X64Encoder::ECX, stoi(tac.arg1));
+                encoder.movImm(X64Encoder::EAX, 0);
+                encoder.repStosd();
+            }
+            else if (tac.op == "[]")
+            {
+                int32_t disp = element(tac.arg1, tac.arg2);
+                if (TACUtils::isLiteral(tac.arg2))
+                    encoder.load(X64Encoder::EAX, disp);
+                else
+                    encoder.loadIndexed(X64Encoder::EAX, X64Encoder::ECX, disp);
+                encoder.store(slot(tac.result), X64Encoder::EAX);
+            }
+            else if (tac.op == "[]=")
+            {
+                loadOperand(X64Encoder::EAX, tac.arg2);
+                int32_t disp = element(tac.result, tac.arg1);
+                if (TACUtils::isLiteral(tac.arg1))
+                    encoder.store(disp, X64Encoder::EAX);
+                else
+                    encoder.storeIndexed(disp, X64Encoder::ECX, X64Encoder::EAX);
+            }
+            else if (tac.arg2.empty())
+            {
+                loadOperand(X64Encoder::EAX, tac.arg1);
+                encoder.store(slot(tac.result), X64Encoder::EAX);
+            }
+            else
+                lowerArithmetic(tac);
         }
-        else if (tokens[pos].type == T_DEF)
+        if (region.scope == "main")
         {
-            return parseFunction();
+            encoder.leave();
+            encoder.ret();
         }
-        else if (tokens[pos].type == T_CALL)
+
+        for (const auto &jump : jumps)
         {
-            return parseFunctionCall(scope);
+            auto it = labels.find(jump.second);
+            if (it == labels.end())
+            {
+                cout << "Error: undefined label " << jump.second << endl;
+                exit(1);
+            }
+            encoder.patch(jump.first, it->second);
         }
-        // else if (tokens[pos].type == T_RETURN)
-        // {
-        //     parseReturnStatement();
-        // }
-        else if (tokens[pos].type == T_LBRACE)
+    }
+};
+
+// Copies lowered code into an executable mapping and calls main.
+class JitExecutor
+{
+public:
+    void run(const vector<TAC> &tacList, long long *counters = nullptr)
+    {
+#if defined(__linux__) && defined(__x86_64__)
+        X64Lowering lowering;
+        lowering.counters = counters;
+        lowering.lower(tacList);
+        const vector<uint8_t> &code = lowering.encoder.code;
+
+        size_t length = (code.size() + 4095) & ~(size_t)4095;
+        void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
         {
-            parseBlock();
+            cout << "Error: cannot map JIT memory" << endl;
+            exit(1);
         }
-        else
+        memcpy(memory, code.data(), code.size());
+        if (mprotect(memory, length, PROT_READ | PROT_EXEC) != 0)
         {
-            cout << "Syntax error: unexpected token " << tokens[pos].value << endl;
+            cout << "Error: cannot make JIT memory executable" << endl;
             exit(1);
         }
-        return nullptr;
-    }
 
-    shared_ptr<ASTNode> parseBlock(string scope = "main")
-    {
-        expect(T_LBRACE);
-        auto blockNode = make_shared<ASTNode>("block");
-        while (tokens[pos].type != T_RBRACE && tokens[pos].type != T_EOF)
+        using EntryPoint = void (*)(int32_t *);
+        EntryPoint entry = (EntryPoint)((uint8_t *)memory + lowering.entries["main"]);
         {
-            auto statementNode = parseStatement(scope);
-            blockNode->children.push_back(statementNode);
+            PhaseTimer timer("execute");
+            entry(nullptr);
+            JitRuntime::flush();
         }
-        expect(T_RBRACE);
-        return blockNode;
+        munmap(memory, length);
+#else
+        (void)tacList;
+        (void)counters;
+        cout << "Error: --jit needs Linux on x86-64" << endl;
+        exit(1);
+#endif
     }
+};
 
-    shared_ptr<ASTNode> parsePrintStatement(string scope = "main")
+// Freestanding I/O runtime for the GAS backend, written out by --emit-runtime.
+// It talks to the kernel directly so programs link with plain `ld`.
+const char *gasRuntimeSource = R"(/* runtime for the x86-64 GAS backend
+   cc -c -O2 -ffreestanding -fno-stack-protector -fno-pie runtime.c
+   as -o prog.o prog.s && ld -o prog prog.o runtime.o */
+
+static long sys3(long n, long a, long b, long c)
+{
+    long r;
+    __asm__ volatile("syscall" : "=a"(r) : "a"(n), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+    return r;
+}
+
+static char out[1 << 16];
+static long outLen;
+static char in[1 << 12];
+static long inLen, inPos;
+
+static void rt_flush(void)
+{
+    long done = 0;
+    while (done < outLen)
     {
-        auto printStat = tokens[pos].value;
-        expect(T_PRINT);
-        expect(T_LPAREN);
+        long n = sys3(1, 1, (long)(out + done), outLen - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    outLen = 0;
+}
 
-        string varName = tokens[pos].value;
-        expect(T_ID); // Expect the variable identifier
+static void rt_fail(const char *message, long length)
+{
+    rt_flush();
+    sys3(1, 1, (long)message, length);
+    sys3(60, 1, 0, 0);
+}
 
-        size_t line = symbolTable.symbolExists(varName, scope);
-        if (line == -1)
+static void rt_digits(int value)
+{
+    char digits[12];
+    int n = 0;
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    do
+    {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    if (outLen > (long)sizeof(out) - 16)
+        rt_flush();
+    if (value < 0)
+        out[outLen++] = '-';
+    while (n)
+        out[outLen++] = digits[--n];
+}
+
+void rt_print(int value)
+{
+    rt_digits(value);
+    out[outLen++] = '\n';
+}
+
+static void rt_text(const char *text)
+{
+    while (*text)
+        out[outLen++] = *text++;
+}
+
+static int rt_getc(void)
+{
+    if (inPos == inLen)
+    {
+        inLen = sys3(0, 0, (long)in, sizeof(in));
+        inPos = 0;
+        if (inLen <= 0)
         {
-            cout << "Error: Variable " << varName << " not declared!" << endl;
-            exit(1);
+            inLen = 0;
+            return -1;
         }
+    }
+    return in[inPos++];
+}
 
-        expect(T_RPAREN);
-        expect(T_SEMICOLON);
+int rt_input(void)
+{
+    rt_flush();
+    int c = rt_getc();
+    while (c == ' ' || c == '\n' || c == '\t' || c == '\r')
+        c = rt_getc();
+    int negative = c == '-';
+    if (negative)
+        c = rt_getc();
+    if (c < '0' || c > '9')
+        rt_fail("Error: expected an integer on input\n", 36);
+    unsigned int value = 0;
+    while (c >= '0' && c <= '9')
+    {
+        value = value * 10 + (c - '0');
+        c = rt_getc();
+    }
+    return negative ? (int)(0u - value) : (int)value;
+}
 
-        auto printNode = std::make_shared<ASTNode>("print");
-        printNode->children.push_back(make_shared<ASTNode>(varName));
+void rt_div0(void)
+{
+    rt_fail("Error: division by zero\n", 24);
+}
 
-        return printNode;
+void rt_bounds(int index, int size)
+{
+    rt_flush();
+    rt_text("Error: index ");
+    rt_digits(index);
+    rt_text(" is out of bounds for an array of ");
+    rt_digits(size);
+    rt_text("\n");
+    rt_flush();
+    sys3(60, 1, 0, 0);
+}
+
+/* defined by programs built with -fprofile-generate */
+extern long rt_counters[] __attribute__((weak));
+extern const long rt_counter_count __attribute__((weak));
+extern const char rt_profile_path[] __attribute__((weak));
+extern const char rt_profile_header[] __attribute__((weak));
+
+static void rt_write(long fd, const char *text, long length)
+{
+    while (length > 0)
+    {
+        long n = sys3(1, fd, (long)text, length);
+        if (n <= 0)
+            break;
+        text += n;
+        length -= n;
     }
-    shared_ptr<ASTNode> parseInputStatement(string scope = "main")
+}
+
+static void rt_dump_profile(void)
+{
+    long fd = sys3(2, (long)rt_profile_path, 01 | 0100 | 01000, 0644); /* O_WRONLY|O_CREAT|O_TRUNC */
+    if (fd < 0)
+        return;
+    long length = 0;
+    while (rt_profile_header[length])
+        length++;
+    rt_write(fd, rt_profile_header, length);
+    char line[48];
+    for (long i = 0; i < rt_counter_count; i += 2)
     {
-        expect(T_INPUT);
-        expect(T_LPAREN);
+        long n = 0;
+        for (int k = 0; k < 2; k++)
+        {
+            char digits[24];
+            int d = 0;
+            unsigned long value = rt_counters[i + k];
+            do
+            {
+                digits[d++] = '0' + value % 10;
+                value /= 10;
+            } while (value);
+            while (d)
+                line[n++] = digits[--d];
+            line[n++] = k ? '\n' : ' ';
+        }
+        rt_write(fd, line, n);
+    }
+    sys3(3, fd, 0, 0);
+}
 
-        string varName = tokens[pos].value;
-        expect(T_ID); // Expect the variable identifier
+void program_main(void);
 
-        size_t line = symbolTable.symbolExists(varName, scope);
-        if (line == -1)
+void rt_start(void)
+{
+    program_main();
+    rt_flush();
+    if (&rt_counter_count)
+        rt_dump_profile();
+    sys3(60, 0, 0, 0);
+}
+
+__asm__(".globl _start\n_start:\n    xor %ebp, %ebp\n    and $-16, %rsp\n    call rt_start\n    hlt\n");
+)";
+
+// Emits Intel-syntax GAS for x86-64 Linux following the System V convention:
+// up to six arguments in edi, esi, edx, ecx, r8d, r9d, the rest on the stack,
+// and the returned value in eax.
+// Variables live in stack slots; temps get one of eight registers, twice the
+// eax-edx set of the MASM target, and a stack slot once those run out.
+class GasAssembly
+{
+public:
+    GasAssembly()
+    {
+        registerPool = {"r8d", "r9d", "r10d", "r11d", "esi", "edi", "ebx", "r12d"};
+        insMap["+"] = "add";
+        insMap["-"] = "sub";
+        insMap["*"] = "imul";
+        insMap["<"] = "jl";
+        insMap["<="] = "jle";
+        insMap[">"] = "jg";
+        insMap[">="] = "jge";
+        insMap["=="] = "je";
+        insMap["!="] = "jne";
+    }
+
+    string getAssembly(const vector<TAC> &tacList)
+    {
+        PhaseTimer timer("codegen");
+        string assembly = ".intel_syntax noprefix\n.text\n";
+        for (const auto &region : TACUtils::split(tacList))
         {
-            cout << "Error: Variable " << varName << " not declared!" << endl;
-            exit(1);
+            PhaseTimer timer("function codegen", region.scope);
+            assembly += generateFunction(region);
         }
+        if (!profilePath.empty())
+        {
+            // the runtime writes these out at exit
+            assembly += ".bss\n.globl rt_counters\n.align 8\nrt_counters:\n    .zero " + to_string(8 * max(profileCounters, 1)) + "\n";
+            assembly += ".section .rodata\n.globl rt_counter_count\n.align 8\nrt_counter_count:\n    .quad " +
+                        to_string(profileCounters) + "\n";
+            assembly += ".globl rt_profile_path\nrt_profile_path:\n    .asciz \"" + profilePath + "\"\n";
+            assembly += ".globl rt_profile_header\nrt_profile_header:\n    .asciz \"" +
+                        profileHeader.substr(0, profileHeader.size() - 1) + "\\n\"\n";
+        }
+        assembly += ".section .note.GNU-stack,\"\",@progbits\n";
+        return assembly;
+    }
 
-        expect(T_RPAREN);
-        expect(T_SEMICOLON);
+    int getSpilledTemps() const { return spilledTemps; }
 
-        auto inputNode = std::make_shared<ASTNode>("input");
-        inputNode->children.push_back(make_shared<ASTNode>(varName));
+    bool avx2 = false; // vector loops use ymm registers
+    // -fprofile-generate: counter count, the file the runtime writes and its header line, empty when off
+    int profileCounters = 0;
+    string profilePath, profileHeader;
 
-        return inputNode;
+    static string symbol(const string &function)
+    {
+        return function == "main" ? "program_main" : "f_" + function;
     }
-    shared_ptr<ASTNode> parseFunction()
+
+private:
+    vector<string> registerPool;
+    unordered_map<string, string> insMap;
+    unordered_map<string, int> slots;
+    unordered_map<string, int> arrays; // name -> slot of element 0
+    unordered_map<string, int> sizes;  // name -> element count
+    int words = 0;
+    int clearLoops = 0;
+    int divisions = 0;    // numbers the INT_MIN / -1 labels
+    int boundsChecks = 0; // numbers the labels past each index check
+    unordered_map<string, string> tempRegisters; // temp -> register holding it
+    unordered_map<string, bool> usedRegisters;
+    unordered_set<string> crossesCall;  // temps whose value is live during a call or a runtime helper
+    unordered_set<string> passedToCall; // temps used as call arguments
+    string body;
+    int spilledTemps = 0;
+
+    static string label(const string &name)
     {
-        auto def = tokens[pos].value;
+        return ".L" + TACUtils::labelName(name);
+    }
 
-        expect(T_DEF);
+    string slot(const string &name)
+    {
+        auto it = slots.find(name);
+        int index = it == slots.end() ? (slots[name] = ++words) : it->second;
+        return "DWORD PTR [rbp-" + to_string(4 * index) + "]";
+    }
 
-        string funcName = tokens[pos].value;
-        expect(T_ID); // Expect the function identifier
+    int arraySlot(const string &name, int size)
+    {
+        auto it = arrays.find(name);
+        if (it != arrays.end())
+            return it->second;
+        sizes[name] = size;
+        return arrays[name] = words += size;
+    }
 
-        size_t line = symbolTable.symbolExists(funcName);
-        if (line != -1)
+    // element address; an index that is not a literal goes through ecx, and
+    // rt_bounds reports one outside the array the way the VM does
+    string element(const string &array, const string &index)
+    {
+        return "DWORD PTR " + address(array, index);
+    }
+    string address(const string &array, const string &index)
+    {
+        int offset = 4 * arrays.at(array);
+        if (TACUtils::isLiteral(index))
+            return "[rbp-" + to_string(offset - 4 * stoi(index)) + "]";
+        string size = to_string(sizes.at(array));
+        string inBounds = ".Lbounds_" + to_string(boundsChecks++);
+        emit("mov", "ecx", operand(index));
+        emit("cmp", "ecx", size);
+        emit("jb", inBounds); // unsigned, so negative indices fail too
+        emit("mov", "edi", "ecx");
+        emit("mov", "esi", size);
+        emit("call", "rt_bounds");
+        body += inBounds + ":\n";
+        return "[rbp+rcx*4-" + to_string(offset) + "]";
+    }
+
+    // the vectorizer's loops; the index of vload and vstore is the loop variable
+    void generateVector(const TAC &tac)
+    {
+        VectorAsm vec([this](const string &op, const string &dst, const string &src)
+                      { emit(op, dst, src); },
+                      avx2);
+        if (tac.op == "vsplat")
         {
-            cout << "Error: function " << funcName << " already declared! on Line " << line << endl;
-            exit(1);
+            string value = tac.arg1 == "0" ? "" : operand(tac.arg1);
+            if (TACUtils::isLiteral(value))
+            {
+                emit("mov", "eax", value);
+                value = "eax";
+            }
+            vec.splat(tac.result, value);
         }
-        symbolTable.addSymbol(funcName, def, tokens[pos].lineNo);
+        else if (tac.op == "vload")
+            vec.load(tac.result, address(tac.arg1, tac.arg2));
+        else if (tac.op == "vstore")
+            vec.store(address(tac.result, tac.arg1), tac.arg2);
+        else if (tac.op == "vsum")
+        {
+            string dst = TACUtils::isTemp(tac.result) ? allocate(tac.result) : "";
+            vec.sum(dst.empty() ? slot(tac.result) : dst, tac.arg1);
+        }
+        else if (tac.op == "vend")
+            vec.end();
+        else
+            vec.arithmetic(tac.op, tac.result, tac.arg1, tac.arg2);
+    }
 
-        expect(T_LPAREN);
-        vector<shared_ptr<ASTNode>> parameters;
-        if (tokens[pos].type != T_RPAREN) // Check if parameters exist
+    void emit(const string &op, const string &dst = "", const string &src = "")
+    {
+        body += "    " + op;
+        if (!dst.empty())
+            body += " " + dst;
+        if (!src.empty())
+            body += ", " + src;
+        body += "\n";
+    }
+
+    // register or memory operand for a value; temps are released at their single use
+    string operand(const string &value)
+    {
+        if (TACUtils::isLiteral(value))
+            return value;
+        if (TACUtils::isTemp(value))
         {
-            do
+            auto it = tempRegisters.find(value);
+            if (it != tempRegisters.end())
             {
-                string paramName = tokens[pos].value;
-                expect(T_ID); // Expect parameter name
+                string reg = it->second;
+                tempRegisters.erase(it);
+                return reg;
+            }
+        }
+        return slot(value);
+    }
 
-                // Check for duplicate parameter names
-                for (const auto &param : parameters)
-                {
-                    if (param->value == paramName)
-                    {
-                        cout << "Error: duplicate parameter name '" << paramName << "' in function " << funcName << "!" << endl;
-                        exit(1);
-                    }
-                }
-                symbolTable.addSymbol(paramName, "int", tokens[pos].lineNo, "", funcName);
-                // Add parameter as an ASTNode
-                parameters.push_back(make_shared<ASTNode>(paramName));
-                if (tokens[pos].type == T_COMMA)
-                {
-                    expect(T_COMMA);
-                    if (tokens[pos].type == T_RPAREN)
-                    {
-                        cout << "Error: Expect param name on Line " << tokens[pos].lineNo << endl;
-                        exit(1);
-                    }
-                }
+    // a temp live across a call needs a callee-saved register, and an argument
+    // must not sit in another argument's register while they are loaded
+    bool fits(const string &temp, const string &reg) const
+    {
+        bool calleeSaved = reg == "ebx" || reg == "r12d";
+        bool argumentRegister = reg == "r8d" || reg == "r9d" || reg == "esi" || reg == "edi";
+        return (calleeSaved || !crossesCall.count(temp)) && (!argumentRegister || !passedToCall.count(temp));
+    }
 
-            } while (tokens[pos].type != T_RPAREN); // Consume ',' if there are more parameters
+    string allocate(const string &temp)
+    {
+        for (const auto &reg : registerPool)
+        {
+            if (!fits(temp, reg))
+                continue;
+            bool taken = false;
+            for (const auto &it : tempRegisters)
+                taken = taken || it.second == reg;
+            if (!taken)
+            {
+                tempRegisters[temp] = reg;
+                usedRegisters[reg] = true;
+                return reg;
+            }
         }
-        expect(T_RPAREN);
-        auto funcBlock = parseBlock(funcName);
+        spilledTemps++;
+        return "";
+    }
 
-        auto funcNode = std::make_shared<ASTNode>("function");
-        funcNode->children.push_back(make_shared<ASTNode>(funcName));
-        funcNode->children.push_back(funcBlock);
-        funcNode->children.push_back(make_shared<ASTNode>(to_string(parameters.size()))); // number of params
-        for (auto param : parameters)
+    static bool isMemory(const string &operand) { return operand.find('[') != string::npos; }
+
+    void generateArithmetic(const TAC &tac)
+    {
+        bool toTemp = TACUtils::isTemp(tac.result);
+        string lhs = operand(tac.arg1);
+        string rhs = operand(tac.arg2);
+        string work = "eax";
+        if (tac.op == "/")
         {
-            funcNode->children.push_back(param);
+            emit("mov", "eax", lhs);
+            emit("mov", "ecx", rhs);
+            emit("test", "ecx", "ecx");
+            emit("je", "rt_div0");
+            // INT_MIN / -1 traps in idiv: negate both so it divides by 1 and wraps
+            string divide = ".Ldiv_" + to_string(divisions++);
+            emit("cmp", "ecx", "-1");
+            emit("jne", divide);
+            emit("neg", "eax");
+            emit("neg", "ecx");
+            body += divide + ":\n";
+            emit("cdq");
+            emit("idiv", "ecx");
+        }
+        else
+        {
+            // compute straight into the result register when there is one
+            if (toTemp && !isMemory(lhs) && !TACUtils::isLiteral(lhs) && fits(tac.result, lhs))
+                tempRegisters[tac.result] = work = lhs;
+            else if (toTemp)
+            {
+                string reg = allocate(tac.result);
+                if (reg == rhs)
+                    tempRegisters.erase(tac.result);
+                else if (!reg.empty())
+                    work = reg;
+            }
+            if (work != lhs)
+                emit("mov", work, lhs);
+            emit(insMap[tac.op], work, rhs);
+            if (work != "eax")
+                return;
         }
 
-        return funcNode;
+        string dst = toTemp && !tempRegisters.count(tac.result) ? allocate(tac.result) : "";
+        if (dst.empty())
+            dst = slot(tac.result);
+        emit("mov", dst, "eax");
     }
-    shared_ptr<ASTNode> parseFunctionCall(string scope = "main")
+
+    void generateCall(const TAC &tac)
     {
-        expect(T_CALL);
-        string funcName = tokens[pos].value;
-        expect(T_ID); // Expect the function identifier
+        static const char *argumentRegisters[] = {"edi", "esi", "edx", "ecx", "r8d", "r9d"};
+        size_t count = tac.extras.size();
+        size_t stackArgs = count > 6 ? count - 6 : 0;
+        if (stackArgs % 2)
+            emit("sub", "rsp", "8"); // keep rsp 16-byte aligned at the call
+        for (size_t i = count; i-- > 6;)
+        {
+            emit("mov", "eax", operand(tac.extras[i]));
+            emit("push", "rax");
+        }
+        for (size_t i = 0; i < count && i < 6; i++)
+            emit("mov", argumentRegisters[i], operand(tac.extras[i]));
+        emit("call", symbol(tac.arg1));
+        if (stackArgs)
+            emit("add", "rsp", to_string(8 * (stackArgs + stackArgs % 2)));
+        if (tac.op.empty())
+            return;
+        string dst = TACUtils::isTemp(tac.op) ? allocate(tac.op) : "";
+        emit("mov", dst.empty() ? slot(tac.op) : dst, "eax");
+    }
 
-        size_t line = symbolTable.symbolExists(funcName);
-        if (line == -1)
+    // an inlined body can put a call or a print between a temp's definition and its use
+    void findCallConstraints(const vector<TAC> &code)
+    {
+        crossesCall.clear();
+        passedToCall.clear();
+        unordered_map<string, int> definedAt;
+        int calls = 0; // calls and helper calls so far
+        for (const auto &tac : code)
         {
-            cout << "Error: function " << funcName << " is not declared " << line << endl;
-            exit(1);
+            vector<string> used;
+            if (tac.result == "call")
+            {
+                used = tac.extras;
+                passedToCall.insert(tac.extras.begin(), tac.extras.end());
+            }
+            else if (tac.result == "if")
+                used = {tac.arg1, tac.arg2};
+            else if (tac.result == "ret")
+                used = {tac.arg1};
+            else if (!TACUtils::isMarker(tac) && tac.result != "label" && tac.result != "goto" && tac.result != "print" && tac.result != "input")
+                used = {tac.arg1, tac.arg2};
+            for (const auto &value : used)
+            {
+                auto it = definedAt.find(value);
+                if (it != definedAt.end() && it->second < calls)
+                    crossesCall.insert(value);
+            }
+            if (tac.result == "call" || tac.result == "print" || tac.result == "input")
+                calls++;
+            string defined = tac.result == "call" ? tac.op : tac.result;
+            if (TACUtils::isTemp(defined))
+                definedAt[defined] = calls;
         }
-        expect(T_LPAREN);
-        vector<shared_ptr<ASTNode>> parameters;
-        if (tokens[pos].type != T_RPAREN)
+    }
+
+    string generateFunction(const TACRegion &region)
+    {
+        slots.clear();
+        arrays.clear();
+        sizes.clear();
+        words = 0;
+        tempRegisters.clear();
+        usedRegisters.clear();
+        body.clear();
+        string name = symbol(region.scope);
+        static const char *argumentRegisters[] = {"edi", "esi", "edx", "ecx", "r8d", "r9d"};
+
+        const vector<TAC> &code = region.code;
+        findCallConstraints(code);
+        if (!code.empty() && code.front().result == "function")
         {
-            do
+            const auto &params = code.front().extras;
+            for (size_t i = 0; i < params.size(); i++)
             {
-                string paramName = tokens[pos].value;
-                int type = expectTwoToken(T_ID, T_NUM);
-                if (type == 1)
+                if (i < 6)
+                    emit("mov", slot(params[i]), argumentRegisters[i]);
+                else
                 {
-                    size_t line = symbolTable.symbolExists(paramName, scope);
-                    if (line == -1)
-                    {
-                        cout << "Error: variable " << paramName << " is not declared in this scope " << scope << line << endl;
-                        exit(1);
-                    }
-                    parameters.push_back(make_shared<ASTNode>(paramName));
+                    emit("mov", "eax", "DWORD PTR [rbp+" + to_string(16 + 8 * (i - 6)) + "]");
+                    emit("mov", slot(params[i]), "eax");
                 }
-                else
+            }
+        }
+        string returnLabel = ".Lreturn_" + name;
+        bool jumpsToReturn = false;
+        for (size_t i = 0; i < code.size(); i++)
+        {
+            const TAC &tac = code[i];
+            if (TACUtils::isMarker(tac))
+                continue;
+            if (tac.result == "ret")
+            {
+                emit("mov", "eax", operand(tac.arg1));
+                // the epilogue follows the last instruction directly
+                if (i + 2 < code.size())
                 {
-                    parameters.push_back(make_shared<ASTNode>(paramName));
+                    emit("jmp", returnLabel);
+                    jumpsToReturn = true;
                 }
-                // Add parameter as an ASTNode
-                if (tokens[pos].type == T_COMMA)
+            }
+            else if (tac.result == "label")
+                body += label(tac.arg1) + ":\n";
+            else if (tac.result == "goto")
+                emit("jmp", label(tac.arg1));
+            else if (tac.result == "if")
+            {
+                string lhs = tac.arg1, rhs = tac.arg2, op = tac.op;
+                if (TACUtils::isLiteral(lhs))
                 {
-                    expect(T_COMMA);
-                    if (tokens[pos].type == T_RPAREN)
-                    {
-                        cout << "Error: Expect param name on Line " << tokens[pos].lineNo << endl;
-                        exit(1);
-                    }
+                    swap(lhs, rhs);
+                    op = op == ">" ? "<" : op == "<" ? ">" : op == ">=" ? "<=" : op == "<=" ? ">=" : op;
                 }
-
-            } while (tokens[pos].type != T_RPAREN); // Consume ',' if there are more parameters
+                string left = operand(lhs);
+                string right = operand(rhs);
+                if (TACUtils::isLiteral(left) || (isMemory(left) && isMemory(right)))
+                {
+                    emit("mov", "eax", left);
+                    left = "eax";
+                }
+                emit("cmp", left, right);
+                emit(insMap[op], label(tac.extras[0]));
+            }
+            else if (tac.result == "print")
+            {
+                emit("mov", "edi", slot(tac.op));
+                emit("call", "rt_print");
+            }
+            else if (tac.result == "input")
+            {
+                emit("call", "rt_input");
+                emit("mov", slot(tac.op), "eax");
+            }
+            else if (tac.result == "call")
+                generateCall(tac);
+            else if (VectorAsm::handles(tac.op))
+                generateVector(tac);
+            else if (TACUtils::isCounter(tac))
+                emit("inc", "QWORD PTR [rip+rt_counters+" + to_string(8 * stoi(tac.arg1)) + "]");
+            else if (tac.op == "array")
+            {
+                // clear from the last element down, leaving the register pool alone
+                int size = stoi(tac.arg1);
+                arraySlot(tac.result, size);
+                string loop = ".Lclear_" + name + "_" + to_string(clearLoops++);
+                emit("mov", "ecx", tac.arg1);
+                body += loop + ":\n";
+                emit("mov", "DWORD PTR [rbp+rcx*4-" + to_string(4 * arrays[tac.result] + 4) + "]", "0");
+                emit("sub", "ecx", "1");
+                emit("jnz", loop);
+            }
+            else if (tac.op == "[]")
+            {
+                string src = element(tac.arg1, tac.arg2);
+                string dst = TACUtils::isTemp(tac.result) ? allocate(tac.result) : "";
+                emit("mov", dst.empty() ? "eax" : dst, src);
+                if (dst.empty())
+                    emit("mov", slot(tac.result), "eax");
+            }
+            else if (tac.op == "[]=")
+            {
+                string value = operand(tac.arg2);
+                if (isMemory(value))
+                {
+                    emit("mov", "eax", value);
+                    value = "eax";
+                }
+                emit("mov", element(tac.result, tac.arg1), value);
+            }
+            else if (tac.arg2.empty())
+            {
+                string src = operand(tac.arg1);
+                string dst = TACUtils::isTemp(tac.result) ? allocate(tac.result) : "";
+                if (dst.empty())
+                    dst = slot(tac.result);
+                if (isMemory(src) && isMemory(dst))
+                {
+                    emit("mov", "eax", src);
+                    src = "eax";
+                }
+                emit("mov", dst, src);
+            }
+            else
+                generateArithmetic(tac);
         }
-        expect(T_RPAREN);
-        expect(T_SEMICOLON);
-        auto funcNode = std::make_shared<ASTNode>("call");
-        funcNode->children.push_back(make_shared<ASTNode>(funcName));
-        funcNode->children.push_back(make_shared<ASTNode>(to_string(parameters.size()))); // number of params
-        for (auto param : parameters)
+
+        // callee-saved registers from the pool are kept below the slots
+        vector<string> saved;
+        for (const string reg : {"ebx", "r12d"})
         {
-            funcNode->children.push_back(param);
+            if (usedRegisters[reg])
+                saved.push_back(reg == "ebx" ? "rbx" : "r12");
         }
-
-        return funcNode;
+        int frame = 4 * words + 8 * saved.size();
+        frame = (frame + 15) & ~15;
+
+        string function = ".globl " + name + "\n.type " + name + ", @function\n" + name + ":\n";
+        function += "    push rbp\n    mov rbp, rsp\n";
+        if (frame)
+            function += "    sub rsp, " + to_string(frame) + "\n";
+        for (size_t i = 0; i < saved.size(); i++)
+            function += "    mov QWORD PTR [rsp+" + to_string(8 * i) + "], " + saved[i] + "\n";
+        vector<int> scalars;
+        for (const auto &it : slots)
+            scalars.push_back(it.second);
+        sort(scalars.begin(), scalars.end());
+        for (int index : scalars)
+            function += "    mov DWORD PTR [rbp-" + to_string(4 * index) + "], 0\n";
+        function += body;
+        if (region.scope != "main" && (code.size() < 2 || code[code.size() - 2].result != "ret"))
+            function += "    xor eax, eax\n"; // falling off the end returns 0
+        if (jumpsToReturn)
+            function += returnLabel + ":\n";
+        for (size_t i = 0; i < saved.size(); i++)
+            function += "    mov " + saved[i] + ", QWORD PTR [rsp+" + to_string(8 * i) + "]\n";
+        function += "    leave\n    ret\n";
+        return function;
     }
-    shared_ptr<ASTNode> parseForLoop(string scope = "main")
+};
+
+// Writes the x86-64 lowering straight to an ELF64 relocatable object, skipping
+// assembly text. Calls between functions and to the runtime helpers become
+// R_X86_64_PLT32 relocations, so the object links with `ld` against the
+// --emit-runtime runtime. Functions keep the lowering's `f(int32_t *args)`
+// convention and are not callable from System V code.
+class ElfObjectWriter : public X64Lowering
+{
+public:
+    vector<uint8_t> write(const vector<TAC> &tacList)
     {
-        auto forNode = std::make_shared<ASTNode>("for");
+        lower(tacList);
+        PhaseTimer timer("object file");
+        // lower() resolved calls in place; turn them back into relocations
+        for (const auto &call : calls)
+        {
+            for (int i = 0; i < 4; i++)
+                encoder.code[call.first + i] = 0;
+            relocations.emplace_back(call.first, GasAssembly::symbol(call.second));
+        }
 
-        expect(T_FOR);
-        expect(T_LPAREN);
+        // symbols: null, defined functions by address, then undefined helpers
+        vector<pair<size_t, string>> functions;
+        for (const auto &entry : entries)
+            functions.emplace_back(entry.second, entry.first);
+        sort(functions.begin(), functions.end());
+        vector<string> symbolNames;
+        unordered_map<string, uint32_t> symbolIndex;
+        for (const auto &function : functions)
+        {
+            symbolIndex[GasAssembly::symbol(function.second)] = symbolNames.size() + 1;
+            symbolNames.push_back(GasAssembly::symbol(function.second));
+        }
+        for (const auto &relocation : relocations)
+        {
+            if (!symbolIndex.count(relocation.second))
+            {
+                symbolIndex[relocation.second] = symbolNames.size() + 1;
+                symbolNames.push_back(relocation.second);
+            }
+        }
 
-        auto initialization = parseAssignment(scope);
+        string strtab(1, '\0');
+        vector<uint8_t> symtab(24, 0);
+        for (size_t i = 0; i < symbolNames.size(); i++)
+        {
+            bool defined = i < functions.size();
+            put32(symtab, strtab.size());
+            symtab.push_back(defined ? 0x12 : 0x10); // GLOBAL FUNC / GLOBAL NOTYPE
+            symtab.push_back(0);
+            put16(symtab, defined ? 1 : 0); // .text or undefined
+            put64(symtab, defined ? functions[i].first : 0);
+            size_t end = i + 1 < functions.size() ? functions[i + 1].first : encoder.size();
+            put64(symtab, defined ? end - functions[i].first : 0);
+            strtab += symbolNames[i];
+            strtab += '\0';
+        }
 
-        // expect(T_SEMICOLON);
+        vector<uint8_t> rela;
+        for (const auto &relocation : relocations)
+        {
+            put64(rela, relocation.first);
+            put64(rela, ((uint64_t)symbolIndex[relocation.second] << 32) | 4); // R_X86_64_PLT32
+            put64(rela, (uint64_t)-4);
+        }
 
-        auto condition = parseExpression(scope);
+        const char *sectionNames[] = {"", ".text", ".data", ".symtab", ".strtab", ".rela.text", ".shstrtab", ".note.GNU-stack"};
+        string shstrtab;
+        vector<uint32_t> nameOffsets;
+        for (const char *name : sectionNames)
+        {
+            nameOffsets.push_back(shstrtab.size());
+            shstrtab += name;
+            shstrtab += '\0';
+        }
 
-        expect(T_SEMICOLON);
+        vector<uint8_t> file(64, 0);
+        auto append = [&](const void *data, size_t size, size_t align) {
+            while (file.size() % align)
+                file.push_back(0);
+            size_t offset = file.size();
+            file.insert(file.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+            return offset;
+        };
+        size_t textOffset = append(encoder.code.data(), encoder.size(), 16);
+        size_t dataOffset = file.size();
+        size_t symtabOffset = append(symtab.data(), symtab.size(), 8);
+        size_t strtabOffset = append(strtab.data(), strtab.size(), 1);
+        size_t relaOffset = append(rela.data(), rela.size(), 8);
+        size_t shstrtabOffset = append(shstrtab.data(), shstrtab.size(), 1);
+        while (file.size() % 8)
+            file.push_back(0);
+        size_t sectionHeaders = file.size();
+
+        // name, type, flags, offset, size, link, info, align, entsize
+        file.resize(file.size() + 64, 0);
+        sectionHeader(file, nameOffsets[1], 1, 6, textOffset, encoder.size(), 0, 0, 16, 0);
+        sectionHeader(file, nameOffsets[2], 1, 3, dataOffset, 0, 0, 0, 4, 0);
+        sectionHeader(file, nameOffsets[3], 2, 0, symtabOffset, symtab.size(), 4, 1, 8, 24);
+        sectionHeader(file, nameOffsets[4], 3, 0, strtabOffset, strtab.size(), 0, 0, 1, 0);
+        sectionHeader(file, nameOffsets[5], 4, 0x40, relaOffset, rela.size(), 3, 1, 8, 24);
+        sectionHeader(file, nameOffsets[6], 3, 0, shstrtabOffset, shstrtab.size(), 0, 0, 1, 0);
+        sectionHeader(file, nameOffsets[7], 1, 0, shstrtabOffset, 0, 0, 0, 1, 0);
+
+        vector<uint8_t> header = {0x7F, 'E', 'L', 'F', 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        put16(header, 1);  // ET_REL
+        put16(header, 62); // EM_X86_64
+        put32(header, 1);
+        put64(header, 0);
+        put64(header, 0);
+        put64(header, sectionHeaders);
+        put32(header, 0);
+        put16(header, 64);
+        put16(header, 0);
+        put16(header, 0);
+        put16(header, 64);
+        put16(header, 8);
+        put16(header, 6);
+        copy(header.begin(), header.end(), file.begin());
+        return file;
+    }
 
-        auto incDec = parseAssignment(scope);
+protected:
+    void callHelper(const string &name) override
+    {
+        string symbol = name == "print" ? "rt_print" : name == "input" ? "rt_input" : name == "outOfBounds" ? "rt_bounds" : "rt_div0";
+        relocations.emplace_back(encoder.call(), symbol);
+    }
 
-        expect(T_RPAREN);
+private:
+    vector<pair<size_t, string>> relocations; // rel32 offset, symbol
 
-        forNode->children.push_back(initialization);
-        forNode->children.push_back(condition);
-        forNode->children.push_back(incDec);
+    static void put16(vector<uint8_t> &out, uint16_t value)
+    {
+        out.push_back(value), out.push_back(value >> 8);
+    }
+    static void put32(vector<uint8_t> &out, uint32_t value)
+    {
+        put16(out, value), put16(out, value >> 16);
+    }
+    static void put64(vector<uint8_t> &out, uint64_t value)
+    {
+        put32(out, value), put32(out, value >> 32);
+    }
+    static void sectionHeader(vector<uint8_t> &out, uint32_t name, uint32_t type, uint64_t flags, uint64_t offset,
+                              uint64_t size, uint32_t link, uint32_t info, uint64_t align, uint64_t entsize)
+    {
+        put32(out, name);
+        put32(out, type);
+        put64(out, flags);
+        put64(out, 0);
+        put64(out, offset);
+        put64(out, size);
+        put32(out, link);
+        put32(out, info);
+        put64(out, align);
+        put64(out, entsize);
+    }
+};
 
-        auto forBlock = parseBlock(scope);
-        forNode->children.push_back(forBlock);
+// Lowers TAC to portable C for the host compiler: every region becomes a
+// function with its variables and temps as int locals, labels and gotos map
+// one to one, and arithmetic wraps at 32 bits like the VM.
+class CBackend
+{
+public:
+    // -fprofile-generate: counter count, the file main writes them to and its header line, empty when off
+    int profileCounters = 0;
+    string profilePath, profileHeader;
 
-        return forNode;
+    string generate(const vector<TAC> &tacList)
+    {
+        PhaseTimer timer("codegen");
+        vector<TACRegion> regions = TACUtils::split(tacList);
+        string source = R"(#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline void rt_print(int value)
+{
+    printf("%d\n", value);
+}
+
+static inline int rt_input(void)
+{
+    int value;
+    fflush(stdout);
+    if (scanf("%d", &value) != 1)
+    {
+        printf("Error: expected an integer on input\n");
+        exit(1);
     }
-    shared_ptr<ASTNode> parseWhileLoop(string scope = "main")
+    return value;
+}
+
+static inline int rt_div(int a, int b)
+{
+    if (b == 0)
     {
-        auto whileNode = std::make_shared<ASTNode>("while");
+        printf("Error: division by zero\n");
+        exit(1);
+    }
+    if (b == -1)
+        return (int)(0u - (unsigned)a);
+    return a / b;
+}
 
-        expect(T_WHILE);
-        expect(T_LPAREN);
+static inline int rt_bounds(int index, int size)
+{
+    if ((unsigned)index >= (unsigned)size)
+    {
+        printf("Error: index %d is out of bounds for an array of %d\n", index, size);
+        exit(1);
+    }
+    return index;
+}
 
-        auto condition = parseExpression(scope);
+)";
+        if (!profilePath.empty())
+        {
+            string n = to_string(profileCounters);
+            source += "static long long rt_counts[" + to_string(max(profileCounters, 1)) + "];\n\n";
+            source += "static void rt_dump_profile(void)\n{\n    FILE *file = fopen(\"" + profilePath + "\", \"w\");\n";
+            source += "    if (!file)\n        return;\n    fputs(\"" + profileHeader.substr(0, profileHeader.size() - 1) + "\\n\", file);\n";
+            source += "    for (int i = 0; i < " + n + "; i += 2)\n";
+            source += "        fprintf(file, \"%lld %lld\\n\", rt_counts[i], rt_counts[i + 1]);\n    fclose(file);\n}\n\n";
+        }
+        // defs unreachable from main would only draw unused-function warnings from cc
+        unordered_map<string, const TACRegion *> byName;
+        for (const auto &region : regions)
+            byName[region.scope] = &region;
+        unordered_set<string> called;
+        vector<const TACRegion *> worklist = {&regions[0]};
+        while (!worklist.empty())
+        {
+            const TACRegion *region = worklist.back();
+            worklist.pop_back();
+            for (const auto &tac : region->code)
+            {
+                if (tac.result == "call" && called.insert(tac.arg1).second && byName.count(tac.arg1))
+                    worklist.push_back(byName[tac.arg1]);
+            }
+        }
+        vector<const TACRegion *> functions;
+        for (size_t i = 1; i < regions.size(); i++)
+        {
+            if (called.count(regions[i].scope))
+                functions.push_back(&regions[i]);
+        }
+        for (const auto *function : functions)
+            source += "static int " + signature(*function) + ";\n";
+        if (!functions.empty())
+            source += "\n";
+        for (const auto *function : functions)
+        {
+            PhaseTimer timer("function codegen", function->scope);
+            source += "static int " + signature(*function) + "\n" + body(*function) + "\n";
+        }
+        PhaseTimer mainTimer("function codegen", "main");
+        source += "int main(void)\n" + body(regions[0]);
+        return source;
+    }
 
-        expect(T_RPAREN);
+private:
+    static string value(const string &name)
+    {
+        if (TACUtils::isLiteral(name))
+            return name[0] == '-' ? "(" + name + ")" : name;
+        return "v_" + name;
+    }
 
-        auto whileBlock = parseBlock(scope);
-        whileNode->children.push_back(condition);
-        whileNode->children.push_back(whileBlock);
+    static string signature(const TACRegion &region)
+    {
+        string text = "f_" + region.scope + "(";
+        const auto &params = region.code.front().extras;
+        for (size_t i = 0; i < params.size(); i++)
+            text += (i ? ", int " : "int ") + value(params[i]);
+        return text + (params.empty() ? "void)" : ")");
+    }
 
-        return whileNode;
+    string body(const TACRegion &region)
+    {
+        const vector<TAC> &code = region.code;
+        bool isFunction = !code.empty() && code.front().result == "function";
+        unordered_set<string> params;
+        if (isFunction)
+            params.insert(code.front().extras.begin(), code.front().extras.end());
+
+        vector<string> locals;
+        vector<pair<string, string>> arrays; // name, size
+        unordered_map<string, string> sizes;
+        unordered_set<string> seen(params);
+        auto declare = [&](const string &name) {
+            if (!name.empty() && !TACUtils::isLiteral(name) && seen.insert(name).second)
+                locals.push_back(name);
+        };
+        // a variable index goes through rt_bounds, which stops the program like the VM does
+        auto element = [&](const string &array, const string &index) {
+            if (TACUtils::isLiteral(index))
+                return value(array) + "[" + value(index) + "]";
+            return value(array) + "[rt_bounds(" + value(index) + ", " + sizes.at(array) + ")]";
+        };
+        string statements;
+        for (const auto &tac : code)
+        {
+            if (TACUtils::isMarker(tac))
+                continue;
+            if (tac.result == "label")
+                statements += TACUtils::labelName(tac.arg1) + ":;\n";
+            else if (tac.result == "goto")
+                statements += "    goto " + TACUtils::labelName(tac.arg1) + ";\n";
+            else if (TACUtils::isCounter(tac))
+                statements += "    rt_counts[" + tac.arg1 + "]++;\n";
+            else if (tac.result == "if")
+            {
+                declare(tac.arg1);
+                declare(tac.arg2);
+                statements += "    if (" + value(tac.arg1) + " " + tac.op + " " + value(tac.arg2) + ") goto " +
+                              TACUtils::labelName(tac.extras[0]) + ";\n";
+            }
+            else if (tac.result == "print")
+            {
+                declare(tac.op);
+                statements += "    rt_print(" + value(tac.op) + ");\n";
+            }
+            else if (tac.result == "input")
+            {
+                declare(tac.op);
+                statements += "    " + value(tac.op) + " = rt_input();\n";
+            }
+            else if (tac.result == "call")
+            {
+                string args;
+                for (const auto &arg : tac.extras)
+                {
+                    declare(arg);
+                    args += (args.empty() ? "" : ", ") + value(arg);
+                }
+                declare(tac.op);
+                string assign = tac.op.empty() ? "" : value(tac.op) + " = ";
+                statements += "    " + assign + "f_" + tac.arg1 + "(" + args + ");\n";
+            }
+            else if (tac.result == "ret")
+            {
+                declare(tac.arg1);
+                statements += "    return " + value(tac.arg1) + ";\n";
+            }
+            else if (tac.op == "array")
+            {
+                if (seen.insert(tac.result).second)
+                    arrays.emplace_back(tac.result, tac.arg1);
+                sizes[tac.result] = tac.arg1;
+                statements += "    memset(" + value(tac.result) + ", 0, sizeof " + value(tac.result) + ");\n";
+            }
+            else if (tac.op == "[]")
+            {
+                declare(tac.result);
+                declare(tac.arg2);
+                statements += "    " + value(tac.result) + " = " + element(tac.arg1, tac.arg2) + ";\n";
+            }
+            else if (tac.op == "[]=")
+            {
+                declare(tac.arg1);
+                declare(tac.arg2);
+                statements += "    " + element(tac.result, tac.arg1) + " = " + value(tac.arg2) + ";\n";
+            }
+            else
+            {
+                declare(tac.result);
+                declare(tac.arg1);
+                declare(tac.arg2);
+                string rhs = value(tac.arg1);
+                if (tac.op == "/")
+                    rhs = "rt_div(" + rhs + ", " + value(tac.arg2) + ")";
+                else if (!tac.arg2.empty())
+                    rhs = "(int)((unsigned)" + rhs + " " + tac.op + " (unsigned)" + value(tac.arg2) + ")";
+                statements += "    " + value(tac.result) + " = " + rhs + ";\n";
+            }
+        }
+
+        string text = "{\n";
+        for (const auto &name : locals)
+            text += "    int " + value(name) + " = 0;\n";
+        for (const auto &array : arrays)
+            text += "    int " + value(array.first) + "[" + array.second + "];\n";
+        text += statements;
+        if (!isFunction && !profilePath.empty())
+            text += "    rt_dump_profile();\n";
+        if (!isFunction)
+            text += "    fflush(stdout);\n";
+        if (code.size() < 2 || code[code.size() - 2].result != "ret")
+            text += "    return 0;\n";
+        return text + "}\n";
     }
-    shared_ptr<ASTNode> parseDeclaration(string scope = "main")
+};
+
+// the count after `-fname=` or `key=`; anything but digits is a usage error rather than a stoi exception
+int numericOption(const string &arg, size_t prefix)
+{
+    string value = arg.substr(prefix);
+    if (value.empty() || value.size() > 9 || !all_of(value.begin(), value.end(), ::isdigit))
     {
-        auto type = tokens[pos].value;
-        expect(T_INT); // Expect 'int'
-        string varName = tokens[pos].value;
-        expect(T_ID); // Expect the variable identifier
+        cout << "Error: " << arg.substr(0, prefix) << " expects a non-negative integer, got '" << value << "'" << endl;
+        exit(1);
+    }
+    return stoi(value);
+}
+
+// Writes random programs that this compiler accepts, shaped for compile-time
+// benchmarks. Every def takes two parameters, declares its locals up front and
+// returns; calls only go to earlier defs and loops have constant trip counts.
+// The same shape and seed always give the same program.
+class ProgramGenerator
+{
+public:
+    struct Shape
+    {
+        int defs = 10;           // ignored when lines is set
+        int statements = 20;     // top-level statements per def
+        int depth = 3;           // how deep if/else and for nest
+        int expressionDepth = 3; // operator levels in an expression
+        int identifiers = 8;     // locals per def, besides the loop counters
+        long long lines = 0;     // adds defs until the program is at least this long
+        unsigned seed = 1;
+    };
+
+    ProgramGenerator(const Shape &shape) : shape(shape), random(shape.seed) {}
+
+    // "key=value,..." with the field names above; expression-depth for expressionDepth
+    static Shape parseShape(const string &spec)
+    {
+        Shape shape;
+        stringstream fields(spec);
+        string field;
+        while (getline(fields, field, ','))
+        {
+            if (field.empty())
+                continue;
+            size_t equals = field.find('=');
+            if (equals == string::npos)
+            {
+                cout << "Error: expected key=value in program shape, got " << field << endl;
+                exit(1);
+            }
+            string key = field.substr(0, equals);
+            int value = numericOption(field, equals + 1);
+            if (key == "defs")
+                shape.defs = value;
+            else if (key == "statements")
+                shape.statements = value;
+            else if (key == "depth")
+                shape.depth = value;
+            else if (key == "expression-depth")
+                shape.expressionDepth = value;
+            else if (key == "identifiers")
+                shape.identifiers = max(1, value);
+            else if (key == "lines")
+                shape.lines = value;
+            else if (key == "seed")
+                shape.seed = value;
+            else
+            {
+                cout << "Error: unknown program shape field " << key << endl;
+                exit(1);
+            }
+        }
+        return shape;
+    }
 
-        size_t line = symbolTable.symbolExists(varName, scope);
-        if (line != -1)
+    string generate()
+    {
+        text = "{\n";
+        lineCount = 1;
+        defCount = 0;
+        while (shape.lines > 0 ? lineCount + 4 < shape.lines : defCount < shape.defs)
+            generateDef();
+        line("", "int r;");
+        for (int f = max(0, defCount - 4); f < defCount; f++)
         {
-            cout << "Error: Variable " << varName << " already declared! on Line " << line << endl;
-            exit(1);
+            line("", "r = call f" + to_string(f) + "(" + to_string(pick(100)) + ", " + to_string(pick(100)) + ");");
+            line("", "print(r);");
         }
-        symbolTable.addSymbol(varName, type, tokens[pos].lineNo, "", scope);
-        expect(T_SEMICOLON); // Expect the semicolon at the end of the declaration
+        line("", "}");
+        return move(text);
+    }
 
-        auto declNode = std::make_shared<ASTNode>("declaration");
-        declNode->children.push_back(make_shared<ASTNode>(type));
-        declNode->children.push_back(make_shared<ASTNode>(varName));
+    long long getLines() const { return lineCount; }
+    int getDefs() const { return defCount; }
 
-        return declNode;
+private:
+    Shape shape;
+    mt19937 random;
+    string text;
+    long long lineCount = 0;
+    int defCount = 0;
+
+    int pick(int n) { return n > 0 ? random() % n : 0; }
+
+    void line(const string &indent, const string &code)
+    {
+        text += indent;
+        text += code;
+        text += '\n';
+        lineCount++;
     }
-    shared_ptr<ASTNode> parseAssignment(string scope = "main")
+
+    void generateDef()
     {
-        string id = tokens[pos].value;
-        expect(T_ID);
+        line("", "def f" + to_string(defCount) + "(p0, p1)");
+        line("", "{");
+        for (int v = 0; v < shape.identifiers; v++)
+            line("    ", "int v" + to_string(v) + ";");
+        for (int d = 0; d < shape.depth; d++)
+            line("    ", "int i" + to_string(d) + ";");
+        for (int k = 0; k < shape.statements; k++)
+            generateStatement(0, "    ");
+        line("    ", "return " + generateExpression(shape.expressionDepth) + ";");
+        line("", "}");
+        defCount++;
+    }
 
-        size_t line = symbolTable.symbolExists(id, scope);
-        if (line == -1)
+    void generateStatement(int depth, const string &indent)
+    {
+        int kind = pick(depth < shape.depth ? 8 : 5);
+        if (kind == 4)
         {
-            cout << "Error: Variable " << id << " not declared!" << endl;
-            exit(1);
+            line(indent, "print(" + variable() + ");");
         }
-        expect(T_ASSIGN);
-        auto expNode = parseExpression(scope);
-        // symbolTable.updateVariableValue(id, tokens[pos - 1].value); may be problem
-        expect(T_SEMICOLON);
-
-        auto assignNode = std::make_shared<ASTNode>("assignment");
-        assignNode->children.push_back(make_shared<ASTNode>(id));
-        assignNode->children.push_back(expNode);
+        else if (kind == 5 || kind == 6)
+        {
+            const char *relops[] = {">", "<", ">=", "<=", "=="};
+            line(indent, "if (" + generateExpression(shape.expressionDepth) + " " + relops[pick(5)] + " " +
+                             generateExpression(shape.expressionDepth) + ")");
+            generateBlock(depth, indent);
+            if (kind == 6)
+            {
+                line(indent, "else");
+                generateBlock(depth, indent);
+            }
+        }
+        else if (kind == 7)
+        {
+            string counter = "i" + to_string(depth);
+            line(indent, "for (" + counter + " = 0 ; " + counter + " < " + to_string(2 + pick(7)) + " ; " + counter +
+                             " = " + counter + "+1;)");
+            generateBlock(depth, indent);
+        }
+        else
+        {
+            line(indent, "v" + to_string(pick(shape.identifiers)) + " = " + generateExpression(shape.expressionDepth) + ";");
+        }
+    }
 
-        return assignNode;
+    void generateBlock(int depth, const string &indent)
+    {
+        line(indent, "{");
+        for (int k = 1 + pick(3); k > 0; k--)
+            generateStatement(depth + 1, indent + "    ");
+        line(indent, "}");
     }
 
-    shared_ptr<ASTNode> parseIfStatement(string scope = "main")
+    string generateExpression(int depth)
     {
-        expect(T_IF);
-        auto ifNode = std::make_shared<ASTNode>("if");
-        expect(T_LPAREN);
+        if (depth == 0 || pick(4) == 0)
+            return leaf(true);
+        int op = pick(4);
+        if (op == 3)
+            return "(" + generateExpression(depth - 1) + " / " + to_string(1 + pick(9)) + ")";
+        return "(" + generateExpression(depth - 1) + " " + "+-*"[op] + " " + generateExpression(depth - 1) + ")";
+    }
 
-        auto condition = parseExpression(scope);
-        ifNode->children.push_back(condition);
+    string leaf(bool calls)
+    {
+        int kind = pick(calls && defCount > 0 ? 9 : 8);
+        if (kind == 8)
+            return "call f" + to_string(pick(defCount)) + "(" + leaf(false) + ", " + leaf(false) + ")";
+        if (kind >= 5)
+            return to_string(pick(100));
+        return variable();
+    }
 
-        expect(T_RPAREN);
+    string variable()
+    {
+        int k = pick(shape.identifiers + 2);
+        return k < 2 ? "p" + to_string(k) : "v" + to_string(k - 2);
+    }
+};
 
-        auto ifBlock = parseBlock(scope);
-        ifNode->children.push_back(ifBlock);
+// Compile-throughput curve: for each size a generated program goes through the
+// lexer, the parser, TAC generation and MASM assembly one phase at a time. One
+// JSON line per phase and size records the time, lines per second and heap use.
+// Allocations come from a first run with counting on; the time is the best of
+// the runs after it, which have counting off. The default sizes all finish in
+// reasonable time; bigger ones such as 10000000 are asked for with --bench-lines.
+class CompileBenchmark
+{
+public:
+    ProgramGenerator::Shape shape;
+    vector<long long> sizes = {1000, 10000, 100000, 1000000};
+    int codegenThreads = 0;
 
-        if (tokens[pos].type == T_ELSE)
+    void run(FdWriter &out)
+    {
+        for (long long size : sizes)
         {
-            expect(T_ELSE);
-
-            auto elseBlock = parseBlock(scope);
-            ifNode->children.push_back(elseBlock);
+            ProgramGenerator::Shape sized = shape;
+            sized.lines = size;
+            ProgramGenerator generator(sized);
+            string source = generator.generate();
+            vector<Measurement> phases(4);
+            int runs = 1 + (int)max(1LL, 200000 / max(1LL, generator.getLines()));
+            for (int r = 0; r < runs; r++)
+            {
+                AllocationTracker::enabled = r == 0;
+                compile(source, phases, r == 0);
+            }
+            AllocationTracker::enabled = false;
+            const char *names[] = {"lex", "parse", "tac", "assembly"};
+            for (int p = 0; p < 4; p++)
+            {
+                const Measurement &m = phases[p];
+                string record = "{\"benchmark\":\"compile\",\"phase\":\"" + string(names[p]) +
+                                "\",\"lines\":" + to_string(generator.getLines()) +
+                                ",\"source_bytes\":" + to_string(source.size()) +
+                                ",\"defs\":" + to_string(generator.getDefs()) +
+                                ",\"statements\":" + to_string(shape.statements) +
+                                ",\"depth\":" + to_string(shape.depth) +
+                                ",\"expression_depth\":" + to_string(shape.expressionDepth) +
+                                ",\"identifiers\":" + to_string(shape.identifiers) +
+                                ",\"seed\":" + to_string(shape.seed) +
+                                ",\"runs\":" + to_string(runs - 1);
+                char numbers[256];
+                snprintf(numbers, sizeof numbers,
+                         ",\"seconds\":%.6f,\"lines_per_second\":%.0f,\"allocations\":%lld,\"allocated_bytes\":%lld,"
+                         "\"peak_live_bytes\":%lld,\"peak_rss_kb\":%ld}\n",
+                         m.seconds, m.seconds > 0 ? generator.getLines() / m.seconds : 0.0, m.allocations, m.bytes,
+                         m.peakLive, m.peakRss);
+                out.write(record + numbers);
+            }
+            out.flush(); // a curve cut short by running out of memory keeps its finished sizes
         }
-        return ifNode;
     }
 
-    // void parseReturnStatement()
-    // {
-    //     expect(T_RETURN);
-    //     parseExpression();
-    //     expect(T_SEMICOLON);
-    // }
+private:
+    struct Measurement
+    {
+        double seconds = 0;
+        long long allocations = 0, bytes = 0, peakLive = 0;
+        long peakRss = 0;
+    };
 
-    shared_ptr<ASTNode> parseExpression(string scope = "main")
+    void compile(const string &source, vector<Measurement> &phases, bool counting)
     {
-        auto node = parseTerm(scope);
-        while (tokens[pos].type == T_PLUS || tokens[pos].type == T_MINUS || tokens[pos].type == T_GT || tokens[pos].type == T_ST || tokens[pos].type == T_GTE || tokens[pos].type == T_STE || tokens[pos].type == T_EQUALITY)
-        {
-            auto op = tokens[pos].value;
-            pos++;
-            auto right = parseTerm(scope);
-            auto opNode = make_shared<ASTNode>(op);
-            opNode->children.push_back(node);
-            opNode->children.push_back(right);
-            node = opNode; // Update the root of the expression tree
-        }
-        return node;
-        // if (tokens[pos].type == T_GT)
-        // {
-        //     pos++;
-        //     parseExpression(); // After relational operator, parse the next expression
-        // }
+        vector<Token> tokens;
+        shared_ptr<ASTNode> root;
+        SymbolTable symbolTable;
+        measure(phases[0], counting, [&]()
+                { tokens = Lexer(source).tokenize(); });
+        Parser parser(tokens, symbolTable);
+        parser.quiet = true;
+        measure(phases[1], counting, [&]()
+                { root = parser.parseProgram(); });
+        measure(phases[2], counting, [&]()
+                { parser.generateTAC(root); });
+        measure(phases[3], counting, [&]()
+                {
+                    Assembly assembly(symbolTable);
+                    assembly.threads = codegenThreads;
+                    assembly.generate(parser.tacList);
+                    PeepholeOptimizer peephole;
+                    assembly.runPeephole(peephole);
+#ifdef _WIN32
+                    FdWriter sink("NUL");
+#else
+                    FdWriter sink("/dev/null");
+#endif
+                    assembly.write(sink); });
     }
 
-    shared_ptr<ASTNode> parseTerm(string scope = "main")
+    template <typename Work>
+    static void measure(Measurement &m, bool counting, Work work)
     {
-        auto node = parseFactor(scope);
-        while (tokens[pos].type == T_MUL || tokens[pos].type == T_DIV)
+        long long allocations = AllocationTracker::allocations.load();
+        long long bytes = AllocationTracker::bytes.load();
+        long long outerPeak = AllocationTracker::resetPeak();
+        auto start = chrono::steady_clock::now();
+        work();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (counting)
         {
-            auto op = tokens[pos].value;
-            pos++;
-            auto right = parseFactor(scope);
-            auto opNode = make_shared<ASTNode>(op);
-            opNode->children.push_back(node);
-            opNode->children.push_back(right);
-            node = opNode; // Update the root of the term tree
+            m.allocations = AllocationTracker::allocations.load() - allocations;
+            m.bytes = AllocationTracker::bytes.load() - bytes;
+            m.peakLive = AllocationTracker::peak.load();
+            m.peakRss = AllocationTracker::peakRss();
         }
-        return node;
+        else if (m.seconds == 0 || seconds < m.seconds)
+            m.seconds = seconds;
+        AllocationTracker::restorePeak(outerPeak);
     }
+};
 
-    shared_ptr<ASTNode> parseFactor(string scope = "main")
+struct CompilerOptions
+{
+    string inputFile;
+    int evalBudget = 1000000; // TAC steps run at compile time, 0 disables partial evaluation
+    int inlineThreshold = 16; // callee size in TAC instructions, 0 disables inlining
+    int unrollBudget = 32;    // unrolled loop body size in TAC instructions, 0 disables unrolling
+    bool vectorize = true;    // native targets only; the VM and C keep scalar loops
+    bool avx2 = false;        // 8 lanes instead of SSE2's 4 in the assembly text targets
+    bool rotateLoops = true;
+    bool simplifyCFG = true;
+    bool peephole = true;
+    bool peepholeStats = false;
+    bool registerStats = false;
+    bool promoteVariables = true; // MASM keeps variables in registers across their live ranges
+    int codegenThreads = 0; // 0 uses one thread per core
+    bool run = false; // execute in the bytecode VM instead of emitting assembly
+    bool jit = false; // execute as native x86-64 code
+    string target = "masm"; // masm (Irvine32), gas (x86-64 System V), elf (object file) or c
+    string outputFile;      // assembly goes to stdout when empty
+    string runtimeFile;     // where to write the GAS runtime source
+    string profileGenerate; // the instrumented program writes its counts here
+    string profileUse;      // counts that drive inlining and block layout
+    bool timeReport = false;   // per-phase wall times on stderr at exit
+    bool memoryReport = false; // per-phase allocations, heap and RSS peaks on stderr at exit
+    string traceFile;          // Chrome trace-event JSON of the same phases
+    bool generate = false;        // write a generated program instead of compiling one
+    bool bench = false;           // run the compile-throughput curve instead of compiling
+    string programShape;          // ProgramGenerator::parseShape fields for both
+    vector<long long> benchLines; // program sizes of the curve, empty for the default
+};
+
+// the file after `-fname=`; an empty one would quietly turn the option off
+string pathOption(const string &arg, size_t prefix)
+{
+    if (arg.size() == prefix)
     {
-        if (tokens[pos].type == T_NUM || tokens[pos].type == T_ID)
+        cout << "Error: " << arg << " expects a file name" << endl;
+        exit(1);
+    }
+    return arg.substr(prefix);
+}
+
+CompilerOptions parseOptions(int argc, char *argv[])
+{
+    CompilerOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg.rfind("-fpartial-eval-budget=", 0) == 0)
         {
-            auto factor = tokens[pos].value;
-            auto node = make_shared<ASTNode>(factor);
-            pos++;
-            return node;
+            options.evalBudget = numericOption(arg, 22);
         }
-        else if (tokens[pos].type == T_LPAREN)
+        else if (arg == "-fno-partial-eval")
         {
-            expect(T_LPAREN);
-            auto node = parseExpression(scope);
-            expect(T_RPAREN);
-            return node;
+            options.evalBudget = 0;
         }
-        else
+        else if (arg.rfind("-finline-threshold=", 0) == 0)
         {
-            cout << "Syntax error: unexpected token " << tokens[pos].value << endl;
-            exit(1);
+            options.inlineThreshold = numericOption(arg, 19);
         }
-        return nullptr;
-    }
-
-    void expect(TokenType type)
-    {
-        if (tokens[pos].type == type)
+        else if (arg == "-fno-inline")
         {
-            pos++;
+            options.inlineThreshold = 0;
         }
-        else
+        else if (arg.rfind("-funroll-budget=", 0) == 0)
         {
-            cout << "Syntax error: expected " << tokenMap[type] << " but found " << tokens[pos].value << " on line no: " << tokens[pos].lineNo << endl;
-            exit(1);
+            options.unrollBudget = numericOption(arg, 16);
         }
-    }
-
-    // just for function call
-    int expectTwoToken(TokenType type1, TokenType type2)
-    {
-        if (tokens[pos].type == type1)
+        else if (arg == "-fno-unroll-loops")
         {
-            pos++;
-            return 1;
+            options.unrollBudget = 0;
         }
-        else if (tokens[pos].type == type2)
+        else if (arg == "-fno-vectorize")
         {
-            pos++;
-            return 2;
+            options.vectorize = false;
         }
-        else
+        else if (arg == "-mavx2")
         {
-            cout << "Syntax error: expected " << tokenMap[type1] << " or " << tokenMap[type2] << " but found " << tokens[pos].value << " on line no: " << tokens[pos].lineNo << endl;
+            options.avx2 = true;
+        }
+        else if (arg == "-fno-rotate-loops")
+        {
+            options.rotateLoops = false;
+        }
+        else if (arg == "-fno-simplify-cfg")
+        {
+            options.simplifyCFG = false;
+        }
+        else if (arg == "-fno-peephole")
+        {
+            options.peephole = false;
+        }
+        else if (arg == "-fpeephole-stats")
+        {
+            options.peepholeStats = true;
+        }
+        else if (arg == "-fno-promote-variables")
+        {
+            options.promoteVariables = false;
+        }
+        else if (arg == "-fregalloc-stats")
+        {
+            options.registerStats = true;
+        }
+        else if (arg.rfind("-fcodegen-threads=", 0) == 0)
+        {
+            options.codegenThreads = numericOption(arg, 18);
+        }
+        else if (arg == "--run")
+        {
+            options.run = true;
+        }
+        else if (arg == "--jit")
+        {
+            options.jit = true;
+        }
+        else if (arg.rfind("--target=", 0) == 0)
+        {
+            options.target = arg.substr(9);
+            if (options.target != "masm" && options.target != "gas" && options.target != "elf" &&
+                options.target != "c")
+            {
+                cout << "Error: unknown target " << options.target << endl;
+                exit(1);
+            }
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            options.outputFile = argv[++i];
+        }
+        else if (arg.rfind("--emit-runtime=", 0) == 0)
+        {
+            options.runtimeFile = arg.substr(15);
+        }
+        else if (arg == "-fprofile-generate" || arg.rfind("-fprofile-generate=", 0) == 0)
+        {
+            options.profileGenerate = arg.size() > 18 ? pathOption(arg, 19) : "program.profile";
+        }
+        else if (arg.rfind("-fprofile-use=", 0) == 0)
+        {
+            options.profileUse = pathOption(arg, 14);
+        }
+        else if (arg == "-ftime-report")
+        {
+            options.timeReport = true;
+        }
+        else if (arg == "-fmem-report")
+        {
+            options.memoryReport = true;
+        }
+        else if (arg.rfind("--trace=", 0) == 0)
+        {
+            options.traceFile = arg.substr(8);
+        }
+        else if (arg == "--generate" || arg.rfind("--generate=", 0) == 0)
+        {
+            options.generate = true;
+            options.programShape = arg.size() > 10 ? arg.substr(11) : "";
+        }
+        else if (arg == "--bench" || arg.rfind("--bench=", 0) == 0)
+        {
+            options.bench = true;
+            options.programShape = arg.size() > 7 ? arg.substr(8) : "";
+        }
+        else if (arg.rfind("--bench-lines=", 0) == 0)
+        {
+            stringstream sizes(arg.substr(14));
+            string size;
+            while (getline(sizes, size, ','))
+                options.benchLines.push_back(numericOption("--bench-lines=" + size, 14));
+            if (options.benchLines.empty())
+                numericOption(arg, 14); // reports the missing value
+        }
+        else if (!arg.empty() && arg[0] == '-')
+        {
+            cout << "Error: unknown option " << arg << endl;
             exit(1);
         }
+        else
+        {
+            options.inputFile = arg;
+        }
     }
-};
+    return options;
+}
 
-int main()
+string readSource(const string &path)
 {
+    ifstream file(path);
+    if (!file)
+    {
+        cout << "Error: cannot open " << path << endl;
+        exit(1);
+    }
+    stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+void writeOutput(const string &path, const string &text)
+{
+    PhaseTimer timer("write");
+    FdWriter out(path);
+    out.write(text);
+}
+
+int main(int argc, char *argv[])
+{
+    CompilerOptions options = parseOptions(argc, argv);
+    if (options.timeReport || options.memoryReport || !options.traceFile.empty())
+    {
+        PhaseTrace &trace = PhaseTrace::get();
+        trace.report = options.timeReport;
+        trace.memoryReport = options.memoryReport;
+        trace.tracePath = options.traceFile;
+        trace.start();
+    }
+    if (options.generate)
+    {
+        ProgramGenerator generator(ProgramGenerator::parseShape(options.programShape));
+        writeOutput(options.outputFile, generator.generate());
+        return 0;
+    }
+    if (options.bench)
+    {
+        CompileBenchmark benchmark;
+        benchmark.shape = ProgramGenerator::parseShape(options.programShape);
+        if (!options.benchLines.empty())
+            benchmark.sizes = options.benchLines;
+        benchmark.codegenThreads = options.codegenThreads;
+        FdWriter out(options.outputFile);
+        benchmark.run(out);
+        return 0;
+    }
     string input = R"(
        {
             def findFact(a)
@@ -2134,56 +9222,204 @@ int main()
             call findFact(num);
         }
     )";
+    if (!options.inputFile.empty())
+    {
+        PhaseTimer timer("read");
+        input = readSource(options.inputFile);
+    }
 
     Lexer lexer(input);
-    vector<Token> tokens = lexer.tokenize();
+    vector<Token> tokens;
+    {
+        PhaseTimer timer("lex");
+        tokens = lexer.tokenize();
+    }
 
     SymbolTable symbolTable;
 
     Parser parser(tokens, symbolTable);
-    auto node = parser.parseProgram();
+    shared_ptr<ASTNode> node;
+    {
+        PhaseTimer timer("parse");
+        node = parser.parseProgram();
+    }
     // parser.printAST(node);
     int t = 1;
-    auto tac = parser.generateTAC(node);
-
-    for (auto s : parser.tacList)
     {
-        s.print();
+        PhaseTimer timer("tac");
+        parser.generateTAC(node);
     }
-    cout << endl
-         << endl;
 
-    Assembly asembly(symbolTable);
-    asembly.declareVariablesInDataSegment();
-
-    // for (auto ds : asembly.getDataSegmentForScope("main"))
-    // {
-    //     cout << ds;
-    // }
+    if (options.evalBudget > 0)
+    {
+        PhaseTimer timer("partial-eval");
+        PartialEvaluator evaluator(parser, symbolTable, options.evalBudget);
+        evaluator.run();
+    }
+    Profile profile(input);
+    bool profiling = !options.profileGenerate.empty();
+    if (profiling && !options.run && !options.jit && options.target != "gas" && options.target != "c")
+    {
+        cout << "Error: -fprofile-generate needs --run, --jit, --target=gas or --target=c" << endl;
+        exit(1);
+    }
+    if (profiling || !options.profileUse.empty())
+        profile.stamp(parser.tacList);
+    if (!options.profileUse.empty())
+    {
+        PhaseTimer timer("profile-use");
+        profile.use(options.profileUse, parser.tacList);
+    }
+    // counters go in before the passes copy, invert or delete branches, so each
+    // one still counts its source `if` or call however the code is rearranged
+    if (profiling)
+    {
+        PhaseTimer timer("instrument");
+        profile.instrument(parser.tacList);
+    }
+    if (options.inlineThreshold > 0)
+    {
+        PhaseTimer timer("inline");
+        Inliner inliner(parser, symbolTable, options.inlineThreshold);
+        inliner.run();
+    }
+    // instrumented builds stay scalar so every target records the same counts
+    if (options.vectorize && !profiling && !options.run && options.target != "c")
+    {
+        PhaseTimer timer("vectorize");
+        // the x86-64 encoder behind --jit and elf only knows SSE2
+        bool textTarget = !options.jit && (options.target == "masm" || options.target == "gas");
+        Vectorizer vectorizer(parser, options.avx2 && textTarget ? 8 : 4);
+        vectorizer.run();
+    }
+    if (options.unrollBudget > 0)
+    {
+        PhaseTimer timer("unroll");
+        LoopUnroller unroller(parser, options.unrollBudget);
+        unroller.run();
+    }
+    if (options.rotateLoops)
+    {
+        PhaseTimer timer("rotate-loops");
+        LoopRotation rotation(parser);
+        rotation.run();
+    }
+    if (options.simplifyCFG)
+    {
+        PhaseTimer timer("simplify-cfg");
+        CFGSimplifier simplifier(parser);
+        simplifier.run();
+    }
+    if (!options.profileUse.empty())
+    {
+        PhaseTimer timer("block-layout");
+        BlockLayout layout(parser);
+        layout.run();
+    }
 
-    bool isFunction = false;
-    for (auto s : parser.tacList)
+    if (options.run)
+    {
+        BytecodeCompiler compiler;
+        BytecodeProgram program;
+        {
+            PhaseTimer timer("codegen");
+            program = compiler.compile(parser.tacList);
+        }
+        program.counters.assign(profile.counters.size(), 0);
+        VirtualMachine vm(program);
+        {
+            PhaseTimer timer("execute");
+            vm.run();
+        }
+        if (profiling)
+        {
+            profile.counters = program.counters;
+            writeOutput(options.profileGenerate, profile.text());
+        }
+        return 0;
+    }
+    if (options.jit)
+    {
+        JitExecutor executor;
+        executor.run(parser.tacList, profile.counters.data());
+        if (profiling)
+            writeOutput(options.profileGenerate, profile.text());
+        return 0;
+    }
+    if (!options.runtimeFile.empty())
+    {
+        writeOutput(options.runtimeFile, gasRuntimeSource);
+    }
+    if (options.target == "gas")
     {
-        if (s.result == "return")
+        GasAssembly gas;
+        gas.avx2 = options.avx2;
+        if (profiling)
         {
-            isFunction = false;
-            asembly.generateFunctionAssembly(s);
+            gas.profileCounters = profile.counters.size();
+            gas.profilePath = options.profileGenerate;
+            gas.profileHeader = profile.header();
         }
-        else if (s.result == "function" || isFunction)
+        writeOutput(options.outputFile, gas.getAssembly(parser.tacList));
+        return 0;
+    }
+    if (options.target == "c")
+    {
+        CBackend backend;
+        if (profiling)
+        {
+            backend.profileCounters = profile.counters.size();
+            backend.profilePath = options.profileGenerate;
+            backend.profileHeader = profile.header();
+        }
+        writeOutput(options.outputFile, backend.generate(parser.tacList));
+        return 0;
+    }
+    if (options.target == "elf")
+    {
+        if (options.outputFile.empty())
         {
-            isFunction = true;
-            asembly.generateFunctionAssembly(s);
+            cout << "Error: --target=elf needs -o <file>" << endl;
+            exit(1);
         }
-        else if (!isFunction)
+        ElfObjectWriter writer;
+        vector<uint8_t> object = writer.write(parser.tacList);
+        writeOutput(options.outputFile, string(object.begin(), object.end()));
+        return 0;
+    }
+
+    {
+        PhaseTimer timer("print tac");
+        for (auto s : parser.tacList)
         {
-            asembly.generateMainAssembly(s);
+            s.print();
         }
+        cout << endl
+             << endl;
+    }
+
+    Assembly asembly(symbolTable);
+    asembly.threads = options.codegenThreads;
+    asembly.promoteVariables = options.promoteVariables;
+    asembly.avx2 = options.avx2;
+
+    asembly.generate(parser.tacList);
+    if (options.registerStats)
+        asembly.printRegisterStats(cerr);
+
+    if (options.peephole)
+    {
+        PhaseTimer timer("peephole");
+        PeepholeOptimizer peephole;
+        asembly.runPeephole(peephole);
+        if (options.peepholeStats)
+            peephole.printStats(cerr);
     }
 
-    cout << asembly.getAssembly();
+    PhaseTimer timer("write");
+    FdWriter out(options.outputFile);
+    asembly.write(out);
 
-    // cout << endl
-    //      << asembly.getDataSegment() << endl;
     // parsser.printTAC(tac.instructions);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+# Runs the MASM the default target emits, without Irvine32 or Windows.
+# usage: python3 masmsim.py program.asm < input
+# Models the instruction subset the compiler uses with 32-bit wrapping, prints
+# what WriteDec, WriteString and Crlf would, and reads ReadInt values from
+# stdin. A zero divisor prints the message the VM gives (the real program would
+# fault there).
+import sys, re
+lines=[l.strip() for l in open(sys.argv[1]) if l.strip()]
+inp=[int(x) for x in sys.stdin.read().split()]
+M=0xffffffff
+def s32(v): v&=M; return v-(1<<32) if v&0x80000000 else v
+code=[]; labels={}; procs={}; data={}; text={}
+for l in lines:
+    m=re.match(r'^(\S+)\s*(.*)$',l); op=m.group(1); rest=m.group(2)
+    if op.endswith(':'): labels[op[:-1]]=len(code); continue
+    if rest.upper().startswith('BYTE'):
+        # name BYTE "text",0 gets a made-up address that OFFSET returns
+        data[op.lower()]=0x10000000+len(data); text[data[op.lower()]]=re.search(r'"(.*)"',rest).group(1); continue
+    if rest.upper().startswith('PROC') or rest.lower().startswith('proc'):
+        uses=rest.split()[2:] if 'USES' in rest.upper() else []
+        procs[op]=len(code); code.append(('PROC',[op,uses])); continue
+    if rest.lower().startswith('endp'): continue
+    if op.startswith('.'): continue
+    args=[a.strip() for a in rest.split(',')] if rest else []
+    code.append((op.upper(),args))
+R={r:0 for r in 'eax ebx ecx edx esi edi ebp esp'.split()}
+R['esp']=1<<20; mem={}; frames=[]; flags=(0,0); out=[]
+def addr(a):
+    for w in ('DWORD PTR','XMMWORD PTR','YMMWORD PTR'): a=a.replace(w,'')
+    a=a.strip()[1:-1].strip().lower()
+    if re.match(r'^[a-z_][a-z0-9_]*$',a) and a not in R: return ('v',len(frames),a)
+    e=a.replace(' ','').replace('-','+-'); v=0
+    for term in [t for t in e.split('+') if t]:
+        neg=term.startswith('-'); term=term.lstrip('-')
+        if '*' in term: r_,k=term.split('*'); tv=R[r_]*int(k)
+        elif term in R: tv=R[term]
+        else: tv=int(term)
+        v+= -tv if neg else tv
+    return v
+def get(a):
+    al=a.lower()
+    if al in R: return R[al]
+    if al.startswith('offset '): return data[al[7:].strip()]
+    if '[' in a: return mem.get(addr(a),0)
+    return int(a)
+def put(a,v):
+    al=a.lower(); v=s32(v)
+    if al in R: R[al]=v
+    else: mem[addr(a)]=v
+def push(v): R['esp']-=4; mem[R['esp']]=s32(v)
+def pop(): v=mem[R['esp']]; R['esp']+=4; return v
+V={k:[0]*8 for k in range(8)}
+def vreg(a):
+    a=a.strip().lower()
+    if a[:3] in('xmm','ymm') and a[3:].isdigit(): return int(a[3:]),(4 if a[0]=='x' else 8)
+    return None
+def vget(a,n):
+    r=vreg(a)
+    if r: return V[r[0]][:n]
+    b=addr(a); return [mem.get(b+4*k,0)&M for k in range(n)]
+def vput(a,lanes):
+    r=vreg(a)
+    if r:
+        V[r[0]][:len(lanes)]=[x&M for x in lanes]
+    else:
+        b=addr(a)
+        for k,x in enumerate(lanes): mem[b+4*k]=s32(x)
+def width(a): r=vreg(a); return r[1] if r else (8 if 'YMMWORD' in a else 4)
+def shuf(x,imm): return [x[(imm>>(2*k))&3] for k in range(4)]
+def muludq(x,y):
+    p0=(x[0]*y[0])&0xffffffffffffffff; p1=(x[2]*y[2])&0xffffffffffffffff
+    return [p0&M,p0>>32,p1&M,p1>>32]
+pc=procs['main']; steps=0
+while True:
+    steps+=1
+    if steps>50_000_000: print("TIMEOUT"); break
+    op,a=code[pc]; pc+=1
+    if op=='PROC':
+        framed = a[0]=='main' or code[pc][0]=='LOCAL'
+        if framed: push(R['ebp']); R['ebp']=R['esp']
+        for r in a[1]: push(R[r])
+        frames.append((a[0],a[1],framed))
+        # fresh locals: clear this depth
+        d=len(frames)
+        for k in [k for k in mem if isinstance(k,tuple) and k[1]==d]: del mem[k]
+    elif op=='LOCAL': pass
+    elif op=='MOV': put(a[0],get(a[1]))
+    elif op=='ADD': put(a[0],get(a[0])+get(a[1])); flags=(s32(get(a[0])),0)
+    elif op=='SUB': put(a[0],get(a[0])-get(a[1])); flags=(s32(get(a[0])),0)
+    elif op=='TEST': get(a[0])
+    elif op=='IMUL':
+        if len(a)==1:
+            pr=R['eax']*get(a[0]); R['eax']=s32(pr); R['edx']=s32(pr>>32)
+        elif len(a)==3: put(a[0],get(a[1])*int(a[2]))
+        else: put(a[0],get(a[0])*get(a[1]))
+    elif op=='LEA':
+        e=a[1].strip()[1:-1].replace('-','+-'); v=0
+        for term in [t.strip() for t in e.split('+') if t.strip()]:
+            neg=term.startswith('-'); term=term.lstrip('-').strip()
+            if '*' in term: r_,k=term.split('*'); tv=R[r_.strip().lower()]*int(k)
+            elif term.lower() in R: tv=R[term.lower()]
+            else: tv=int(term)
+            v+= -tv if neg else tv
+        put(a[0],v)
+    elif op=='SHL': put(a[0],get(a[0])<<get(a[1]))
+    elif op=='SAR': put(a[0],get(a[0])>>get(a[1]))
+    elif op=='SHR': put(a[0],(get(a[0])&M)>>get(a[1]))
+    elif op=='AND': put(a[0],get(a[0])&get(a[1]))
+    elif op=='NEG': put(a[0],-get(a[0]))
+    elif op=='XOR': put(a[0],get(a[0])^get(a[1]))
+    elif op=='XCHG': x=get(a[0]); put(a[0],get(a[1])); put(a[1],x)
+    elif op=='CDQ': R['edx']=-1 if R['eax']<0 else 0
+    elif op=='IDIV':
+        d=get(a[0]); n=R['eax']
+        if d==0: out.append("Error: division by zero\n"); break
+        q=abs(n)//abs(d); q=q if (n<0)==(d<0) else -q
+        if q>0x7fffffff: out.append("DIVIDE ERROR\n"); break
+        R['eax']=s32(q); R['edx']=s32(n-q*d)
+    elif op=='LEAVE': R['esp']=R['ebp']; R['ebp']=pop()
+    elif op=='PUSH': push(get(a[0]))
+    elif op=='POP': put(a[0],pop())
+    elif op=='PUSHAD':
+        t=R['esp']
+        for r in 'eax ecx edx ebx'.split(): push(R[r])
+        push(t)
+        for r in 'ebp esi edi'.split(): push(R[r])
+    elif op=='POPAD':
+        for r in 'edi esi ebp'.split(): R[r]=pop()
+        pop()
+        for r in 'ebx edx ecx eax'.split(): R[r]=pop()
+    elif op=='CMP': flags=(get(a[0]),get(a[1]))
+    elif op in('JMP','JG','JL','JGE','JLE','JE','JNE','JNZ','JZ','JB','JAE'):
+        x,y=flags
+        t={'JMP':True,'JG':x>y,'JL':x<y,'JGE':x>=y,'JLE':x<=y,'JE':x==y,'JNE':x!=y,'JNZ':x!=y,'JZ':x==y,
+           'JB':(x&M)<(y&M),'JAE':(x&M)>=(y&M)}[op]
+        if t: pc=labels[a[0]]
+    elif op=='CALL':
+        n=a[0]
+        if n.lower()=='writedec': out.append(str(R['eax']))
+        elif n.lower()=='writestring': out.append(text[R['edx']])
+        elif n.lower()=='crlf': out.append('\n')
+        elif n.lower()=='readint': R['eax']=inp.pop(0)
+        else: push(pc); pc=procs[n]
+    elif op=='RET':
+        name,uses,framed=frames.pop()
+        for r in reversed(uses): R[r]=pop()
+        if framed: R['esp']=R['ebp']; R['ebp']=pop()
+        pc=pop()
+        R['ecx']=0x1badc0de; R['edx']=-0x2badbeef  # caller-saved: never rely on them
+    elif op in('MOVD','VMOVD'):
+        if vreg(a[0]): vput(a[0],[get(a[1])&M,0,0,0])
+        else: put(a[0],s32(V[vreg(a[1])[0]][0]))
+    elif op in('PXOR','VPXOR'): vput(a[0],[0]*width(a[0]))
+    elif op in('MOVDQU','MOVDQA','VMOVDQU'):
+        n=min(width(a[0]),width(a[1])); vput(a[0],vget(a[1],n))
+    elif op=='PSHUFD': vput(a[0],shuf(vget(a[1],4),int(a[2])))
+    elif op=='VPSHUFD': vput(a[0],shuf(vget(a[1],4),int(a[2])))
+    elif op=='VPBROADCASTD': vput(a[0],[vget(a[1],1)[0]]*8)
+    elif op=='VEXTRACTI128': vput(a[0],vget(a[1],8)[4:8])
+    elif op in('PADDD','PSUBD','PMULUDQ','PUNPCKLDQ'):
+        x=vget(a[0],4); y=vget(a[1],4)
+        r={'PADDD':lambda:[p+q for p,q in zip(x,y)],'PSUBD':lambda:[p-q for p,q in zip(x,y)],
+           'PMULUDQ':lambda:muludq(x,y),'PUNPCKLDQ':lambda:[x[0],y[0],x[1],y[1]]}[op]()
+        vput(a[0],r)
+    elif op=='PSLLD': vput(a[0],[p<<int(a[1]) for p in vget(a[0],4)])
+    elif op in('VPADDD','VPSUBD','VPMULLD'):
+        n=width(a[0]); x=vget(a[1],n); y=vget(a[2],n)
+        f={'VPADDD':lambda p,q:p+q,'VPSUBD':lambda p,q:p-q,'VPMULLD':lambda p,q:p*q}[op]
+        vput(a[0],[f(p,q) for p,q in zip(x,y)])
+    elif op=='VPSLLD': n=width(a[0]); vput(a[0],[p<<int(a[2]) for p in vget(a[1],n)])
+    elif op=='VZEROUPPER':
+        for k in V: V[k][4:]=[0]*4
+    elif op=='INVOKE': break
+    else: print("UNKNOWN",op,a); break
+sys.stdout.write("".join(out))
+import os
+if os.environ.get('MASMSTEPS'): sys.stderr.write("steps %d\n"%steps)
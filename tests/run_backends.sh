@@ -0,0 +1,87 @@
+#!/bin/bash
+# Checks the native backends against the bytecode VM, and that profile counts
+# do not depend on the loop passes.
+# usage: tests/run_backends.sh [compiler flags...]
+# Builds Symbol_Table.cpp and the --emit-runtime runtime, then runs every
+# program in tests/programs and tests/fuzz through --jit, --target=gas (as and
+# ld), --target=elf (ld) and --target=c (cc), comparing each output with --run
+# on the same input; the VM with every pass off must agree too, which keeps the
+# passes from dropping a run-time error. Programs in tests/programs are also run with
+# -fprofile-generate on the VM, the JIT, GAS and C, with and without
+# -fno-rotate-loops -fno-unroll-loops, and the two profiles must be identical;
+# divret.txt, bounds.txt and loop.txt cover the checks and counts that broke.
+# Exits non-zero when anything differs.
+cd "$(dirname "$0")/.." || exit 1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+g++ -std=c++17 -O2 -o "$work/cc" Symbol_Table.cpp || exit 1
+echo "{ int x; x = 0; print(x); }" >"$work/empty.txt"
+"$work/cc" --target=gas --emit-runtime="$work/runtime.c" -o "$work/empty.s" "$work/empty.txt" 2>/dev/null || exit 1
+cc -c -O2 -ffreestanding -fno-stack-protector -fno-pie -o "$work/runtime.o" "$work/runtime.c" || exit 1
+
+# build <backend> <program> [flags...]: leaves a runnable $work/prog, or fails
+build() {
+    local backend=$1 f=$2
+    shift 2
+    case $backend in
+    jit)
+        printf '#!/bin/sh\nexec "%s" --jit %s "%s"\n' "$work/cc" "$*" "$f" >"$work/prog" && chmod +x "$work/prog" ;;
+    gas)
+        "$work/cc" "$@" --target=gas -o "$work/prog.s" "$f" >/dev/null 2>&1 &&
+            as -o "$work/prog.o" "$work/prog.s" && ld -o "$work/prog" "$work/prog.o" "$work/runtime.o" ;;
+    elf)
+        "$work/cc" "$@" --target=elf -o "$work/prog.o" "$f" >/dev/null 2>&1 &&
+            ld -o "$work/prog" "$work/prog.o" "$work/runtime.o" ;;
+    c)
+        "$work/cc" "$@" --target=c -o "$work/prog.c" "$f" >/dev/null 2>&1 &&
+            cc -O2 -w -o "$work/prog" "$work/prog.c" ;;
+    run)
+        printf '#!/bin/sh\nexec "%s" --run %s "%s"\n' "$work/cc" "$*" "$f" >"$work/prog" && chmod +x "$work/prog" ;;
+    plain)
+        build run "$f" "$@" -fno-partial-eval -fno-inline -fno-unroll-loops -fno-vectorize -fno-rotate-loops -fno-simplify-cfg ;;
+    esac
+}
+
+input="6 7 8 9 10"
+failed=0 total=0
+for f in tests/programs/*.txt tests/fuzz/*.txt; do
+    vm=$(echo "$input" | timeout 20 "$work/cc" "$@" --run "$f" 2>/dev/null)
+    for backend in plain jit gas elf c; do
+        total=$((total + 1))
+        rm -f "$work/prog"
+        if ! build $backend "$f" "$@"; then
+            echo "FAIL $backend compile $f"
+            failed=$((failed + 1))
+            continue
+        fi
+        out=$(echo "$input" | timeout 20 "$work/prog" 2>/dev/null)
+        if [ "$out" != "$vm" ]; then
+            echo "DIFF $backend $f"
+            diff <(echo "$vm") <(echo "$out") | head -5
+            failed=$((failed + 1))
+        fi
+    done
+done
+echo "$((total - failed)) of $total backend runs match the VM"
+
+profiles=0 mismatched=0
+for f in tests/programs/*.txt; do
+    # a program stopped by a run-time error writes no profile
+    echo "$input" | timeout 20 "$work/cc" "$@" --run "$f" >/dev/null 2>&1 || continue
+    for backend in run jit gas c; do
+        profiles=$((profiles + 1))
+        for passes in on off; do
+            flags=(-fprofile-generate="$work/$passes.profile")
+            [ $passes = off ] && flags+=(-fno-rotate-loops -fno-unroll-loops)
+            rm -f "$work/$passes.profile"
+            build $backend "$f" "$@" "${flags[@]}" && echo "$input" | timeout 20 "$work/prog" >/dev/null 2>&1
+        done
+        if [ ! -s "$work/on.profile" ] || ! cmp -s "$work/on.profile" "$work/off.profile"; then
+            echo "PROFILE $backend $f"
+            diff "$work/on.profile" "$work/off.profile" 2>&1 | head -5
+            mismatched=$((mismatched + 1))
+        fi
+    done
+done
+echo "$((profiles - mismatched)) of $profiles profiles are the same without loop rotation and unrolling"
+[ "$failed" -eq 0 ] && [ "$mismatched" -eq 0 ]
@@ -0,0 +1,40 @@
+#!/bin/bash
+# Checks the default MASM target against the bytecode VM and reports what the
+# peephole pass removes from the sample programs.
+# usage: tests/run_masm.sh [compiler flags...]
+# Builds Symbol_Table.cpp, then for every program in tests/programs and
+# tests/fuzz compiles it to MASM, runs it in masmsim.py and compares the output
+# with --run on the same input. Exits non-zero when any program differs.
+cd "$(dirname "$0")/.." || exit 1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+g++ -std=c++17 -O2 -o "$work/cc" Symbol_Table.cpp || exit 1
+
+input="6 7 8 9 10"
+failed=0 total=0 removed=0 emitted=0
+for f in tests/programs/*.txt tests/fuzz/*.txt; do
+    total=$((total + 1))
+    if ! "$work/cc" "$@" -fpeephole-stats -o "$work/out.asm" "$f" >/dev/null 2>"$work/stats"; then
+        echo "FAIL compile $f"
+        failed=$((failed + 1))
+        continue
+    fi
+    if [[ $f == tests/programs/* ]]; then
+        # "peephole: removed X of Y instructions (Z%)"
+        read -r x y < <(sed -n 's/^peephole: removed \([0-9]*\) of \([0-9]*\).*/\1 \2/p' "$work/stats")
+        removed=$((removed + ${x:-0}))
+        emitted=$((emitted + ${y:-0}))
+    fi
+    masm=$(echo "$input" | timeout 60 python3 tests/masmsim.py "$work/out.asm")
+    vm=$(echo "$input" | timeout 20 "$work/cc" "$@" --run "$f" 2>/dev/null)
+    if [ "$masm" != "$vm" ]; then
+        echo "DIFF $f"
+        diff <(echo "$vm") <(echo "$masm") | head -5
+        failed=$((failed + 1))
+    fi
+done
+echo "$((total - failed)) of $total programs match the VM"
+if [ "$emitted" -gt 0 ]; then
+    echo "peephole on tests/programs: removed $removed of $emitted instructions ($((1000 * removed / emitted / 10)).$((1000 * removed / emitted % 10))%)"
+fi
+[ "$failed" -eq 0 ]